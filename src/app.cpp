@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <memory>
 #include <filesystem>
+#include <chrono>
+#include <ctime>
 
 #include <imgui.h>
 #include <examples/imgui_impl_glfw.h>
@@ -24,9 +26,12 @@
 #include "app_log.hpp"
 #include "image.hpp"
 #include "recording.hpp"
+#include "stream_sink.hpp"
+#include "h264_encoder.hpp"
 #include "buffers.hpp"
 #include "shader_files.hpp"
 #include "default_shader.hpp"
+#include "cpu_profiler.hpp"
 
 namespace fs = std::filesystem;
 
@@ -71,6 +76,12 @@ void EnableOpenGLDebugExtention() {
     }
 }
 #endif
+
+template <typename T>
+void appendBytes(std::vector<uint8_t>& bytes, const T& value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    bytes.insert(bytes.end(), p, p + sizeof(T));
+}
 }  // namespace
 
 namespace shader_editor {
@@ -127,6 +138,8 @@ UniformNames App::getCurrentUniformNames() {
 }
 
 void App::setupPlatformUniform(const UniformNames& uNames) {
+    PROFILE_SCOPE("setupPlatformUniform");
+
     const ImGuiIO& io = ImGui::GetIO();
     const bool* const mouseDown = io.MouseDown;
     const bool wantCaptureKeyboard = io.WantCaptureKeyboard;
@@ -154,7 +167,8 @@ void App::setupPlatformUniform(const UniformNames& uNames) {
     auto spd = 2.0f * ImGui::GetIO().DeltaTime;
     auto rotT = glm::transpose(glm::mat3_cast(rot));
 
-    if (!wantCaptureKeyboard) {
+    // There is no window (and no keyboard) when running headless.
+    if (!wantCaptureKeyboard && mainWindow != nullptr) {
         if (glfwGetKey(mainWindow, GLFW_KEY_W) >= GLFW_PRESS) {
             posCamera -= rotT * glm::vec3(0.0f, 0.0f, spd);
         }
@@ -223,6 +237,52 @@ void App::setupPlatformUniform(const UniformNames& uNames) {
     }
 }
 
+bool App::isTimeDependentProgram(const UniformNames& uNames) const {
+    return program->isUniformActive(uNames.time) ||
+           program->isUniformActive(uNames.frame) ||
+           program->isUniformActive(uNames.mouse) ||
+           program->isUniformActive(uNames.backbuffer) ||
+           program->isUniformActive(uNames.matMV) ||
+           program->isUniformActive(uNames.matMV_T) ||
+           program->isUniformActive(uNames.matMV_IT);
+}
+
+bool App::updateFrameCache(const UniformNames& uNames,
+                           const std::map<std::string, PImage>& usedTextures) {
+    if (!uiStaticFrameCache || recording->getIsRecording() ||
+        !program->isOK() || isTimeDependentProgram(uNames)) {
+        frameCacheKey.clear();
+        return false;
+    }
+
+    // Everything the image of a time-independent program depends on.
+    std::vector<uint8_t> key;
+    appendBytes(key, program->getSerial());
+    appendBytes(key, buffers.getGeneration());
+    // The render size changes without reallocating the buffers.
+    appendBytes(key, buffers.getWidth());
+    appendBytes(key, buffers.getHeight());
+
+    const auto& uniforms = program->getUniforms();
+    for (auto it = uniforms.cbegin(); it != uniforms.cend(); it++) {
+        const ShaderUniform& u = it->second;
+        if (u.location < 0) {
+            continue;
+        }
+
+        appendBytes(key, u.location);
+        appendBytes(key, u.value);
+    }
+
+    for (auto it = usedTextures.cbegin(); it != usedTextures.cend(); it++) {
+        appendBytes(key, it->second->getTexture());
+    }
+
+    const bool hit = key == frameCacheKey;
+    frameCacheKey.swap(key);
+    return hit;
+}
+
 void App::setupShaderTemplate(PShaderProgram newProgram) {
     switch (uiShaderPlatformIndex) {
         case SHADER_TOY: {
@@ -239,6 +299,8 @@ void App::setupShaderTemplate(PShaderProgram newProgram) {
 }
 
 PShaderProgram App::refreshShaderProgram(float now, int32_t& cursorLine) {
+    PROFILE_SCOPE("refreshShaderProgram");
+
     PShaderProgram newProgram = std::make_shared<ShaderProgram>();
 
     newProgram->setCompileInfo(
@@ -275,6 +337,8 @@ PShaderProgram App::refreshShaderProgram(float now, int32_t& cursorLine) {
 }
 
 void App::update(void*) {
+    PROFILE_SCOPE("App::update");
+
     std::map<std::string, PImage> usedTextures;
 
     int currentWidth, currentHeight;
@@ -287,12 +351,29 @@ void App::update(void*) {
 
     auto uNames = getCurrentUniformNames();
 
+#ifndef __EMSCRIPTEN__
+    // Nothing is visible while minimized, sleep until the window is restored.
+    if (!recording->getIsRecording() &&
+        glfwGetWindowAttrib(mainWindow, GLFW_ICONIFIED)) {
+        scheduler.invalidate();
+        scheduler.waitEvents(false, CheckInterval);
+        return;
+    }
+#endif
+
     glfwMakeContextCurrent(mainWindow);
     glfwGetFramebufferSize(mainWindow, &currentWidth, &currentHeight);
 
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    {
+        PROFILE_SCOPE("NewFrame");
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+    }
+
+    if (hasInputActivity()) {
+        scheduler.invalidate();
+    }
 
     auto newProgram = refreshShaderProgram(now, cursorLine);
 
@@ -302,6 +383,8 @@ void App::update(void*) {
     }
 
     if (needRecompile && now > lastTextEdited + recompileDelay) {
+        PROFILE_SCOPE("recompileFragmentShader");
+
         needRecompile = false;
 
         setupShaderTemplate(newProgram);
@@ -333,6 +416,7 @@ void App::update(void*) {
     // onResizeWindow
     if (!recording->getIsRecording() &&
         (currentWidth != windowWidth || currentHeight != windowHeight)) {
+        scheduler.invalidate();
         buffers.updateFrameBuffersSize(
             static_cast<GLint>(currentWidth * bufferScale),
             static_cast<GLint>(currentHeight * bufferScale));
@@ -354,12 +438,22 @@ void App::update(void*) {
 
     getUsedTextures(uNames, usedTextures);
 
+    // Offline export renders frames back to back, the window only shows the
+    // latest frame and the progress a few times per second.
+    bool offlineExport = recording->getIsRecording() && isOfflineExport();
+    if (offlineExport) {
+        exportOfflineFrames(uNames, usedTextures, currentWidth, currentHeight);
+        offlineExport = recording->getIsRecording();
+    }
+
     if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Escape)) &&
         !recording->getIsRecording()) {
         uiDebugWindow = !uiDebugWindow;
     }
 
     if (uiDebugWindow) {
+        PROFILE_SCOPE("build UI");
+
         if (ImGui::BeginMainMenuBar()) {
             if (ImGui::BeginMenu("File")) {
 #if defined(_MSC_VER) || defined(__MINGW32__)
@@ -440,6 +534,22 @@ void App::update(void*) {
 
                 ImGui::MenuItem("Export as Video", nullptr, &uiCaptureWindow);
 
+#ifndef __EMSCRIPTEN__
+                if (ImGui::MenuItem("Record CPU Trace", nullptr,
+                                    &uiCpuTrace)) {
+                    if (uiCpuTrace) {
+                        startCpuTrace("trace.json");
+                    } else {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+                        saveFileDialog(cpuTraceFileName,
+                                       "Trace file (*.json)\0*.json\0",
+                                       "json");
+#endif
+                        stopCpuTrace();
+                    }
+                }
+#endif
+
                 ImGui::EndMenu();
             }
 
@@ -498,12 +608,16 @@ void App::update(void*) {
                     ImGui::EndMenu();
                 }
 
+                ImGui::MenuItem("Static Frame Cache", nullptr,
+                                &uiStaticFrameCache);
+
                 ImGui::EndMenu();
             }
 
             if (ImGui::BeginMenu("View")) {
                 ImGui::MenuItem("TextEditor", nullptr, &uiShowTextEditor);
                 ImGui::MenuItem("Stats", nullptr, &uiStatsWindow);
+                ImGui::MenuItem("Performance", nullptr, &uiPerformanceWindow);
                 ImGui::MenuItem("Time", nullptr, &uiTimeWindow);
                 ImGui::MenuItem("Camera", nullptr, &uiCameraWindow);
                 ImGui::MenuItem("Uniforms", nullptr, &uiUniformWindow);
@@ -548,6 +662,10 @@ void App::update(void*) {
             onUiStatsWindow();
         }
 
+        if (uiPerformanceWindow) {
+            onUiPerformanceWindow();
+        }
+
         if (uiUniformWindow) {
             onUiUniformWindow(uNames, usedTextures);
         }
@@ -567,67 +685,51 @@ void App::update(void*) {
 #endif
     }
 
-    ImGui::Render();
-
-    glBindFramebuffer(GL_FRAMEBUFFER, buffers.getFrameBuffer(WRITE));
-    glViewport(0, 0, buffers.getWidth(), buffers.getHeight());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // uniform values
-
-    setupPlatformUniform(uNames);
-
-    program->setUniformValue(
-        uNames.resolution,
-        glm::vec2(static_cast<GLfloat>(buffers.getWidth()),
-                  static_cast<GLfloat>(buffers.getHeight())));
-
-    program->setUniformValue(uNames.time, uiTimeValue);
+    {
+        PROFILE_SCOPE("ImGui::Render");
+        ImGui::Render();
+    }
 
-    if (program->isOK()) {
-        glUseProgram(program->getProgram());
+    gpuProfiler.collect();
+    updateRenderScale(uNames);
 
-        int32_t channel = 0;
+    setupFrameUniforms(uNames);
 
-        for (auto iter = usedTextures.begin(); iter != usedTextures.end();
-             iter++) {
-            PImage image = iter->second;
+    // A program that reads none of the animated uniforms renders the same
+    // image until its inputs change, so keep presenting the last frame.
+    frameCacheHit = updateFrameCache(uNames, usedTextures);
 
-            if (!image->isLoaded()) {
-                image->load();
-            }
+    // Progressive frames are split into tiles drawn over several updates,
+    // they cannot be combined with a changing render size or with export.
+    const bool progressive = uiProgressiveRendering && !uiDynamicResolution &&
+                             !recording->getIsRecording() && program->isOK();
 
-            glActiveTexture(GL_TEXTURE0 + channel);
-            glBindTexture(GL_TEXTURE_2D, image->getTexture());
-            program->setUniformValue(iter->first, channel++);
-        }
+    if (!progressive || progressiveSerial != program->getSerial() ||
+        progressiveGeneration != buffers.getGeneration()) {
+        progressiveRenderer.cancel();
+    }
 
-        glActiveTexture(GL_TEXTURE0 + channel);
-        glBindTexture(GL_TEXTURE_2D, buffers.getBackBuffer(READ));
-        program->setUniformValue(uNames.backbuffer, channel++);
-        program->applyUniforms();
+    bool frameCompleted = !frameCacheHit && !offlineExport;
 
-        glBindVertexArray(vertexArraysObject);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
-        glBindVertexArray(0);
+    if (progressive) {
+        frameCompleted = renderProgressiveTiles(uNames, usedTextures);
+    } else if (program->isOK() && !frameCacheHit && !offlineExport) {
+        renderShaderPass(uNames, usedTextures);
     }
 
-    if (recording->getIsRecording()) {
+    if (offlineExport) {
+        // Frames were already recorded by exportOfflineFrames().
+    } else if (recording->getIsRecording()) {
         bool isLastFrame = uiTimeValue >= uiVideoTime;
 
-        recording->update(isLastFrame, currentFrame,
-                          buffers.getPixelBuffer(WRITE),
-                          buffers.getPixelBuffer(READ));
+        readbackExportFrame(isLastFrame, 0);
+
+        exportedFrames++;
+        currentFrame++;
 
         if (isLastFrame) {
-            bufferScale =
-                1.0f / powf(2.0f, static_cast<float>(uiBufferQualityIndex - 1));
-            buffers.updateFrameBuffersSize(
-                static_cast<GLint>(currentWidth * bufferScale),
-                static_cast<GLint>(currentHeight * bufferScale));
+            finishRecord(currentWidth, currentHeight);
         }
-
-        currentFrame++;
     } else {
         if (uiPlaying) {
             currentFrame++;
@@ -635,294 +737,1130 @@ void App::update(void*) {
     }
 
     // swap buffer
-    buffers.swap();
+    if (frameCompleted) {
+        buffers.swap();
+    }
+
+#ifndef __EMSCRIPTEN__
+    updateInstantReplay(now, frameCompleted);
+#endif
 
     // copy to frontbuffer
+    PROFILE_SCOPE("present");
+
+    gpuProfiler.begin(GPU_PASS_COPY);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glViewport(0, 0, windowWidth, windowHeight);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(copyProgram->getProgram());
 
+    // An unfinished progressive frame is shown as it builds up.
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, buffers.getBackBuffer(READ));
+    glBindTexture(GL_TEXTURE_2D,
+                  buffers.getBackBuffer(progressiveRenderer.isActive() ? WRITE
+                                                                       : READ));
+    glBindSampler(0, upscaleSamplers[uiUpscaleFilterIndex]);
+
+    const glm::vec2 renderSize(static_cast<GLfloat>(buffers.getWidth()),
+                               static_cast<GLfloat>(buffers.getHeight()));
+    const glm::vec2 allocatedSize(
+        static_cast<GLfloat>(buffers.getAllocatedWidth()),
+        static_cast<GLfloat>(buffers.getAllocatedHeight()));
 
     copyProgram->setUniformValue("backbuffer", 0);
     copyProgram->setUniformValue("resolution",
                                  glm::vec2(windowWidth, windowHeight));
+    copyProgram->setUniformValue("uvScale", renderSize / allocatedSize);
+    copyProgram->setUniformValue(
+        "uvMax", (renderSize - glm::vec2(0.5f, 0.5f)) / allocatedSize);
     copyProgram->applyUniforms();
 
     glBindVertexArray(vertexArraysObject);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
     glBindVertexArray(0);
+    glBindSampler(0, 0);
+    gpuProfiler.end(GPU_PASS_COPY);
 
+    gpuProfiler.begin(GPU_PASS_IMGUI);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    gpuProfiler.end(GPU_PASS_IMGUI);
     glfwMakeContextCurrent(mainWindow);
 
-    glfwSwapBuffers(mainWindow);
+    {
+        PROFILE_SCOPE("glfwSwapBuffers");
+        glfwSwapBuffers(mainWindow);
+    }
 
     for (GLenum error = glGetError(); error; error = glGetError()) {
         AppLog::getInstance().debug("error code: 0x%0X\n", error);
     }
 
-    glfwPollEvents();
+    {
+        PROFILE_SCOPE("waitEvents");
+        scheduler.waitEvents(isAnimating(), CheckInterval);
+    }
 }
 
-void App::startRecord(const std::string& fileName, const int32_t kbps,
-                      unsigned long encodeDeadline) {
-    currentFrame = 0;
-    uiTimeValue = 0;
+bool App::hasInputActivity() {
+    const ImGuiIO& io = ImGui::GetIO();
 
-    switch (uiVideoResolutionIndex) {
-        case 0:
-            buffers.updateFrameBuffersSize(256, 144);
-            break;
-        case 1:
-            buffers.updateFrameBuffersSize(427, 240);
-            break;
-        case 2:
-            buffers.updateFrameBuffersSize(640, 360);
-            break;
-        case 3:
-            buffers.updateFrameBuffersSize(720, 480);
-            break;
-        case 4:
-            buffers.updateFrameBuffersSize(1280, 720);
-            break;
-        case 5:
-            buffers.updateFrameBuffersSize(1920, 1080);
-            break;
-        case 6:
-            buffers.updateFrameBuffersSize(2560, 1440);
-            break;
-        case 7:
-            buffers.updateFrameBuffersSize(3840, 2160);
-            break;
+    bool active = io.MousePos.x != lastMousePos.x ||
+                  io.MousePos.y != lastMousePos.y || io.MouseWheel != 0.0f ||
+                  io.MouseWheelH != 0.0f || io.InputQueueCharacters.Size > 0;
+
+    lastMousePos = io.MousePos;
+
+    for (auto i = 0; !active && i < IM_ARRAYSIZE(io.MouseDown); i++) {
+        active = io.MouseDown[i];
+    }
+
+    for (auto i = 0; !active && i < IM_ARRAYSIZE(io.KeysDown); i++) {
+        active = io.KeysDown[i];
     }
 
-    recording->start(buffers.getWidth(), buffers.getHeight(), fileName,
-                     uiVideoTypeIndex, kbps, encodeDeadline);
+    return active;
 }
 
-void App::SetProgramErrors(PShaderProgram program) {
-    std::map<int32_t, std::string> markers;
-    for (auto it = programErrors.cbegin(); it != programErrors.cend(); it++) {
-        const auto lineNumber = it->getLineNumber();
-        if (lineNumber < 0) {
-            continue;
-        }
+bool App::isAnimating() {
+    if (!uiIdleMode || recording->getIsRecording() || needRecompile) {
+        return true;
+    }
 
-        if (fs::path(program->getFragmentShader().getPath())
-                .compare(it->getFileName()) != 0) {
-            continue;
-        }
+#ifndef __EMSCRIPTEN__
+    if (uiThrottleUnfocused && !glfwGetWindowAttrib(mainWindow, GLFW_FOCUSED)) {
+        return false;
+    }
+#endif
 
-        if (markers.count(lineNumber) != 0) {
-            markers[lineNumber] += "\n" + it->getOriginal();
-        } else {
-            markers[lineNumber] += it->getOriginal();
-        }
+    if (progressiveRenderer.isActive()) {
+        return true;
     }
-    editor.SetErrorMarkers(markers);
-}
 
-void App::swapProgram(PShaderProgram newProgram) {
-    newProgram->copyAttributesFrom(*program);
-    newProgram->copyUniformsFrom(*program);
+    return uiPlaying && !frameCacheHit;
+}
 
-    glBindVertexArray(vertexArraysObject);
-    glBindBuffer(GL_ARRAY_BUFFER, vPosition);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vIndex);
-    newProgram->applyAttributes();
-    glBindVertexArray(0);
+void App::setFrameRateCap(int32_t fps) { scheduler.setFrameRateCap(fps); }
 
-    glUseProgram(newProgram->getProgram());
+void App::startCpuTrace(const std::string& fileName) {
+    cpuTraceFileName = fileName;
+    uiCpuTrace = true;
 
-    program.swap(newProgram);
+    CpuProfiler::getInstance().setThreadName("main");
+    CpuProfiler::getInstance().start();
 }
 
-void App::onTextEditor(float& bufferScale, int32_t& currentWidth,
-                       int32_t& currentHeight, int32_t& cursorLine) {
-    auto cpos = editor.GetCursorPosition();
-    ImGui::Begin("Text Editor", &uiShowTextEditor, ImGuiWindowFlags_MenuBar);
-    ImGui::SetWindowSize(ImVec2(800, 600), ImGuiCond_FirstUseEver);
-    if (ImGui::BeginMenuBar()) {
-        if (ImGui::BeginMenu("File")) {
-            if (ImGui::MenuItem("Save")) {
-                const std::string& textToSave = editor.GetText();
-                const char* const buffer = textToSave.c_str();
-                const int64_t size = textToSave.size();
+void App::stopCpuTrace() {
+    if (!CpuProfiler::getInstance().isEnabled()) {
+        return;
+    }
 
-                if (uiShaderFileIndex != 0) {
-                    writeText(program->getFragmentShader().getPath(), buffer,
-                              static_cast<int32_t>(size));
-                } else {
-                    std::string path;
+    CpuProfiler::getInstance().stop();
+    uiCpuTrace = false;
 
-                    if (saveFileDialog(path, "Shader file (*.glsl)\0*.glsl\0",
-                                       "glsl")) {
-                        PShaderProgram newProgram =
-                            std::make_shared<ShaderProgram>();
+    CpuProfiler::getInstance().writeTrace(cpuTraceFileName);
+}
 
-                        setupShaderTemplate(newProgram);
+void App::updateRenderScale(const UniformNames& uNames) {
+    float milliseconds = 0.0f;
+    const bool measured =
+        gpuProfiler.getNewSample(GPU_PASS_SHADER, milliseconds);
+
+    // Shaders sample the backbuffer with gl_FragCoord / resolution, which
+    // only lines up with the previous frame when the whole buffer is used.
+    const bool enabled = uiDynamicResolution &&
+                         !recording->getIsRecording() &&
+                         !program->isUniformActive(uNames.backbuffer);
+
+    if (!enabled) {
+        dynamicResolution.reset();
+    } else if (measured) {
+        dynamicResolution.update(milliseconds);
+    }
 
-                        writeText(path, buffer, static_cast<int32_t>(size));
+    const float scale = dynamicResolution.getScale();
+    buffers.setRenderSize(
+        static_cast<GLint>(buffers.getAllocatedWidth() * scale),
+        static_cast<GLint>(buffers.getAllocatedHeight() * scale));
+}
 
-                        const std::string& vsPath =
-                            program->getVertexShader().getPath();
-                        const std::string& fsPath = path;
-                        const int64_t vsTime = getMTime(vsPath);
-                        const int64_t fsTime = getMTime(fsPath);
-                        const std::string& vsSource =
-                            program->getVertexShader().getSource();
-                        const std::string& fsSource = textToSave;
+void App::setupFrameUniforms(const UniformNames& uNames) {
+    setupPlatformUniform(uNames);
 
-                        newProgram->compile(vsPath, fsPath, vsSource, fsSource,
-                                            vsTime, fsTime);
+    program->setUniformValue(
+        uNames.resolution,
+        glm::vec2(static_cast<GLfloat>(buffers.getWidth()),
+                  static_cast<GLfloat>(buffers.getHeight())));
 
-                        uiShaderFileIndex =
-                            shaderFiles.pushNewProgram(newProgram);
+    program->setUniformValue(uNames.time, uiTimeValue);
 
-                        program.swap(newProgram);
-                    }
-                }
-            }
+    // Tiled and multi-sampled exports move it per draw, whole frames are
+    // drawn in place.
+    program->setUniformValue(FragCoordOffsetUniform, glm::vec2(0.0f));
+}
 
-            ImGui::EndMenu();
-        }
+void App::renderShaderPass(const UniformNames& uNames,
+                           std::map<std::string, PImage>& usedTextures) {
+    PROFILE_SCOPE("draw");
 
-        if (ImGui::BeginMenu("Edit")) {
-            const bool ro = editor.IsReadOnly();
-            if (ImGui::MenuItem("Read-only mode", nullptr, &ro))
-                editor.SetReadOnly(ro);
-            ImGui::Separator();
+    glBindFramebuffer(GL_FRAMEBUFFER, buffers.getFrameBuffer(WRITE));
+    glViewport(0, 0, buffers.getWidth(), buffers.getHeight());
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            if (ImGui::MenuItem("Undo", "ALT-Backspace", nullptr,
-                                !ro && editor.CanUndo()))
-                editor.Undo();
-            if (ImGui::MenuItem("Redo", "Ctrl-Y", nullptr,
-                                !ro && editor.CanRedo()))
-                editor.Redo();
+    bindShaderInputs(uNames, usedTextures);
+    program->applyUniforms();
 
-            ImGui::Separator();
+    gpuProfiler.begin(GPU_PASS_SHADER);
+    glBindVertexArray(vertexArraysObject);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    glBindVertexArray(0);
+    gpuProfiler.end(GPU_PASS_SHADER);
+}
 
-            if (ImGui::MenuItem("Copy", "Ctrl-C", nullptr,
-                                editor.HasSelection()))
-                editor.Copy();
-            if (ImGui::MenuItem("Cut", "Ctrl-X", nullptr,
-                                !ro && editor.HasSelection()))
-                editor.Cut();
-            if (ImGui::MenuItem("Delete", "Del", nullptr,
-                                !ro && editor.HasSelection()))
-                editor.Delete();
-            if (ImGui::MenuItem("Paste", "Ctrl-V", nullptr,
-                                !ro && ImGui::GetClipboardText() != nullptr)) {
-                editor.Paste();
-            }
+void App::bindShaderInputs(const UniformNames& uNames,
+                           std::map<std::string, PImage>& usedTextures) {
+    PROFILE_SCOPE("bindShaderInputs");
 
-            ImGui::Separator();
+    glUseProgram(program->getProgram());
 
-            if (ImGui::MenuItem("Select all", nullptr, nullptr))
-                editor.SetSelection(
-                    TextEditor::Coordinates(),
-                    TextEditor::Coordinates(editor.GetTotalLines(), 0));
+    int32_t channel = 0;
 
-            ImGui::EndMenu();
-        }
+    for (auto iter = usedTextures.begin(); iter != usedTextures.end();
+         iter++) {
+        PImage image = iter->second;
 
-        if (ImGui::BeginMenu("View")) {
-            if (ImGui::MenuItem("Dark palette"))
-                editor.SetPalette(TextEditor::GetDarkPalette());
-            if (ImGui::MenuItem("Light palette"))
-                editor.SetPalette(TextEditor::GetLightPalette());
-            if (ImGui::MenuItem("Retro blue palette"))
-                editor.SetPalette(TextEditor::GetRetroBluePalette());
-            ImGui::EndMenu();
+        if (!image->isLoaded()) {
+            image->load();
         }
 
-        ImGui::EndMenuBar();
+        glActiveTexture(GL_TEXTURE0 + channel);
+        glBindTexture(GL_TEXTURE_2D, image->getTexture());
+        program->setUniformValue(iter->first, channel++);
     }
 
-    ImGui::Text("%6d/%-6d %6d lines  | %s | %s | %s | %s", cpos.mLine + 1,
-                cpos.mColumn + 1, editor.GetTotalLines(),
-                editor.IsOverwrite() ? "Ovr" : "Ins",
-                editor.CanUndo() ? "*" : " ",
-                editor.GetLanguageDefinition().mName.c_str(),
-                program->getFragmentShader().getPath().c_str());
+    glActiveTexture(GL_TEXTURE0 + channel);
+    glBindTexture(GL_TEXTURE_2D, buffers.getBackBuffer(READ));
+    program->setUniformValue(uNames.backbuffer, channel++);
+}
 
-    editor.Render("TextEditor");
-    ImGui::End();
+bool App::renderProgressiveTiles(const UniformNames& uNames,
+                                 std::map<std::string, PImage>& usedTextures) {
+    PROFILE_SCOPE("renderProgressiveTiles");
 
-    if (cursorLine >= 0) {
-        editor.SetCursorPosition(TextEditor::Coordinates(cursorLine, 0));
-        cursorLine = -1;
-    }
-}
+    const GLint width = buffers.getWidth();
+    const GLint height = buffers.getHeight();
 
-int32_t App::start(int32_t width, int32_t height, const std::string& assetPath,
-                   bool alwaysOnTop) {
-    this->windowWidth = width;
-    this->windowHeight = height;
+    if (!progressiveRenderer.isActive()) {
+        // The last completed frame is still current.
+        if (frameCacheHit) {
+            return false;
+        }
 
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    h264enabled = h264encoder::LoadEncoderLibrary();
-#endif
+        // Start from a copy of the previous frame so that tiles which are
+        // not drawn yet keep showing it.
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, buffers.getFrameBuffer(READ));
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buffers.getFrameBuffer(WRITE));
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        bindShaderInputs(uNames, usedTextures);
+        progressiveUniforms = program->getUniforms();
+        progressiveCacheKey = frameCacheKey;
+        progressiveSerial = program->getSerial();
+        progressiveGeneration = buffers.getGeneration();
+        progressiveRenderer.start(width, height);
+    } else {
+        bindShaderInputs(uNames, usedTextures);
+    }
 
-    glfwSetErrorCallback(glfwErrorCallback);
+    glBindFramebuffer(GL_FRAMEBUFFER, buffers.getFrameBuffer(WRITE));
+    glViewport(0, 0, width, height);
 
-    if (!glfwInit()) return -1;
+    // Draw with the frozen values, then restore the live ones which the UI
+    // keeps editing.
+    std::map<const std::string, ShaderUniform> uniforms;
+    uniforms.swap(program->getUniforms());
+    program->getUniforms() = progressiveUniforms;
+    program->applyUniforms();
+    uniforms.swap(program->getUniforms());
 
-#if defined(__EMSCRIPTEN__)
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-#elif defined(__APPLE__)
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#endif
+    bool completed = false;
 
-#ifndef NDEBUG
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, 1);
+    glBindVertexArray(vertexArraysObject);
+    const int32_t tiles = progressiveRenderer.getTilesPerUpdate();
+    for (auto i = 0; i < tiles && !completed; i++) {
+        progressiveRenderer.beginTile();
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+        completed = progressiveRenderer.endTile();
+    }
+    glBindVertexArray(0);
+
+    // Whether the inputs changed since the frame started decides if the
+    // next update has to render again.
+    if (completed) {
+        frameCacheKey = progressiveCacheKey;
+    }
+
+    return completed;
+}
+
+void App::startRecord(const std::string& fileName, const int32_t kbps,
+                      unsigned long encodeDeadline) {
+    const VideoResolution& resolution =
+        VideoResolutions[uiVideoResolutionIndex];
+
+    startRecord(fileName, resolution.width, resolution.height, kbps,
+                encodeDeadline);
+}
+
+void App::startRecord(const std::string& fileName, GLint width, GLint height,
+                      const int32_t kbps, unsigned long encodeDeadline) {
+    currentFrame = 0;
+    uiTimeValue = 0;
+    exportedFrames = 0;
+    exportFrameCount = getExportFrameCount();
+
+    // Frames of a shader that reads the previous frame depend on each other,
+    // only an export without that feedback can be split into time segments.
+    const bool segmentable =
+        uiOfflineExport &&
+        !program->isUniformActive(getCurrentUniformNames().backbuffer);
+    recording->setSegments(segmentable ? uiExportSegments : 1,
+                           exportFrameCount);
+    recording->setCheckpoints(
+        segmentable && uiCheckpointSeconds > 0.0f
+            ? std::max<int64_t>(1, llround(uiCheckpointSeconds * 30000.0 /
+                                           1001.0))
+            : 0);
+
+    // Tiled frames only ever need framebuffers the size of a tile.
+    const int32_t tileSize = getExportTileSize(width, height);
+    recording->setTileSize(tileSize);
+
+    if (tileSize > 0) {
+        buffers.updateFrameBuffersSize(std::min(width, tileSize),
+                                       std::min(height, tileSize));
+    } else {
+        buffers.updateFrameBuffersSize(width, height);
+    }
+
+    // Falls back to the CPU conversion if the size or the driver does not
+    // allow reading back the packed planes.
+    recording->setGpuYuvConversion(
+        uiGpuYuvConversion && tileSize == 0 &&
+        yuvConverter.initialize(buffers.getWidth(), buffers.getHeight()));
+
+    // Sub-frames are averaged at the size they are rendered, per tile.
+    if (uiExportSubframes > 1) {
+        accumulator.initialize(buffers.getWidth(), buffers.getHeight());
+    }
+
+    recording->start(tileSize > 0 ? width : buffers.getWidth(),
+                     tileSize > 0 ? height : buffers.getHeight(), fileName,
+                     getExportVideoType(), kbps, encodeDeadline);
+
+    const TileGrid& tiles = recording->getTiles();
+    if (tiles.getCount() > 1) {
+        AppLog::getInstance().info(
+            "Exporting %dx%d in %d tiles of %dx%d, offline%s\n",
+            tiles.width, tiles.height, tiles.getCount(), tiles.tileWidth,
+            tiles.tileHeight, uiOfflineExport ? "" : " (forced)");
+    }
+
+    if (accumulator.isInitialized()) {
+        AppLog::getInstance().info(
+            "Averaging %d sub-frames per frame, %.0f degree shutter\n",
+            uiExportSubframes, uiShutterAngle);
+    }
+
+    if (recording->getSegmentCount() > 1) {
+        AppLog::getInstance().info("Exporting %lld frames in %d segments%s\n",
+                                   static_cast<long long>(exportFrameCount),
+                                   recording->getSegmentCount(),
+                                   recording->isCheckpointed()
+                                       ? ", each one a checkpoint"
+                                       : "");
+    }
+
+    exportManifestPath.clear();
+    if (recording->isCheckpointed()) {
+        writeExportManifest(fileName, width, height, kbps, encodeDeadline);
+    }
+
+    exportStartTime = std::chrono::steady_clock::now();
+}
+
+void App::writeExportManifest(const std::string& fileName, GLint width,
+                              GLint height, int32_t kbps,
+                              unsigned long encodeDeadline) {
+    const std::string& shaderPath = program->getFragmentShader().getPath();
+
+    exportManifest = ExportManifest();
+    exportManifest.shaderPath = shaderPath;
+    exportManifest.shaderTime = getMTime(shaderPath);
+    exportManifest.platform = uiShaderPlatformIndex;
+    exportManifest.seconds = uiVideoTime;
+    exportManifest.width = width;
+    exportManifest.height = height;
+    exportManifest.kbps = kbps;
+    exportManifest.encodeDeadline = encodeDeadline;
+    exportManifest.webmOptions = uiWebmOptions;
+    exportManifest.segments = uiExportSegments;
+    exportManifest.checkpointSeconds = uiCheckpointSeconds;
+    exportManifest.tileSize = uiExportTileSize;
+    exportManifest.subframes = uiExportSubframes;
+    exportManifest.shutterAngle = uiShutterAngle;
+    exportManifest.deduplicate = recording->getFrameDeduplication();
+    exportManifest.cameraPosition = posCamera;
+    exportManifest.cameraRotation = rotCamera;
+    exportManifest.outputs = recording->getOutputs();
+
+    // The values set in the uniform window, the others are set per frame.
+    const UniformNames uNames = getCurrentUniformNames();
+    for (const auto& it : program->getUniforms()) {
+        const ShaderUniform& u = it.second;
+        if (u.location < 0 || u.name == uNames.time ||
+            u.name == uNames.resolution || u.name == uNames.mouse ||
+            u.name == uNames.frame || u.name == FragCoordOffsetUniform) {
+            continue;
+        }
+
+        switch (u.type) {
+            case UniformType::Float:
+            case UniformType::Integer:
+            case UniformType::Vector2:
+            case UniformType::Vector3:
+            case UniformType::Vector4:
+                exportManifest.uniforms.push_back(u);
+                break;
+            default:
+                break;
+        }
+    }
+
+    exportManifest.completedCheckpoints = recording->getCompletedCheckpoints();
+    exportManifestPath = ExportManifest::getPath(fileName);
+    if (exportManifest.save(exportManifestPath)) {
+        AppLog::getInstance().info("Export manifest: %s\n",
+                                   exportManifestPath.c_str());
+    }
+
+    // A resumed export may already be complete.
+    updateExportManifest();
+}
+
+void App::updateExportManifest() {
+    if (exportManifestPath.empty()) {
+        return;
+    }
+
+    if (recording->getIsRecording()) {
+        const int32_t completed = recording->getCompletedCheckpoints();
+        if (completed != exportManifest.completedCheckpoints) {
+            exportManifest.completedCheckpoints = completed;
+            exportManifest.save(exportManifestPath);
+        }
+        return;
+    }
+
+    // Kept while there are checkpoints to resume from or join again.
+    if (recording->isResumable()) {
+        AppLog::getInstance().info(
+            "The export can be continued with --headless --resume %s\n",
+            exportManifestPath.c_str());
+    } else {
+        remove(exportManifestPath.c_str());
+    }
+    exportManifestPath.clear();
+}
+
+void App::finishRecord(int32_t currentWidth, int32_t currentHeight) {
+    logExportThroughput();
+
+    yuvConverter.cleanup();
+
+#ifndef __EMSCRIPTEN__
+    if (isOfflineExport()) {
+        glfwSwapInterval(1);
+    }
 #endif
 
-    if (alwaysOnTop) {
-        glfwWindowHint(GLFW_FLOATING, GLFW_TRUE);
+    accumulator.cleanup();
+
+    const float bufferScale =
+        1.0f / powf(2.0f, static_cast<float>(uiBufferQualityIndex - 1));
+    buffers.updateFrameBuffersSize(
+        static_cast<GLint>(currentWidth * bufferScale),
+        static_cast<GLint>(currentHeight * bufferScale));
+}
+
+int32_t App::getExportTileSize(GLint width, GLint height) {
+    // Neither a texture nor the viewport may be larger than this.
+    GLint maxTextureSize = 0;
+    GLint maxRenderbufferSize = 0;
+    GLint maxViewportDims[2] = {0, 0};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+    const int32_t limit =
+        std::min({maxTextureSize, maxRenderbufferSize, maxViewportDims[0],
+                  maxViewportDims[1]});
+
+    int32_t tileSize = uiExportTileSize;
+    if (tileSize <= 0) {
+        const int32_t maxSize = std::min(limit, MaxUntiledExportSize);
+        if (width <= maxSize && height <= maxSize) {
+            return 0;
+        }
+        tileSize = DefaultExportTileSize;
     }
 
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    tileSize = std::min(tileSize, limit);
+    if (tileSize >= width && tileSize >= height) {
+        return 0;
+    }
 
-    mainWindow = glfwCreateWindow(windowWidth, windowHeight, "Shader Editor",
-                                  NULL, NULL);
-    if (!mainWindow) {
-        glfwTerminate();
-        return -1;
+    // Each tile would only see its own part of the previous frame.
+    if (program->isUniformActive(getCurrentUniformNames().backbuffer)) {
+        AppLog::getInstance().error(
+            "A shader that reads the previous frame cannot be rendered in "
+            "tiles, exporting %dx%d at once\n",
+            width, height);
+        return 0;
     }
 
-    glfwMakeContextCurrent(mainWindow);
+    return tileSize;
+}
+
+bool App::isOfflineExport() const {
+    // The tiles and sub-frames of a frame are all rendered before the next
+    // update.
+    return uiOfflineExport || recording->getTiles().getCount() > 1 ||
+           accumulator.isInitialized();
+}
+
+int64_t App::getExportFrameCount() const {
+    // Same test as the export loop so that the count matches what it renders.
+    int64_t count = 0;
+    for (;;) {
+        const float time = static_cast<float>(static_cast<double>(count) *
+                                              (1001.0 / 30000.0));
+        count++;
+        if (time >= uiVideoTime) {
+            return count;
+        }
+    }
+}
+
+AppVideoType App::getExportVideoType() const {
+    if (uiExportStream) {
+        return uiStreamFormatIndex == 0 ? AppVideoType::I420
+                                        : AppVideoType::RGBA;
+    }
+    return uiVideoTypeIndex;
+}
+
+std::vector<RecordingOutput> App::getExtraOutputs(const std::string& fileName,
+                                                  int32_t kbps) const {
+    // Named after the main file, a stream has no name to go by.
+    const fs::path base =
+        uiExportStream ? fs::path("video") : fs::path(fileName);
+
+    std::vector<RecordingOutput> outputs;
+    for (int32_t i = 0; i < IM_ARRAYSIZE(VideoTypeNames); i++) {
+        const AppVideoType type = static_cast<AppVideoType>(i);
+        if (!uiExtraOutputs[i] || type == AppVideoType::RGBA ||
+            (type == AppVideoType::H264 && !h264enabled) ||
+            (!uiExportStream && type == uiVideoTypeIndex)) {
+            continue;
+        }
+
+        fs::path path = base;
+        path.replace_extension(VideoTypeExtensions[i]);
+        outputs.push_back({path.string(), type});
+    }
+
+    if (uiExportStream) {
+        return outputs;
+    }
+
+    const VideoResolution& top = VideoResolutions[uiVideoResolutionIndex];
+    for (int32_t i = 0; i < IM_ARRAYSIZE(VideoResolutions); i++) {
+        const VideoResolution& rung = VideoResolutions[i];
+        if (uiLadderRungs[i] && rung.width < top.width &&
+            rung.height < top.height) {
+            outputs.push_back(getLadderRung(fileName, rung.width, rung.height,
+                                            kbps, top.width, top.height));
+        }
+    }
+    return outputs;
+}
+
+RecordingOutput App::getLadderRung(const std::string& fileName,
+                                   int32_t width, int32_t height,
+                                   int32_t kbps, int32_t topWidth,
+                                   int32_t topHeight) const {
+    // Named after the top rung, video.webm gives video_1280x720.webm.
+    const fs::path path(fileName);
+    const std::string name = path.stem().string() + "_" +
+                             std::to_string(width) + "x" +
+                             std::to_string(height) +
+                             path.extension().string();
+
+    RecordingOutput rung;
+    rung.fileName = (path.parent_path() / name).string();
+    rung.videoType = uiVideoTypeIndex;
+    rung.width = width;
+    rung.height = height;
+
+    // Smaller frames need more bits per pixel to look as good.
+    const double pixels = static_cast<double>(width) * height /
+                          (static_cast<double>(topWidth) * topHeight);
+    rung.kbps =
+        std::max(100, static_cast<int32_t>(kbps * pow(pixels, 0.75)));
+    return rung;
+}
+
+float App::getExportFramesPerSecond() const {
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() -
+                               exportStartTime)
+                               .count();
+
+    return seconds > 0.0 ? static_cast<float>(exportedFrames / seconds) : 0.0f;
+}
+
+void App::logExportThroughput() const {
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() -
+                               exportStartTime)
+                               .count();
+
+    AppLog::getInstance().info(
+        "Exported %llu frames in %.2fs (%.1f fps)\n",
+        static_cast<unsigned long long>(exportedFrames), seconds,
+        getExportFramesPerSecond());
+
+    const int64_t duplicates = recording->getDuplicateFrameCount();
+    if (duplicates > 0) {
+        AppLog::getInstance().info(
+            "Deduplicated %lld of %llu frames, they were not encoded again\n",
+            static_cast<long long>(duplicates),
+            static_cast<unsigned long long>(exportedFrames));
+    }
+}
+
+void App::readbackExportFrame(bool isLastFrame, int32_t tile) {
+    PROFILE_SCOPE("recording->update");
+
+    // The GPU conversion is accounted as part of the readback.
+    gpuProfiler.begin(GPU_PASS_READBACK);
+
+    if (recording->isGpuYuv()) {
+        yuvConverter.convert(buffers.getBackBuffer(WRITE), vertexArraysObject);
+    }
+
+    recording->update(isLastFrame, currentFrame, tile);
+    gpuProfiler.end(GPU_PASS_READBACK);
+}
+
+void App::renderExportSubframes(const UniformNames& uNames,
+                                std::map<std::string, PImage>& usedTextures,
+                                const glm::vec2& tileOffset) {
+    PROFILE_SCOPE("renderExportSubframes");
+
+    // The shutter opens at the frame's time and stays open for its part of
+    // the frame interval, sub-frames sample the middle of equal slices.
+    const double frameTime =
+        static_cast<double>(currentFrame) * (1001.0 / 30000.0);
+    const double shutterTime =
+        static_cast<double>(uiShutterAngle) / 360.0 * (1001.0 / 30000.0);
+    const float weight = 1.0f / static_cast<float>(uiExportSubframes);
+
+    accumulator.clear();
+
+    for (int32_t i = 0; i < uiExportSubframes; i++) {
+        const double time =
+            frameTime + shutterTime * (i + 0.5) / uiExportSubframes;
+        program->setUniformValue(uNames.time, static_cast<float>(time));
+        program->setUniformValue(FragCoordOffsetUniform,
+                                 tileOffset + FrameAccumulator::getJitter(i));
+
+        renderShaderPass(uNames, usedTextures);
+        accumulator.add(buffers.getBackBuffer(WRITE), weight,
+                        vertexArraysObject);
+    }
+
+    // Back into the frame's own buffer, where the readback expects it.
+    accumulator.resolve(buffers.getFrameBuffer(WRITE), vertexArraysObject);
+}
+
+bool App::renderExportFrame(const UniformNames& uNames,
+                            std::map<std::string, PImage>& usedTextures) {
+    // Segmented exports jump between the segments' time ranges.
+    currentFrame = recording->getNextFrame(currentFrame);
+    uiTimeValue = static_cast<float>(static_cast<double>(currentFrame) *
+                                     (1001.0 / 30000.0));
+
+    setupFrameUniforms(uNames);
+
+    const bool isLastFrame = uiTimeValue >= uiVideoTime;
+
+    // Tiles see the resolution of the whole frame, each one is moved to its
+    // place in it.
+    const TileGrid& tiles = recording->getTiles();
+    if (tiles.getCount() > 1) {
+        program->setUniformValue(
+            uNames.resolution,
+            glm::vec2(static_cast<GLfloat>(tiles.width),
+                      static_cast<GLfloat>(tiles.height)));
+    }
+
+    for (int32_t tile = 0; tile < tiles.getCount(); tile++) {
+        glm::vec2 tileOffset(0.0f, 0.0f);
+        if (tiles.getCount() > 1) {
+            int32_t x = 0;
+            int32_t y = 0;
+            int32_t w = 0;
+            int32_t h = 0;
+            tiles.getRect(tile, x, y, w, h);
+            tileOffset =
+                glm::vec2(static_cast<GLfloat>(x), static_cast<GLfloat>(y));
+            program->setUniformValue(FragCoordOffsetUniform, tileOffset);
+        }
+
+        if (accumulator.isInitialized()) {
+            renderExportSubframes(uNames, usedTextures, tileOffset);
+        } else {
+            renderShaderPass(uNames, usedTextures);
+        }
+        readbackExportFrame(isLastFrame, tile);
+    }
+
+    exportedFrames++;
+    currentFrame++;
+    buffers.swap();
+
+    updateExportManifest();
+
+    return !recording->getIsRecording();
+}
+
+void App::exportOfflineFrames(const UniformNames& uNames,
+                              std::map<std::string, PImage>& usedTextures,
+                              int32_t currentWidth, int32_t currentHeight) {
+    PROFILE_SCOPE("exportOfflineFrames");
 
 #ifndef __EMSCRIPTEN__
-    // Initialize OpenGL loader
-    if (gl3wInit() != 0) {
+    // The progress is presented a few times per second, it should not wait
+    // for vblank either.
+    glfwSwapInterval(0);
+#endif
+
+    const auto sliceEnd = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(OfflineExportSliceMs);
+
+    while (recording->getIsRecording()) {
+        if (renderExportFrame(uNames, usedTextures)) {
+            finishRecord(currentWidth, currentHeight);
+            break;
+        }
+
+        if (std::chrono::steady_clock::now() >= sliceEnd) {
+            break;
+        }
+    }
+}
+
+int32_t App::runHeadless(const HeadlessOptions& requested) {
+    // A resumed export is started again with the settings it was started
+    // with, the checkpoints it finished are skipped.
+    HeadlessOptions options = requested;
+    const bool resuming = !requested.resumePath.empty();
+    if (resuming) {
+        if (!exportManifest.load(requested.resumePath)) {
+            return 1;
+        }
+
+        options.shaderPath = exportManifest.shaderPath;
+        options.exportPath = exportManifest.outputs[0].fileName;
+        options.extraExportPaths.clear();
+        options.ladderHeights.clear();
+        options.seconds = exportManifest.seconds;
+        options.width = exportManifest.width;
+        options.height = exportManifest.height;
+        options.kbps = exportManifest.kbps;
+        options.segments = exportManifest.segments;
+        options.checkpointSeconds = exportManifest.checkpointSeconds;
+        options.tileSize = exportManifest.tileSize;
+        options.subframes = exportManifest.subframes;
+        options.shutterAngle = exportManifest.shutterAngle;
+        options.rawRgba = false;
+        options.keepDuplicates = !exportManifest.deduplicate;
+        options.platform =
+            static_cast<AppShaderPlatform>(exportManifest.platform);
+
+        if (getMTime(options.shaderPath) != exportManifest.shaderTime) {
+            AppLog::getInstance().info(
+                "%s changed since the export started, the rest of it may "
+                "not match\n",
+                options.shaderPath.c_str());
+        }
+    }
+
+    // Shaders are looked up in the listing of their directory, a bare file
+    // name has none.
+    std::error_code error;
+    const fs::path absoluteShaderPath = fs::absolute(options.shaderPath, error);
+    if (!error) {
+        options.shaderPath = absoluteShaderPath.string();
+    }
+
+    HeadlessContext context;
+    if (!context.initialize()) {
+        return 1;
+    }
+
+    const std::string extension =
+        fs::path(options.exportPath).extension().string();
+    if (StreamSink::isStreamTarget(options.exportPath)) {
+        // Keep stdout clean for the frames.
+        if (options.exportPath == "-") {
+            AppLog::getInstance().setConsoleStderr(true);
+        }
+        uiExportStream = true;
+        uiStreamFormatIndex = options.rawRgba ? 1 : 0;
+    } else if (options.rawRgba) {
+        AppLog::getInstance().error("Raw RGBA can only be streamed\n");
+        return 1;
+    } else if (extension == ".y4m") {
+        uiVideoTypeIndex = AppVideoType::I420;
+    } else if (extension == ".webm") {
+        uiVideoTypeIndex = AppVideoType::WebM;
+    } else if (extension == ".png") {
+        uiVideoTypeIndex = AppVideoType::PNG;
+    } else if (extension == ".gif") {
+        uiVideoTypeIndex = AppVideoType::GIF;
+    } else if (extension == ".mp4") {
+        if (!enableH264()) {
+            return 1;
+        }
+        uiVideoTypeIndex = AppVideoType::H264;
+    } else {
+        AppLog::getInstance().error("Unknown export format: %s\n",
+                                    options.exportPath.c_str());
         return 1;
     }
 
-#ifndef NDEBUG
-    EnableOpenGLDebugExtention();
-#endif
+    std::vector<RecordingOutput> extraOutputs;
+    for (const std::string& path : options.extraExportPaths) {
+        RecordingOutput output;
+        output.fileName = path;
+        output.videoType = -1;
+
+        const std::string extraExtension =
+            fs::path(path).extension().string();
+        if (StreamSink::isStreamTarget(path)) {
+            if (path == "-") {
+                AppLog::getInstance().setConsoleStderr(true);
+            }
+            output.videoType = AppVideoType::I420;
+        } else {
+            for (int32_t i = 0; i < IM_ARRAYSIZE(VideoTypeExtensions); i++) {
+                if (VideoTypeExtensions[i][0] != '\0' &&
+                    extraExtension == VideoTypeExtensions[i]) {
+                    output.videoType = i;
+                }
+            }
+        }
+
+        if (output.videoType < 0) {
+            AppLog::getInstance().error("Unknown export format: %s\n",
+                                        path.c_str());
+            return 1;
+        }
+
+        if (output.videoType == AppVideoType::H264 && !enableH264()) {
+            return 1;
+        }
+
+        extraOutputs.push_back(output);
+    }
+
+    // Further outputs of a resumed export, ladder rungs included, with the
+    // sizes and bitrates they were started with.
+    for (size_t i = 1; resuming && i < exportManifest.outputs.size(); i++) {
+        const RecordingOutput& output = exportManifest.outputs[i];
+        if (output.videoType == AppVideoType::H264 && !enableH264()) {
+            return 1;
+        }
+        extraOutputs.push_back(output);
+    }
+
+    if (!options.ladderHeights.empty() && uiExportStream) {
+        AppLog::getInstance().error("A ladder needs a file to export to\n");
+        return 1;
+    }
+
+    for (const int32_t height : options.ladderHeights) {
+        // Same aspect as the top rung, rounded to an even width.
+        const int32_t width = static_cast<int32_t>(
+            ((int64_t)options.width * height / options.height + 1) & ~1);
+        extraOutputs.push_back(getLadderRung(options.exportPath, width, height,
+                                             options.kbps, options.width,
+                                             options.height));
+    }
+    recording->setExtraOutputs(extraOutputs);
+
+    // Uniform setup reads the (idle) ImGui input state, a context without a
+    // platform backend is enough.
+    ImGui::SetCurrentContext(ImGui::CreateContext());
+    ImGui::GetIO().IniFilename = nullptr;
+
+    windowWidth = options.width;
+    windowHeight = options.height;
+    uiShaderPlatformIndex = options.platform;
+    uiVideoTime = options.seconds;
+    uiExportSegments = options.segments;
+    uiCheckpointSeconds = options.checkpointSeconds;
+    uiExportTileSize = options.tileSize;
+    uiExportSubframes = options.subframes;
+    uiShutterAngle = options.shutterAngle;
+    recording->setFrameDeduplication(!options.keepDuplicates);
+    recording->setResumedCheckpoints(
+        resuming ? exportManifest.completedCheckpoints : 0);
+    if (resuming) {
+        uiWebmOptions = exportManifest.webmOptions;
+        recording->setWebmEncoderOptions(uiWebmOptions);
+    }
+
+    // startRecord() sizes the buffers, an export too large for one
+    // framebuffer is rendered in tiles.
+    initializeRenderer(std::min(options.width, MaxUntiledExportSize),
+                       std::min(options.height, MaxUntiledExportSize));
+
+    int32_t result = 0;
+
+    if (fs::path(options.shaderPath).extension().empty() ||
+        !loadAssets(options.shaderPath)) {
+        AppLog::getInstance().error("Shader not found: %s\n",
+                                    options.shaderPath.c_str());
+        result = 1;
+    } else if (!program->isOK()) {
+        for (auto it = programErrors.cbegin(); it != programErrors.cend();
+             it++) {
+            AppLog::getInstance().error("%s\n", it->getOriginal().c_str());
+        }
+        result = 1;
+    } else {
+        unsigned long encodeDeadline = VPX_DL_GOOD_QUALITY;
+        if (resuming) {
+            // The rest of the frames look like the ones already written.
+            std::map<const std::string, ShaderUniform>& uniforms =
+                program->getUniforms();
+            for (const ShaderUniform& u : exportManifest.uniforms) {
+                auto it = uniforms.find(u.name);
+                if (it != uniforms.end() && it->second.type == u.type) {
+                    it->second.value = u.value;
+                }
+            }
+            posCamera = exportManifest.cameraPosition;
+            rotCamera = exportManifest.cameraRotation;
+            encodeDeadline = exportManifest.encodeDeadline;
+        }
+
+        startRecord(options.exportPath, options.width, options.height,
+                    options.kbps, encodeDeadline);
+
+        const auto uNames = getCurrentUniformNames();
+        std::map<std::string, PImage> usedTextures;
+        getUsedTextures(uNames, usedTextures);
+
+        while (recording->getIsRecording()) {
+            renderExportFrame(uNames, usedTextures);
+        }
+
+        if (recording->isResumable()) {
+            result = 1;
+        }
+
+        logExportThroughput();
+    }
+
+    cleanup();
+    ImGui::DestroyContext();
+    context.cleanup();
+
+    return result;
+}
+
+bool App::enableH264() {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    if (!h264enabled) {
+        h264enabled = h264encoder::LoadEncoderLibrary();
+    }
+#endif
+    if (!h264enabled) {
+        AppLog::getInstance().error("MP4 export requires OpenH264\n");
+    }
+    return h264enabled;
+}
+
+void App::SetProgramErrors(PShaderProgram program) {
+    std::map<int32_t, std::string> markers;
+    for (auto it = programErrors.cbegin(); it != programErrors.cend(); it++) {
+        const auto lineNumber = it->getLineNumber();
+        if (lineNumber < 0) {
+            continue;
+        }
+
+        if (fs::path(program->getFragmentShader().getPath())
+                .compare(it->getFileName()) != 0) {
+            continue;
+        }
+
+        if (markers.count(lineNumber) != 0) {
+            markers[lineNumber] += "\n" + it->getOriginal();
+        } else {
+            markers[lineNumber] += it->getOriginal();
+        }
+    }
+    editor.SetErrorMarkers(markers);
+}
+
+void App::swapProgram(PShaderProgram newProgram) {
+    newProgram->copyAttributesFrom(*program);
+    newProgram->copyUniformsFrom(*program);
+
+    glBindVertexArray(vertexArraysObject);
+    glBindBuffer(GL_ARRAY_BUFFER, vPosition);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vIndex);
+    newProgram->applyAttributes();
+    glBindVertexArray(0);
+
+    glUseProgram(newProgram->getProgram());
+
+    program.swap(newProgram);
+}
+
+void App::onTextEditor(float& bufferScale, int32_t& currentWidth,
+                       int32_t& currentHeight, int32_t& cursorLine) {
+    auto cpos = editor.GetCursorPosition();
+    ImGui::Begin("Text Editor", &uiShowTextEditor, ImGuiWindowFlags_MenuBar);
+    ImGui::SetWindowSize(ImVec2(800, 600), ImGuiCond_FirstUseEver);
+    if (ImGui::BeginMenuBar()) {
+        if (ImGui::BeginMenu("File")) {
+            if (ImGui::MenuItem("Save")) {
+                const std::string& textToSave = editor.GetText();
+                const char* const buffer = textToSave.c_str();
+                const int64_t size = textToSave.size();
+
+                if (uiShaderFileIndex != 0) {
+                    writeText(program->getFragmentShader().getPath(), buffer,
+                              static_cast<int32_t>(size));
+                } else {
+                    std::string path;
+
+                    if (saveFileDialog(path, "Shader file (*.glsl)\0*.glsl\0",
+                                       "glsl")) {
+                        PShaderProgram newProgram =
+                            std::make_shared<ShaderProgram>();
+
+                        setupShaderTemplate(newProgram);
+
+                        writeText(path, buffer, static_cast<int32_t>(size));
+
+                        const std::string& vsPath =
+                            program->getVertexShader().getPath();
+                        const std::string& fsPath = path;
+                        const int64_t vsTime = getMTime(vsPath);
+                        const int64_t fsTime = getMTime(fsPath);
+                        const std::string& vsSource =
+                            program->getVertexShader().getSource();
+                        const std::string& fsSource = textToSave;
+
+                        newProgram->compile(vsPath, fsPath, vsSource, fsSource,
+                                            vsTime, fsTime);
+
+                        uiShaderFileIndex =
+                            shaderFiles.pushNewProgram(newProgram);
+
+                        program.swap(newProgram);
+                    }
+                }
+            }
+
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Edit")) {
+            const bool ro = editor.IsReadOnly();
+            if (ImGui::MenuItem("Read-only mode", nullptr, &ro))
+                editor.SetReadOnly(ro);
+            ImGui::Separator();
+
+            if (ImGui::MenuItem("Undo", "ALT-Backspace", nullptr,
+                                !ro && editor.CanUndo()))
+                editor.Undo();
+            if (ImGui::MenuItem("Redo", "Ctrl-Y", nullptr,
+                                !ro && editor.CanRedo()))
+                editor.Redo();
+
+            ImGui::Separator();
+
+            if (ImGui::MenuItem("Copy", "Ctrl-C", nullptr,
+                                editor.HasSelection()))
+                editor.Copy();
+            if (ImGui::MenuItem("Cut", "Ctrl-X", nullptr,
+                                !ro && editor.HasSelection()))
+                editor.Cut();
+            if (ImGui::MenuItem("Delete", "Del", nullptr,
+                                !ro && editor.HasSelection()))
+                editor.Delete();
+            if (ImGui::MenuItem("Paste", "Ctrl-V", nullptr,
+                                !ro && ImGui::GetClipboardText() != nullptr)) {
+                editor.Paste();
+            }
+
+            ImGui::Separator();
+
+            if (ImGui::MenuItem("Select all", nullptr, nullptr))
+                editor.SetSelection(
+                    TextEditor::Coordinates(),
+                    TextEditor::Coordinates(editor.GetTotalLines(), 0));
+
+            ImGui::EndMenu();
+        }
 
-#endif
+        if (ImGui::BeginMenu("View")) {
+            if (ImGui::MenuItem("Dark palette"))
+                editor.SetPalette(TextEditor::GetDarkPalette());
+            if (ImGui::MenuItem("Light palette"))
+                editor.SetPalette(TextEditor::GetLightPalette());
+            if (ImGui::MenuItem("Retro blue palette"))
+                editor.SetPalette(TextEditor::GetRetroBluePalette());
+            ImGui::EndMenu();
+        }
 
-    ImGui::SetCurrentContext(ImGui::CreateContext());
-    ImGui_ImplGlfw_InitForOpenGL(mainWindow, true);
-    ImGui_ImplOpenGL3_Init(GlslVersion);
+        ImGui::EndMenuBar();
+    }
 
-    ImGui::StyleColorsClassic();
+    ImGui::Text("%6d/%-6d %6d lines  | %s | %s | %s | %s", cpos.mLine + 1,
+                cpos.mColumn + 1, editor.GetTotalLines(),
+                editor.IsOverwrite() ? "Ovr" : "Ins",
+                editor.CanUndo() ? "*" : " ",
+                editor.GetLanguageDefinition().mName.c_str(),
+                program->getFragmentShader().getPath().c_str());
 
-    ImGui::GetIO().IniFilename = nullptr;
+    editor.Render("TextEditor");
+    ImGui::End();
 
-    glfwMakeContextCurrent(mainWindow);
+    if (cursorLine >= 0) {
+        editor.SetCursorPosition(TextEditor::Coordinates(cursorLine, 0));
+        cursorLine = -1;
+    }
+}
 
+void App::initializeRenderer(GLint bufferWidth, GLint bufferHeight) {
     // Compile shaders.
     program.reset(new ShaderProgram());
     program->compile("<default-vertex-shader>", "<default-fragment-shader>",
@@ -962,14 +1900,31 @@ int32_t App::start(int32_t width, int32_t height, const std::string& assetPath,
     glBindVertexArray(0);
 
     // Framebuffers
-    buffers.initialize(windowWidth / 2, windowHeight / 2);
+    buffers.initialize(bufferWidth, bufferHeight);
+
+    // Filters used when presenting a scaled render target.
+    glGenSamplers(2, upscaleSamplers);
+    for (auto i = 0; i < 2; i++) {
+        const GLint filter = i == 0 ? GL_NEAREST : GL_LINEAR;
+        glSamplerParameteri(upscaleSamplers[i], GL_TEXTURE_MAG_FILTER, filter);
+        glSamplerParameteri(upscaleSamplers[i], GL_TEXTURE_MIN_FILTER, filter);
+        glSamplerParameteri(upscaleSamplers[i], GL_TEXTURE_WRAP_S,
+                            GL_CLAMP_TO_EDGE);
+        glSamplerParameteri(upscaleSamplers[i], GL_TEXTURE_WRAP_T,
+                            GL_CLAMP_TO_EDGE);
+    }
+
+    gpuProfiler.initialize();
+    progressiveRenderer.initialize();
+}
 
-    // Load files.
+bool App::loadAssets(const std::string& assetPath) {
     shaderFiles.pushNewProgram(program);
 
     auto path = fs::path(assetPath);
     if (path.extension().empty()) {
         shaderFiles.loadFiles(assetPath);
+        return true;
     } else {
         shaderFiles.loadFiles(path.parent_path().string());
 
@@ -995,10 +1950,82 @@ int32_t App::start(int32_t width, int32_t height, const std::string& assetPath,
             programErrors = newProgram->getFragmentShader().getErrors();
             SetProgramErrors(this->program);
             program.swap(newProgram);
-            break;
+            return true;
         }
     }
 
+    return false;
+}
+
+int32_t App::start(int32_t width, int32_t height, const std::string& assetPath,
+                   bool alwaysOnTop) {
+    this->windowWidth = width;
+    this->windowHeight = height;
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    h264enabled = h264encoder::LoadEncoderLibrary();
+#endif
+
+    glfwSetErrorCallback(glfwErrorCallback);
+
+    if (!glfwInit()) return -1;
+
+#if defined(__EMSCRIPTEN__)
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+#elif defined(__APPLE__)
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#endif
+
+#ifndef NDEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, 1);
+#endif
+
+    if (alwaysOnTop) {
+        glfwWindowHint(GLFW_FLOATING, GLFW_TRUE);
+    }
+
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+    mainWindow = glfwCreateWindow(windowWidth, windowHeight, "Shader Editor",
+                                  NULL, NULL);
+    if (!mainWindow) {
+        glfwTerminate();
+        return -1;
+    }
+
+    glfwMakeContextCurrent(mainWindow);
+
+#ifndef __EMSCRIPTEN__
+    // Initialize OpenGL loader
+    if (gl3wInit() != 0) {
+        return 1;
+    }
+
+#ifndef NDEBUG
+    EnableOpenGLDebugExtention();
+#endif
+
+#endif
+
+    ImGui::SetCurrentContext(ImGui::CreateContext());
+    ImGui_ImplGlfw_InitForOpenGL(mainWindow, true);
+    ImGui_ImplOpenGL3_Init(GlslVersion);
+
+    ImGui::StyleColorsClassic();
+
+    ImGui::GetIO().IniFilename = nullptr;
+
+    glfwMakeContextCurrent(mainWindow);
+
+    initializeRenderer(windowWidth / 2, windowHeight / 2);
+
+    loadAssets(assetPath);
+
     timeStart = static_cast<float>(ImGui::GetTime());
 
     auto lang = TextEditor::LanguageDefinition::GLSL();
@@ -1009,10 +2036,20 @@ int32_t App::start(int32_t width, int32_t height, const std::string& assetPath,
 }
 
 void App::cleanup() {
+    stopCpuTrace();
+
     shaderFiles.deleteImageFileNames();
     shaderFiles.deleteShaderFileNamse();
 
+    encoderBenchmark.cancel();
+    replay.stop();
     recording->cleanup();
+    yuvConverter.cleanup();
+    accumulator.cleanup();
+
+    gpuProfiler.cleanup();
+    progressiveRenderer.cleanup();
+    glDeleteSamplers(2, upscaleSamplers);
 
     h264encoder::UnloadEncoderLibrary();
 }
@@ -1047,17 +2084,85 @@ void App::onUiCaptureWindow() {
 
     ImGui::Begin("Export Video", &uiCaptureWindow,
                  ImGuiWindowFlags_AlwaysAutoResize);
-    const char* resolutionItems[] = {"256x144",   "427x240",  "640x360",
-                                     "720x480",   "1280x720", "1920x1080",
-                                     "2560x1440", "3840x2160"};
+    const char* resolutionItems[IM_ARRAYSIZE(VideoResolutions)];
+    for (int32_t i = 0; i < IM_ARRAYSIZE(VideoResolutions); i++) {
+        resolutionItems[i] = VideoResolutions[i].name;
+    }
 
     ImGui::Combo("resolution", &uiVideoResolutionIndex, resolutionItems,
                  IM_ARRAYSIZE(resolutionItems));
 
-    ImGui::Combo("format", (int32_t*)&uiVideoTypeIndex, VideoTypeNames,
-                 IM_ARRAYSIZE(VideoTypeNames) - (h264enabled ? 0 : 1));
+#if !defined(_MSC_VER) && !defined(__MINGW32__) && !defined(__EMSCRIPTEN__)
+    ImGui::Checkbox("stream (stdout, fifo: or unix:)", &uiExportStream);
+#endif
+
+    if (uiExportStream) {
+        const char* streamFormatItems[] = {"Y4M", "RGBA (raw)"};
+        ImGui::InputText("target", uiStreamTarget, sizeof(uiStreamTarget));
+        ImGui::Combo("format", &uiStreamFormatIndex, streamFormatItems,
+                     IM_ARRAYSIZE(streamFormatItems));
+    } else {
+        // Raw RGBA is only offered for streams, MP4 only with OpenH264.
+        AppVideoType types[IM_ARRAYSIZE(VideoTypeNames)];
+        const char* typeNames[IM_ARRAYSIZE(VideoTypeNames)];
+        int32_t typeCount = 0;
+        int32_t typeIndex = 0;
+        for (int32_t i = 0; i < IM_ARRAYSIZE(VideoTypeNames); i++) {
+            const AppVideoType type = static_cast<AppVideoType>(i);
+            if (type == AppVideoType::RGBA ||
+                (type == AppVideoType::H264 && !h264enabled)) {
+                continue;
+            }
+#ifdef __EMSCRIPTEN__
+            if (type == AppVideoType::PNG) {
+                continue;
+            }
+#endif
+            if (type == uiVideoTypeIndex) {
+                typeIndex = typeCount;
+            }
+            types[typeCount] = type;
+            typeNames[typeCount] = VideoTypeNames[i];
+            typeCount++;
+        }
+
+        if (ImGui::Combo("format", &typeIndex, typeNames, typeCount)) {
+            uiVideoTypeIndex = types[typeIndex];
+        }
+    }
+
+    // Written from the same frames, so they cost an encode but no render.
+    if (ImGui::TreeNode("also write")) {
+        for (int32_t i = 0; i < IM_ARRAYSIZE(VideoTypeNames); i++) {
+            const AppVideoType type = static_cast<AppVideoType>(i);
+            if (type == AppVideoType::RGBA ||
+                (type == AppVideoType::H264 && !h264enabled) ||
+                (!uiExportStream && type == uiVideoTypeIndex)) {
+                continue;
+            }
+#ifdef __EMSCRIPTEN__
+            if (type == AppVideoType::PNG) {
+                continue;
+            }
+#endif
+            ImGui::Checkbox(VideoTypeNames[i], &uiExtraOutputs[i]);
+        }
+        ImGui::TreePop();
+    }
+
+    // Smaller renditions, downscaled from the rendered frames.
+    if (!uiExportStream && ImGui::TreeNode("ladder")) {
+        const VideoResolution& top = VideoResolutions[uiVideoResolutionIndex];
+        for (int32_t i = 0; i < IM_ARRAYSIZE(VideoResolutions); i++) {
+            const VideoResolution& rung = VideoResolutions[i];
+            if (rung.width < top.width && rung.height < top.height) {
+                ImGui::Checkbox(rung.name, &uiLadderRungs[i]);
+            }
+        }
+        ImGui::TreePop();
+    }
 
-    if (uiVideoTypeIndex == AppVideoType::WebM) {
+    if (!uiExportStream && uiVideoTypeIndex == AppVideoType::WebM) {
         const char* qualityItems[] = {"fast", "good", "best"};
 
         ImGui::Combo("quality", &uiVideoQualityIndex, qualityItems,
@@ -1076,10 +2181,99 @@ void App::onUiCaptureWindow() {
         }
 
         ImGui::DragFloat("Mbps", &uiVideoMbps, 0.1f, 0.5f, 15.0f);
+
+        ImGui::Combo("speed", &uiWebmSpeedIndex, WebmSpeedPresetNames,
+                     WebmSpeedPresetCount);
+        uiWebmOptions.cpuUsed = WebmSpeedPresetCpuUsed[uiWebmSpeedIndex];
+
+#ifndef __EMSCRIPTEN__
+        ImGui::SliderInt("encoder threads", &uiWebmOptions.threads, 0, 16,
+                         uiWebmOptions.threads == 0 ? "auto" : "%d");
+#endif
+
+        const char* codecItems[] = {"VP8", "VP9"};
+        int32_t codecIndex = uiWebmOptions.vp9 ? 1 : 0;
+        if (ImGui::Combo("codec", &codecIndex, codecItems,
+                         IM_ARRAYSIZE(codecItems))) {
+            uiWebmOptions.vp9 = codecIndex == 1;
+        }
+
+        if (uiWebmOptions.vp9) {
+            const char* tileItems[] = {"1", "2", "4", "8", "16", "32", "64"};
+            ImGui::Combo("tile columns", &uiWebmOptions.tileColumns,
+                         tileItems, IM_ARRAYSIZE(tileItems));
+            ImGui::Checkbox("row multithreading",
+                            &uiWebmOptions.rowMultithreading);
+            ImGui::Checkbox("frame parallel", &uiWebmOptions.frameParallel);
+        } else {
+            const char* partitionItems[] = {"1", "2", "4", "8"};
+            ImGui::Combo("token partitions", &uiWebmOptions.tokenPartitions,
+                         partitionItems, IM_ARRAYSIZE(partitionItems));
+        }
+
+        recording->setWebmEncoderOptions(uiWebmOptions);
+
+#ifndef __EMSCRIPTEN__
+        onUiEncoderBenchmark(static_cast<int32_t>(uiVideoMbps * 1000.0f),
+                             encodeDeadline);
+#endif
+    }
+
+    if (!uiExportStream && uiVideoTypeIndex == AppVideoType::GIF) {
+        const char* paletteItems[] = {"global", "per frame"};
+        int32_t paletteIndex = uiGifOptions.globalPalette ? 0 : 1;
+        if (ImGui::Combo("palette", &paletteIndex, paletteItems,
+                         IM_ARRAYSIZE(paletteItems))) {
+            uiGifOptions.globalPalette = paletteIndex == 0;
+        }
+
+        int32_t methodIndex = uiGifOptions.paletteMethod;
+        if (ImGui::Combo("palette method", &methodIndex, GifPaletteMethodNames,
+                         IM_ARRAYSIZE(GifPaletteMethodNames))) {
+            uiGifOptions.paletteMethod =
+                static_cast<GifPaletteMethod>(methodIndex);
+        }
+        ImGui::Checkbox("dither", &uiGifOptions.dither);
+
+#ifndef __EMSCRIPTEN__
+        ImGui::SliderInt("encoder threads", &uiGifOptions.threads, 0, 16,
+                         uiGifOptions.threads == 0 ? "auto" : "%d");
+#endif
+
+        recording->setGifEncoderOptions(uiGifOptions);
     }
 
     ImGui::DragFloat("seconds", &uiVideoTime, 0.5f, 0.5f, 600.0f, "%f");
 
+    ImGui::Checkbox("offline (faster than realtime)", &uiOfflineExport);
+#ifndef __EMSCRIPTEN__
+    if (uiOfflineExport && !uiExportStream) {
+        ImGui::SliderInt("segments", &uiExportSegments, 1, 8);
+        ImGui::SliderFloat("checkpoint every", &uiCheckpointSeconds, 0.0f,
+                           60.0f,
+                           uiCheckpointSeconds > 0.0f ? "%.0f s" : "off");
+    }
+#endif
+    ImGui::SliderInt("tile size", &uiExportTileSize, 0, 8192,
+                     uiExportTileSize == 0 ? "auto" : "%d");
+    ImGui::SliderInt("sub-frames", &uiExportSubframes, 1, 64,
+                     uiExportSubframes == 1 ? "off" : "%d");
+    if (uiExportSubframes > 1) {
+        ImGui::SliderFloat("shutter angle", &uiShutterAngle, 0.0f, 360.0f,
+                           "%.0f deg");
+    }
+    ImGui::Checkbox("convert to I420 on the GPU", &uiGpuYuvConversion);
+
+    bool deduplicate = recording->getFrameDeduplication();
+    if (ImGui::Checkbox("skip duplicate frames", &deduplicate)) {
+        recording->setFrameDeduplication(deduplicate);
+    }
+
+    int32_t readbackDepth = recording->getReadbackDepth();
+    if (ImGui::SliderInt("readback buffers", &readbackDepth, 2, 8)) {
+        recording->setReadbackDepth(readbackDepth);
+    }
+
     std::stringstream ss;
     ss.str(std::string());
     ss << 30000.0f / 1001.0f << " hz";
@@ -1092,6 +2286,10 @@ void App::onUiCaptureWindow() {
     const char* const webmExt = "webm";
     const char* const mp4Filter = "Video file (*.mp4)\0*.mp4\0";
     const char* const mp4Ext = "mp4";
+    const char* const pngFilter = "PNG sequence (*.png)\0*.png\0";
+    const char* const pngExt = "png";
+    const char* const gifFilter = "Animated GIF (*.gif)\0*.gif\0";
+    const char* const gifExt = "gif";
     const char* filter = nullptr;
     const char* ext = nullptr;
     bool ok = false;
@@ -1113,6 +2311,18 @@ void App::onUiCaptureWindow() {
                 filter = mp4Filter;
                 ext = mp4Ext;
             } break;
+            case AppVideoType::PNG: {
+                fileName = "frames.png";
+                filter = pngFilter;
+                ext = pngExt;
+            } break;
+            case AppVideoType::GIF: {
+                fileName = "video.gif";
+                filter = gifFilter;
+                ext = gifExt;
+            } break;
+            default:
+                break;
         }
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
@@ -1120,9 +2330,18 @@ void App::onUiCaptureWindow() {
 #else
         ok = true;
 #endif
+        if (uiExportStream) {
+            fileName = uiStreamTarget;
+            ok = StreamSink::isStreamTarget(fileName);
+            if (!ok) {
+                AppLog::getInstance().error("Unknown stream target: %s\n",
+                                            uiStreamTarget);
+            }
+        }
         if (ok) {
-            startRecord(fileName, static_cast<int32_t>(uiVideoMbps * 1000.0f),
-                        encodeDeadline);
+            const int32_t kbps = static_cast<int32_t>(uiVideoMbps * 1000.0f);
+            recording->setExtraOutputs(getExtraOutputs(fileName, kbps));
+            startRecord(fileName, kbps, encodeDeadline);
             ImGui::OpenPopup("Export Progress");
         }
     }
@@ -1138,15 +2357,171 @@ void App::onUiCaptureWindow() {
                 ImGui::CloseCurrentPopup();
             }
         } else {
-            float value = uiTimeValue / uiVideoTime;
+            float value = static_cast<float>(exportedFrames) /
+                          static_cast<float>(exportFrameCount);
             ImGui::ProgressBar(value, ImVec2(200.0f, 15.0f));
+            ImGui::Text("%.1f fps", getExportFramesPerSecond());
+            if (recording->getSegmentCount() > 1) {
+                ImGui::Text("segments: %d", recording->getSegmentCount());
+            }
+
+            ImGui::Text("readback stalls: %lld (%.1f ms)",
+                        static_cast<long long>(
+                            recording->getReadbackStallCount()),
+                        recording->getReadbackStallMilliseconds());
+            ImGui::Text("encoder backpressure: %lld (%.1f ms)",
+                        static_cast<long long>(
+                            recording->getBackpressureCount()),
+                        recording->getBackpressureMilliseconds());
+            ImGui::Text("duplicate frames: %lld",
+                        static_cast<long long>(
+                            recording->getDuplicateFrameCount()));
         }
 
         ImGui::EndPopup();
     }
+
+#ifndef __EMSCRIPTEN__
+    onUiInstantReplay();
+#endif
+
     ImGui::End();
 }
 
+void App::updateInstantReplay(double now, bool frameCompleted) {
+    // The capture size follows the window, a resize or new settings start
+    // the replay over.
+    const ReplayOptions& options = replay.getOptions();
+    const bool changed =
+        replay.getSourceWidth() != windowWidth ||
+        replay.getSourceHeight() != windowHeight ||
+        options.seconds != uiReplayOptions.seconds ||
+        options.downscale != uiReplayOptions.downscale ||
+        options.kbps != uiReplayOptions.kbps ||
+        options.memoryMegabytes != uiReplayOptions.memoryMegabytes;
+
+    if (!uiInstantReplay) {
+        replay.stop();
+    } else if (!replay.isRunning() || changed) {
+        uiInstantReplay = replay.start(windowWidth, windowHeight,
+                                       uiReplayOptions);
+    }
+
+    // Exported frames are not the preview, and the export needs the GPU.
+    if (frameCompleted && !recording->getIsRecording()) {
+        replay.capture(buffers.getFrameBuffer(READ), buffers.getWidth(),
+                       buffers.getHeight(), now);
+    }
+
+    if (ImGui::IsKeyPressed(GLFW_KEY_F9) && replay.isRunning()) {
+        saveInstantReplay();
+    }
+}
+
+void App::saveInstantReplay() {
+    char fileName[64];
+    const std::time_t t = std::time(nullptr);
+    std::strftime(fileName, sizeof(fileName), "replay_%Y%m%d_%H%M%S.webm",
+                  std::localtime(&t));
+    replay.save(fileName);
+}
+
+void App::onUiInstantReplay() {
+    if (!ImGui::TreeNode("instant replay")) {
+        return;
+    }
+
+    ImGui::Checkbox("keep the last seconds of the preview", &uiInstantReplay);
+    ImGui::SliderInt("length (s)", &uiReplayOptions.seconds, 5, 120);
+
+    const char* downscaleItems[] = {"1/1", "1/2", "1/4"};
+    int32_t downscaleIndex = uiReplayOptions.downscale >= 4
+                                 ? 2
+                                 : uiReplayOptions.downscale - 1;
+    if (ImGui::Combo("size", &downscaleIndex, downscaleItems,
+                     IM_ARRAYSIZE(downscaleItems))) {
+        uiReplayOptions.downscale = 1 << downscaleIndex;
+    }
+
+    ImGui::SliderInt("kbps", &uiReplayOptions.kbps, 500, 20000);
+    ImGui::SliderInt("memory (MB)", &uiReplayOptions.memoryMegabytes, 16, 512);
+
+    if (replay.isRunning()) {
+        ImGui::Text("buffered: %.1f s, %.1f MB, %lld dropped frames",
+                    replay.getBufferedSeconds(),
+                    replay.getBufferedBytes() / (1024.0 * 1024.0),
+                    static_cast<long long>(replay.getDroppedFrames()));
+
+        if (replay.isSaving()) {
+            ImGui::Text("saving...");
+        } else if (ImGui::Button("Save replay (F9)")) {
+            saveInstantReplay();
+        }
+    }
+
+    ImGui::TreePop();
+}
+
+void App::onUiEncoderBenchmark(int32_t kbps, unsigned long encodeDeadline) {
+    if (!ImGui::TreeNode("encode benchmark")) {
+        return;
+    }
+
+    if (encoderBenchmark.isRunning()) {
+        ImGui::ProgressBar(encoderBenchmark.getProgress(),
+                           ImVec2(200.0f, 15.0f));
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) {
+            encoderBenchmark.cancel();
+        }
+    } else if (ImGui::Button("Run")) {
+        std::vector<EncoderBenchmark::Size> sizes;
+        // Sizes that are exported in tiles would take minutes per preset.
+        for (const VideoResolution& resolution : VideoResolutions) {
+            if (resolution.width > MaxUntiledExportSize ||
+                resolution.height > MaxUntiledExportSize) {
+                continue;
+            }
+            sizes.push_back({resolution.width, resolution.height});
+        }
+
+        encoderBenchmark.start(sizes, uiWebmOptions, kbps, encodeDeadline);
+    }
+
+    const std::string error = encoderBenchmark.getError();
+    if (!error.empty()) {
+        ImGui::Text("%s", error.c_str());
+    }
+
+    // One row per resolution with the fps of each speed preset.
+    const std::vector<EncoderBenchmark::Result> results =
+        encoderBenchmark.getResults();
+
+    ImGui::Columns(WebmSpeedPresetCount + 1, "encode benchmark");
+    ImGui::Separator();
+    ImGui::Text("fps");
+    ImGui::NextColumn();
+    for (int32_t i = 0; i < WebmSpeedPresetCount; i++) {
+        ImGui::Text("%s", WebmSpeedPresetNames[i]);
+        ImGui::NextColumn();
+    }
+    ImGui::Separator();
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].preset == 0) {
+            ImGui::Text("%dx%d", results[i].size.width,
+                        results[i].size.height);
+            ImGui::NextColumn();
+        }
+
+        ImGui::Text("%.1f", results[i].framesPerSecond);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+    ImGui::TreePop();
+}
+
 void App::onUiStatsWindow() {
     ImGui::Begin("Stats", &uiStatsWindow, ImGuiWindowFlags_AlwaysAutoResize);
 
@@ -1168,6 +2543,122 @@ void App::onUiStatsWindow() {
     bufferStringStream << buffers.getWidth() << ", " << buffers.getHeight();
     ImGui::LabelText("buffer", "%s", bufferStringStream.str().c_str());
 
+    ImGui::LabelText("static frame", "%s", frameCacheHit ? "cached" : "-");
+
+#ifndef __EMSCRIPTEN__
+    if (ImGui::CollapsingHeader("GPU passes")) {
+        std::vector<float> buckets(32);
+
+        for (auto i = 0; i < GPU_PASS_COUNT; i++) {
+            const GpuPass pass = static_cast<GpuPass>(i);
+            const float p50 = gpuProfiler.getPercentile(pass, 50.0f);
+            const float p95 = gpuProfiler.getPercentile(pass, 95.0f);
+            const float p99 = gpuProfiler.getPercentile(pass, 99.0f);
+
+            ImGui::PushID(i);
+            ImGui::LabelText(GpuProfiler::getPassName(pass),
+                             "%.2f ms (p50 %.2f, p95 %.2f, p99 %.2f)",
+                             gpuProfiler.getLastMilliseconds(pass), p50, p95,
+                             p99);
+
+            // Leave some headroom above p99 so that the tail stays visible.
+            const float maxMilliseconds = std::max(p99 * 1.25f, 0.1f);
+            gpuProfiler.getHistogram(pass, maxMilliseconds, buckets);
+
+            std::stringstream overlay;
+            overlay << "0 - " << maxMilliseconds << " ms";
+            ImGui::PlotHistogram("", buckets.data(),
+                                 static_cast<int>(buckets.size()), 0,
+                                 overlay.str().c_str(), 0.0f, FLT_MAX,
+                                 ImVec2(0, 40));
+            ImGui::PopID();
+        }
+    }
+#endif
+
+    ImGui::End();
+}
+
+void App::onUiPerformanceWindow() {
+    ImGui::Begin("Performance", &uiPerformanceWindow,
+                 ImGuiWindowFlags_AlwaysAutoResize);
+
+    ImGui::Checkbox("Idle when inactive", &uiIdleMode);
+    ImGui::Checkbox("Throttle when unfocused", &uiThrottleUnfocused);
+
+    const char* const capItems[] = {"vsync", "60", "30", "15"};
+    const int32_t capValues[] = {0, 60, 30, 15};
+    int32_t capIndex = 0;
+    for (auto i = 0; i < IM_ARRAYSIZE(capValues); i++) {
+        if (capValues[i] == scheduler.getFrameRateCap()) {
+            capIndex = i;
+        }
+    }
+
+    if (ImGui::Combo("frame rate cap", &capIndex, capItems,
+                     IM_ARRAYSIZE(capItems))) {
+        scheduler.setFrameRateCap(capValues[capIndex]);
+    }
+
+    ImGui::LabelText("scheduler", "%s",
+                     scheduler.isIdle() ? "idle" : "running");
+
+    ImGui::Separator();
+
+    ImGui::Checkbox("Dynamic resolution", &uiDynamicResolution);
+
+    float targetMilliseconds = dynamicResolution.getTargetMilliseconds();
+    if (ImGui::DragFloat("target ms", &targetMilliseconds, 0.1f, 1.0f, 100.0f,
+                         "%.1f")) {
+        dynamicResolution.setTargetMilliseconds(targetMilliseconds);
+    }
+
+    float minScale = dynamicResolution.getMinScale();
+    if (ImGui::SliderFloat("min scale", &minScale, 0.125f, 1.0f, "%.3f")) {
+        dynamicResolution.setMinScale(minScale);
+    }
+
+    const char* const filterItems[] = {"nearest", "linear"};
+    ImGui::Combo("upscale filter", &uiUpscaleFilterIndex, filterItems,
+                 IM_ARRAYSIZE(filterItems));
+
+    ImGui::LabelText("scale", "%.3f", dynamicResolution.getScale());
+    ImGui::LabelText("shader pass", "%.2f ms",
+                     gpuProfiler.getLastMilliseconds(GPU_PASS_SHADER));
+
+    ImGui::Separator();
+
+    ImGui::Checkbox("Progressive rendering", &uiProgressiveRendering);
+    if (uiProgressiveRendering && uiDynamicResolution) {
+        ImGui::TextDisabled("disabled while dynamic resolution is on");
+    }
+
+    const char* const tileItems[] = {"64", "128", "256", "512"};
+    const GLint tileValues[] = {64, 128, 256, 512};
+    int32_t tileIndex = 0;
+    for (auto i = 0; i < IM_ARRAYSIZE(tileValues); i++) {
+        if (tileValues[i] == progressiveRenderer.getTileSize()) {
+            tileIndex = i;
+        }
+    }
+
+    if (ImGui::Combo("tile size", &tileIndex, tileItems,
+                     IM_ARRAYSIZE(tileItems))) {
+        progressiveRenderer.setTileSize(tileValues[tileIndex]);
+    }
+
+    float budgetMilliseconds = progressiveRenderer.getBudgetMilliseconds();
+    if (ImGui::DragFloat("budget ms", &budgetMilliseconds, 0.1f, 1.0f, 100.0f,
+                         "%.1f")) {
+        progressiveRenderer.setBudgetMilliseconds(budgetMilliseconds);
+    }
+
+    ImGui::LabelText("tile", "%.2f ms",
+                     progressiveRenderer.getTileMilliseconds());
+    ImGui::LabelText("tiles", "%d / %d",
+                     progressiveRenderer.getCompletedTiles(),
+                     progressiveRenderer.getTileCount());
+
     ImGui::End();
 }
 
@@ -1204,7 +2695,8 @@ void App::onUiUniformWindow(const UniformNames& uNames,
         if (u.name == uNames.time || u.name == uNames.resolution ||
             u.name == uNames.mouse || u.name == uNames.frame ||
             u.name == uNames.backbuffer || u.name == uNames.matMV ||
-            u.name == uNames.matMV_T || u.name == uNames.matMV_IT) {
+            u.name == uNames.matMV_T || u.name == uNames.matMV_IT ||
+            u.name == FragCoordOffsetUniform) {
             ImGui::LabelText(u.name.c_str(), "%s", u.toString().c_str());
             continue;
         }
@@ -2,16 +2,28 @@
 
 #include "common.hpp"
 
+#include <chrono>
 #include <map>
 #include <string>
 #include <memory>
 
+#include <imgui.h>
 #include <TextEditor.h>
 
 #include "shader_files.hpp"
 #include "shader_program.hpp"
 #include "buffers.hpp"
 #include "recording.hpp"
+#include "frame_scheduler.hpp"
+#include "gpu_profiler.hpp"
+#include "dynamic_resolution.hpp"
+#include "progressive_renderer.hpp"
+#include "headless.hpp"
+#include "gpu_yuv_converter.hpp"
+#include "frame_accumulator.hpp"
+#include "encoder_benchmark.hpp"
+#include "replay_buffer.hpp"
+#include "export_manifest.hpp"
 
 namespace shader_editor {
 struct UniformNames {
@@ -43,12 +55,63 @@ typedef enum {
     I420 = 0,
     WebM = 1,
     H264 = 2,
+    // Uncompressed RGBA, only for streams.
+    RGBA = 3,
+    // Numbered lossless PNG files.
+    PNG = 4,
+    GIF = 5,
 } AppVideoType;
 
 const char* const VideoTypeNames[] = {
-    "I420",
-    "WebM",
-    "MP4",
+    "I420", "WebM", "MP4", "RGBA (raw)", "PNG sequence", "GIF",
+};
+
+// File extensions of the types, raw RGBA has none.
+const char* const VideoTypeExtensions[] = {
+    ".y4m", ".webm", ".mp4", "", ".png", ".gif",
+};
+
+struct VideoResolution {
+    const char* name;
+    int32_t width;
+    int32_t height;
+};
+
+const VideoResolution VideoResolutions[] = {
+    {"256x144", 256, 144},     {"427x240", 427, 240},
+    {"640x360", 640, 360},     {"720x480", 720, 480},
+    {"1280x720", 1280, 720},   {"1920x1080", 1920, 1080},
+    {"2560x1440", 2560, 1440}, {"3840x2160", 3840, 2160},
+    {"7680x4320", 7680, 4320}, {"15360x8640", 15360, 8640},
+};
+
+struct HeadlessOptions {
+    std::string shaderPath;
+    std::string exportPath;
+    // Further files written from the same frames, in the format of their
+    // extension.
+    std::vector<std::string> extraExportPaths;
+    // Heights of smaller renditions written from the same frames.
+    std::vector<int32_t> ladderHeights;
+    float seconds = 10.0f;
+    int32_t width = 1920;
+    int32_t height = 1080;
+    int32_t kbps = 8000;
+    int32_t segments = 1;
+    // Seconds of video written in each checkpoint, 0 for none.
+    float checkpointSeconds = 0.0f;
+    // Manifest of an interrupted export to continue, it replaces the other
+    // export options.
+    std::string resumePath;
+    // 0 picks a tile size when the frame is too large to render at once.
+    int32_t tileSize = 0;
+    // Samples averaged into each frame and the part of the frame interval
+    // they are spread over, in degrees.
+    int32_t subframes = 1;
+    float shutterAngle = 180.0f;
+    bool rawRgba = false;
+    bool keepDuplicates = false;
+    AppShaderPlatform platform = GLSL_DEFAULT;
 };
 
 class App {
@@ -66,9 +129,31 @@ class App {
     bool uiShowTextEditor = true;
     bool uiErrorWindow = false;
     bool uiAppLogWindow = false;
+    bool uiPerformanceWindow = false;
 
     float uiTimeValue = 0;
     bool uiPlaying = true;
+    bool uiStaticFrameCache = true;
+    bool uiIdleMode = true;
+    bool uiThrottleUnfocused = true;
+    bool uiDynamicResolution = false;
+    int32_t uiUpscaleFilterIndex = 1;
+    bool uiProgressiveRendering = false;
+    bool uiCpuTrace = false;
+    bool uiOfflineExport = true;
+    bool uiGpuYuvConversion = true;
+    int32_t uiExportSegments = 1;
+    float uiCheckpointSeconds = 0.0f;
+    int32_t uiExportTileSize = 0;
+    int32_t uiExportSubframes = 1;
+    float uiShutterAngle = 180.0f;
+    bool uiExportStream = false;
+    char uiStreamTarget[256] = "fifo:/tmp/shader_editor.stream";
+    int32_t uiStreamFormatIndex = 0;
+    bool uiExtraOutputs[IM_ARRAYSIZE(VideoTypeNames)] = {false};
+    bool uiLadderRungs[IM_ARRAYSIZE(VideoResolutions)] = {false};
+    bool uiInstantReplay = false;
+    ReplayOptions uiReplayOptions;
 
     AppShaderPlatform uiShaderPlatformIndex = GLSL_DEFAULT;
     AppVideoType uiVideoTypeIndex = AppVideoType::I420;
@@ -77,6 +162,9 @@ class App {
     int32_t uiVideoResolutionIndex = 2;
     int32_t uiVideoQualityIndex = 1;
     float uiVideoMbps = 1.0f;
+    int32_t uiWebmSpeedIndex = 2;
+    WebmEncoderOptions uiWebmOptions;
+    GifEncoderOptions uiGifOptions;
     float uiVideoTime = 5.0f;
 
     glm::vec3 posCamera = glm::vec3(0.0f, 0.0f, 5.0f);
@@ -106,15 +194,88 @@ class App {
     bool needRecompile = false;
     float lastTextEdited = 0;
 
+    std::vector<uint8_t> frameCacheKey;
+    bool frameCacheHit = false;
+
+    FrameScheduler scheduler;
+    ImVec2 lastMousePos = ImVec2(0.0f, 0.0f);
+
+    GpuProfiler gpuProfiler;
+    std::string cpuTraceFileName;
+    DynamicResolution dynamicResolution;
+    GLuint upscaleSamplers[2] = {0};
+
+    // Uniforms and inputs captured when the current progressive frame
+    // started, every tile of a frame is drawn with the same values.
+    ProgressiveRenderer progressiveRenderer;
+    std::map<const std::string, ShaderUniform> progressiveUniforms;
+    std::vector<uint8_t> progressiveCacheKey;
+    uint64_t progressiveSerial = 0;
+    uint32_t progressiveGeneration = 0;
+
     ShaderFiles shaderFiles;
     Buffers buffers;
     TextEditor editor;
 
     std::unique_ptr<Recording> recording = std::make_unique<Recording>();
+    // Rewritten after each checkpoint of the current export, none unless
+    // it is checkpointed.
+    ExportManifest exportManifest;
+    std::string exportManifestPath;
+    GpuYuvConverter yuvConverter;
+    FrameAccumulator accumulator;
+    EncoderBenchmark encoderBenchmark;
+    ReplayBuffer replay;
     bool h264enabled = false;
 
     void startRecord(const std::string& fileName, const int32_t kbps,
                      unsigned long encodeDeadline);
+    void startRecord(const std::string& fileName, GLint width, GLint height,
+                     const int32_t kbps, unsigned long encodeDeadline);
+    void finishRecord(int32_t currentWidth, int32_t currentHeight);
+    void writeExportManifest(const std::string& fileName, GLint width,
+                             GLint height, int32_t kbps,
+                             unsigned long encodeDeadline);
+    void updateExportManifest();
+    bool enableH264();
+
+    // Time budget of one offline export batch before the window gets a
+    // chance to show progress and handle events.
+    const int32_t OfflineExportSliceMs = 100;
+    std::chrono::steady_clock::time_point exportStartTime;
+    uint64_t exportedFrames = 0;
+    int64_t exportFrameCount = 0;
+
+    // Exports larger than this in either direction are rendered in tiles of
+    // DefaultExportTileSize unless a tile size is set.
+    const int32_t MaxUntiledExportSize = 4096;
+    const int32_t DefaultExportTileSize = 2048;
+
+    int32_t getExportTileSize(GLint width, GLint height);
+    bool isOfflineExport() const;
+    int64_t getExportFrameCount() const;
+    AppVideoType getExportVideoType() const;
+    std::vector<RecordingOutput> getExtraOutputs(const std::string& fileName,
+                                                 int32_t kbps) const;
+    RecordingOutput getLadderRung(const std::string& fileName, int32_t width,
+                                  int32_t height, int32_t kbps,
+                                  int32_t topWidth, int32_t topHeight) const;
+    float getExportFramesPerSecond() const;
+    void logExportThroughput() const;
+    void readbackExportFrame(bool isLastFrame, int32_t tile);
+    void onUiEncoderBenchmark(int32_t kbps, unsigned long encodeDeadline);
+
+    void updateInstantReplay(double now, bool frameCompleted);
+    void saveInstantReplay();
+    void onUiInstantReplay();
+    void renderExportSubframes(const UniformNames& uNames,
+                               std::map<std::string, PImage>& usedTextures,
+                               const glm::vec2& tileOffset);
+    bool renderExportFrame(const UniformNames& uNames,
+                           std::map<std::string, PImage>& usedTextures);
+    void exportOfflineFrames(const UniformNames& uNames,
+                             std::map<std::string, PImage>& usedTextures,
+                             int32_t currentWidth, int32_t currentHeight);
 
     void SetProgramErrors(const PShaderProgram program);
 
@@ -128,10 +289,32 @@ class App {
     void setupShaderTemplate(PShaderProgram newProgram);
     void setupPlatformUniform(const UniformNames& uNames);
 
+    bool isTimeDependentProgram(const UniformNames& uNames) const;
+    bool updateFrameCache(const UniformNames& uNames,
+                          const std::map<std::string, PImage>& usedTextures);
+
+    bool hasInputActivity();
+    bool isAnimating();
+
+    void updateRenderScale(const UniformNames& uNames);
+
+    void initializeRenderer(GLint bufferWidth, GLint bufferHeight);
+    bool loadAssets(const std::string& assetPath);
+
+    void setupFrameUniforms(const UniformNames& uNames);
+    void renderShaderPass(const UniformNames& uNames,
+                          std::map<std::string, PImage>& usedTextures);
+
+    void bindShaderInputs(const UniformNames& uNames,
+                          std::map<std::string, PImage>& usedTextures);
+    bool renderProgressiveTiles(const UniformNames& uNames,
+                                std::map<std::string, PImage>& usedTextures);
+
     PShaderProgram refreshShaderProgram(float now, int32_t& cursorLine);
 
     void onUiCaptureWindow();
     void onUiStatsWindow();
+    void onUiPerformanceWindow();
     void onUiErrorWindow();
     void onUiTimeWindow(float now);
     void onUiUniformWindow(const UniformNames& uNames,
@@ -143,9 +326,21 @@ class App {
    public:
     GLFWwindow* getMainWindow();
 
+    void setFrameRateCap(int32_t fps);
+
+    // Records CPU scopes until the app exits (or the trace is stopped from
+    // the menu) and writes them to fileName.
+    void startCpuTrace(const std::string& fileName);
+    void stopCpuTrace();
+
     int32_t start(int32_t width, int32_t height, const std::string& asetPath,
                   bool alwaysOnTop);
     void update(void*);
     void cleanup();
+
+    // Renders requested.shaderPath straight into a video file through an
+    // offscreen context, without creating a window, or continues the export
+    // of requested.resumePath. Returns the exit code.
+    int32_t runHeadless(const HeadlessOptions& requested);
 };
 }  // namespace shader_editor
\ No newline at end of file
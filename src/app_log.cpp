@@ -16,6 +16,10 @@ AppLogLevel AppLog::getLogLevel() {
     return this->logLevel;
 }
 
+void AppLog::setConsoleStderr(bool consoleStderr) {
+    this->consoleStderr = consoleStderr;
+}
+
 void AppLog::clear() {
     buf.clear();
     lineOffsets.clear();
@@ -26,7 +30,7 @@ void AppLog::addLog(va_list args, const char* fmt) {
     int old_size = buf.size();
     buf.appendfv(fmt, args);
 
-    std::cout << buf.c_str() + old_size;
+    (consoleStderr ? std::cerr : std::cout) << buf.c_str() + old_size;
 
     for (int new_size = buf.size(); old_size < new_size; old_size++)
         if (buf[old_size] == '\n') lineOffsets.push_back(old_size + 1);
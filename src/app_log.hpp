@@ -18,6 +18,8 @@ class AppLog {
         lineOffsets;  // Index to lines offset. We maintain this with AddLog()
                       // calls, allowing us to have a random access on lines
     bool scrolltoBottom;
+    // stdout may carry exported video, the console copy then goes to stderr.
+    bool consoleStderr = false;
 
     void addLog(va_list args, const char* fmt);
 
@@ -30,6 +32,8 @@ class AppLog {
 
     AppLogLevel getLogLevel();
 
+    void setConsoleStderr(bool consoleStderr);
+
     void clear();
 
     void detail(const char* fmt, ...);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include <stdint.h>
+
+// Fixed-capacity FIFO shared between threads. push() blocks while the queue
+// is full, pop() blocks while it is empty. Once closed, pop() drains what is
+// left and then fails.
+template <typename T>
+class BoundedQueue {
+   private:
+    std::deque<T> items;
+    size_t capacity = 1;
+    bool closed = false;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+
+   public:
+    explicit BoundedQueue(size_t capacity = 1) : capacity(capacity) {}
+
+    // Must not be called while other threads use the queue.
+    void reset(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        items.clear();
+        this->capacity = capacity;
+        closed = false;
+    }
+
+    bool push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock,
+                     [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+};
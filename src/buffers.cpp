@@ -3,8 +3,11 @@
 #include <algorithm>
 #include <assert.h>
 
-GLint Buffers::getWidth() { return bufferWidth; }
-GLint Buffers::getHeight() { return bufferHeight; }
+GLint Buffers::getWidth() { return renderWidth; }
+GLint Buffers::getHeight() { return renderHeight; }
+GLint Buffers::getAllocatedWidth() { return bufferWidth; }
+GLint Buffers::getAllocatedHeight() { return bufferHeight; }
+uint32_t Buffers::getGeneration() { return generation; }
 
 GLuint Buffers::getFrameBuffer(BufferType type) {
     switch (type) {
@@ -45,25 +48,11 @@ GLuint Buffers::getBackBuffer(BufferType type) {
     return 0;
 }
 
-GLuint Buffers::getPixelBuffer(BufferType type) {
-    switch (type) {
-        case READ:
-            return pixelBuffers[readBufferIndex];
-        case WRITE:
-            return pixelBuffers[writeBufferIndex];
-    }
-
-    assert(0);
-
-    return 0;
-}
-
 void Buffers::initialize(GLint width, GLint height) {
     // Framebuffers
     glGenFramebuffers(2, frameBuffers);
     glGenRenderbuffers(2, depthBuffers);
     glGenTextures(2, backBuffers);
-    glGenBuffers(2, pixelBuffers);
 
     updateFrameBuffersSize(width, height);
 
@@ -75,6 +64,9 @@ void Buffers::initialize(GLint width, GLint height) {
 void Buffers::updateFrameBuffersSize(GLint width, GLint height) {
     bufferWidth = width;
     bufferHeight = height;
+    renderWidth = width;
+    renderHeight = height;
+    generation++;
 
     for (int32_t i = 0; i < 2; i++) {
         glBindFramebuffer(GL_FRAMEBUFFER, frameBuffers[i]);
@@ -99,12 +91,12 @@ void Buffers::updateFrameBuffersSize(GLint width, GLint height) {
         glBindTexture(GL_TEXTURE_2D, 0);
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
-        glBufferData(GL_PIXEL_PACK_BUFFER, bufferWidth * bufferHeight * 4L, 0,
-                     GL_STREAM_DRAW);
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     }
 }
 
+void Buffers::setRenderSize(GLint width, GLint height) {
+    renderWidth = std::clamp(width, 1, bufferWidth);
+    renderHeight = std::clamp(height, 1, bufferHeight);
+}
+
 void Buffers::swap() { std::swap(writeBufferIndex, readBufferIndex); }
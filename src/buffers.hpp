@@ -14,26 +14,40 @@ class Buffers {
     GLuint frameBuffers[2] = {0};
     GLuint depthBuffers[2] = {0};
     GLuint backBuffers[2] = {0};
-    GLuint pixelBuffers[2] = {0};
 
     GLint bufferWidth;
     GLint bufferHeight;
 
+    // Size of the region actually rendered, the lower left sub-rect of the
+    // allocated buffers.
+    GLint renderWidth;
+    GLint renderHeight;
+
+    uint32_t generation = 0;
+
    public:
     GLint getWidth();
     GLint getHeight();
 
+    GLint getAllocatedWidth();
+    GLint getAllocatedHeight();
+
+    // Incremented every time the framebuffers are reallocated (and their
+    // contents lost).
+    uint32_t getGeneration();
+
     GLuint getFrameBuffer(BufferType type);
 
     GLuint getDepthBuffer(BufferType type);
 
     GLuint getBackBuffer(BufferType type);
 
-    GLuint getPixelBuffer(BufferType type);
-
     void initialize(GLint width, GLint height);
 
     void updateFrameBuffersSize(GLint width, GLint height);
 
+    // Renders into a sub-rect of the allocated buffers without reallocating.
+    void setRenderSize(GLint width, GLint height);
+
     void swap();
 };
@@ -0,0 +1,240 @@
+#include "cpu_profiler.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+#include "app_log.hpp"
+
+// Hands the calling thread's chain back to the profiler when it exits.
+struct ThreadRegistration {
+    void* events = nullptr;
+    std::string name;
+
+    ~ThreadRegistration() {
+        if (events != nullptr) {
+            CpuProfiler::getInstance().onThreadExit(
+                static_cast<CpuProfiler::ThreadEvents*>(events));
+        }
+    }
+};
+
+namespace {
+thread_local ThreadRegistration currentThread;
+
+void writeJsonString(std::ostream& out, const std::string& str) {
+    out << '"';
+    for (auto it = str.cbegin(); it != str.cend(); it++) {
+        const char c = *it;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+}  // namespace
+
+CpuProfiler& CpuProfiler::getInstance() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+int64_t CpuProfiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+CpuProfiler::~CpuProfiler() {
+    for (ThreadEvents* t = threads; t != nullptr;) {
+        releaseBlocks(t->head);
+
+        ThreadEvents* next = t->next;
+        delete t;
+        t = next;
+    }
+
+    while (spareBlocks != nullptr) {
+        EventBlock* next = spareBlocks->next.load();
+        delete spareBlocks;
+        spareBlocks = next;
+    }
+}
+
+CpuProfiler::EventBlock* CpuProfiler::acquireBlock() {
+    if (spareBlocks == nullptr) {
+        return new EventBlock();
+    }
+
+    EventBlock* block = spareBlocks;
+    spareBlocks = block->next.load(std::memory_order_relaxed);
+    block->count.store(0, std::memory_order_relaxed);
+    block->next.store(nullptr, std::memory_order_relaxed);
+    return block;
+}
+
+void CpuProfiler::releaseBlocks(EventBlock* first) {
+    while (first != nullptr) {
+        EventBlock* next = first->next.load(std::memory_order_relaxed);
+        first->next.store(spareBlocks, std::memory_order_relaxed);
+        spareBlocks = first;
+        first = next;
+    }
+}
+
+CpuProfiler::ThreadEvents* CpuProfiler::getThreadEvents() {
+    if (currentThread.events != nullptr) {
+        return static_cast<ThreadEvents*>(currentThread.events);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    ThreadEvents* t = new ThreadEvents();
+    t->threadId = ++threadCount;
+    t->threadName = currentThread.name;
+    t->head = t->tail = acquireBlock();
+    t->trace = trace.load(std::memory_order_relaxed);
+    t->next = threads;
+    threads = t;
+
+    currentThread.events = t;
+    return t;
+}
+
+void CpuProfiler::resetThreadEvents(ThreadEvents* t) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    releaseBlocks(t->head->next.load(std::memory_order_relaxed));
+    t->head->next.store(nullptr, std::memory_order_relaxed);
+    t->head->count.store(0, std::memory_order_release);
+    t->tail = t->head;
+    t->trace = trace.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::onThreadExit(ThreadEvents* t) {
+    std::lock_guard<std::mutex> lock(mutex);
+    t->exited = true;
+}
+
+void CpuProfiler::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // The threads that exited since the last trace was written out.
+        for (ThreadEvents** it = &threads; *it != nullptr;) {
+            ThreadEvents* t = *it;
+            if (!t->exited) {
+                it = &t->next;
+                continue;
+            }
+
+            *it = t->next;
+            releaseBlocks(t->head);
+            delete t;
+        }
+
+        trace.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    traceStart = now();
+    enabled.store(true);
+}
+
+void CpuProfiler::stop() { enabled.store(false); }
+
+void CpuProfiler::setThreadName(const std::string& name) {
+    currentThread.name = name;
+
+    if (currentThread.events != nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        static_cast<ThreadEvents*>(currentThread.events)->threadName = name;
+    }
+}
+
+void CpuProfiler::record(const char* name, int64_t start, int64_t end) {
+    ThreadEvents* t = getThreadEvents();
+    if (t->trace != trace.load(std::memory_order_relaxed)) {
+        resetThreadEvents(t);
+    }
+
+    EventBlock* block = t->tail;
+
+    int32_t count = block->count.load(std::memory_order_relaxed);
+    if (count == EventBlock::Capacity) {
+        EventBlock* next = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            next = acquireBlock();
+        }
+        block->next.store(next, std::memory_order_release);
+        t->tail = block = next;
+        count = 0;
+    }
+
+    ProfileEvent& e = block->events[count];
+    e.name = name;
+    e.start = start;
+    e.duration = end - start;
+    block->count.store(count + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::writeTrace(const std::string& fileName) {
+    std::ofstream out(fileName, std::ios::out | std::ios::trunc);
+    if (!out) {
+        AppLog::getInstance().error("Failed to open trace file: %s\n",
+                                    fileName.c_str());
+        return false;
+    }
+
+    int64_t eventCount = 0;
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (ThreadEvents* t = threads; t != nullptr; t = t->next) {
+        if (!t->threadName.empty()) {
+            out << (eventCount++ > 0 ? ",\n" : "\n");
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << t->threadId << ",\"args\":{\"name\":";
+            writeJsonString(out, t->threadName);
+            out << "}}";
+        }
+
+        for (EventBlock* b = t->head; b != nullptr;
+             b = b->next.load(std::memory_order_acquire)) {
+            const int32_t count = b->count.load(std::memory_order_acquire);
+
+            for (int32_t i = 0; i < count; i++) {
+                const ProfileEvent& e = b->events[i];
+                if (e.start < traceStart) {
+                    continue;
+                }
+
+                out << (eventCount++ > 0 ? ",\n" : "\n");
+                out << "{\"name\":";
+                writeJsonString(out, e.name);
+                out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->threadId
+                    << ",\"ts\":" << (e.start - traceStart) / 1000.0
+                    << ",\"dur\":" << e.duration / 1000.0 << "}";
+            }
+        }
+    }
+
+    out << "\n]}\n";
+
+    if (!out) {
+        AppLog::getInstance().error("Failed to write trace file: %s\n",
+                                    fileName.c_str());
+        return false;
+    }
+
+    AppLog::getInstance().info("Wrote %lld trace events to %s\n",
+                               static_cast<long long>(eventCount),
+                               fileName.c_str());
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include <stdint.h>
+
+// Records a timed event for the enclosing scope while a trace is running.
+// The name must outlive the trace, string literals are expected.
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+struct ProfileEvent {
+    const char* name;
+    int64_t start;
+    int64_t duration;
+};
+
+// Collects scoped CPU events and writes them as a Chrome trace (JSON, which
+// chrome://tracing and Perfetto both load).
+//
+// Every thread appends to its own chain of fixed-size blocks. The owning
+// thread is the only writer, it publishes an event by bumping the block's
+// count and a new block through the previous block's next pointer, so the
+// hot path never takes a lock. The mutex guards the list of threads and the
+// spare blocks, which are only touched when a block fills up or a thread
+// records its first event of a trace.
+//
+// A thread gets its chain on its first event while a trace runs, naming it
+// allocates nothing. Each start() takes back the blocks of threads that
+// have exited, and a running thread hands back all but its first block when
+// it records into a new trace.
+class CpuProfiler {
+   private:
+    struct EventBlock {
+        static const int32_t Capacity = 4096;
+
+        ProfileEvent events[Capacity];
+        std::atomic<int32_t> count{0};
+        std::atomic<EventBlock*> next{nullptr};
+    };
+
+    struct ThreadEvents {
+        uint32_t threadId = 0;
+        std::string threadName;
+        EventBlock* head = nullptr;
+        EventBlock* tail = nullptr;
+        ThreadEvents* next = nullptr;
+        // The trace the chain was last reset for.
+        uint32_t trace = 0;
+        // Set when the thread exits, its blocks are kept until the next
+        // start() so that the running trace still has its events.
+        bool exited = false;
+    };
+
+    std::atomic<bool> enabled{false};
+    std::atomic<uint32_t> trace{0};
+    std::mutex mutex;
+    ThreadEvents* threads = nullptr;
+    EventBlock* spareBlocks = nullptr;
+    uint32_t threadCount = 0;
+    int64_t traceStart = 0;
+
+    ThreadEvents* getThreadEvents();
+    EventBlock* acquireBlock();
+    void releaseBlocks(EventBlock* first);
+    void resetThreadEvents(ThreadEvents* t);
+
+    friend struct ThreadRegistration;
+    void onThreadExit(ThreadEvents* t);
+
+   public:
+    static CpuProfiler& getInstance();
+
+    // Nanoseconds on a monotonic clock.
+    static int64_t now();
+
+    CpuProfiler() {}
+    ~CpuProfiler();
+
+    // Starts a new trace. The previous one has to be written out first.
+    void start();
+    void stop();
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in the traces it records into.
+    void setThreadName(const std::string& name);
+    void record(const char* name, int64_t start, int64_t end);
+
+    // Writes the events recorded since the last start().
+    bool writeTrace(const std::string& fileName);
+};
+
+class ProfileScope {
+   private:
+    const char* name;
+    int64_t start;
+
+   public:
+    explicit ProfileScope(const char* name)
+        : name(name),
+          start(CpuProfiler::getInstance().isEnabled() ? CpuProfiler::now()
+                                                       : 0) {}
+
+    ~ProfileScope() {
+        if (start != 0) {
+            CpuProfiler::getInstance().record(name, start, CpuProfiler::now());
+        }
+    }
+};
@@ -41,15 +41,81 @@ const char* const DefaultCopyShaderSource =
     "\n"
     "layout(location=0) uniform vec2 resolution;\n"
     "layout(location=1) uniform sampler2D backbuffer;\n"
+    "layout(location=2) uniform vec2 uvScale;\n"
+    "layout(location=3) uniform vec2 uvMax;\n"
     "\n"
     "layout(location=0) out vec4 fragColor;\n"
     "\n"
     "void main(void) {\n"
-    "    vec2 uv = gl_FragCoord.xy / resolution;\n"
+    "    vec2 uv = min(gl_FragCoord.xy / resolution * uvScale, uvMax);\n"
     "    vec3 color = texture(backbuffer, uv).rgb;\n"
     "    fragColor = vec4(color, 1.0);\n"
     "}\n";
 
+// Renders the I420 planes of backbuffer into one R8 target of
+// resolution.x by resolution.y * 3 / 2, rows in readback order: Y, then U and
+// V with two chroma rows per target row. Same integer BT.601 math as
+// libyuv::ABGRToI420, flipped to top-down.
+const char* const DefaultYuvShaderSource =
+    "#version 310 es\n"
+    "precision highp float;\n"
+    "precision highp int;\n"
+    "\n"
+    "layout(location=0) uniform vec2 resolution;\n"
+    "layout(location=1) uniform sampler2D backbuffer;\n"
+    "\n"
+    "layout(location=0) out vec4 fragColor;\n"
+    "\n"
+    "ivec3 fetchRGB(ivec2 p, ivec2 size) {\n"
+    "    vec3 c = texelFetch(backbuffer, ivec2(p.x, size.y - 1 - p.y), 0).rgb;\n"
+    "    return ivec3(clamp(c, 0.0, 1.0) * 255.0 + 0.5);\n"
+    "}\n"
+    "\n"
+    "void main(void) {\n"
+    "    ivec2 size = ivec2(resolution);\n"
+    "    ivec2 p = ivec2(gl_FragCoord.xy);\n"
+    "    int value = 0;\n"
+    "\n"
+    "    if (p.y < size.y) {\n"
+    "        ivec3 c = fetchRGB(p, size);\n"
+    "        value = (66 * c.r + 129 * c.g + 25 * c.b + 0x1080) >> 8;\n"
+    "    } else {\n"
+    "        int halfWidth = size.x / 2;\n"
+    "        int quarterHeight = size.y / 4;\n"
+    "        int row = p.y - size.y;\n"
+    "        int plane = row / quarterHeight;\n"
+    "        row -= plane * quarterHeight;\n"
+    "\n"
+    "        ivec2 s = 2 * ivec2(p.x % halfWidth, row * 2 + p.x / halfWidth);\n"
+    "        ivec3 c = (fetchRGB(s, size) + fetchRGB(s + ivec2(1, 0), size) +\n"
+    "                   fetchRGB(s + ivec2(0, 1), size) +\n"
+    "                   fetchRGB(s + ivec2(1, 1), size) + 2) >> 2;\n"
+    "\n"
+    "        value = plane == 0\n"
+    "                    ? (112 * c.b - 74 * c.g - 38 * c.r + 0x8080) >> 8\n"
+    "                    : (112 * c.r - 94 * c.g - 18 * c.b + 0x8080) >> 8;\n"
+    "    }\n"
+    "\n"
+    "    fragColor = vec4(float(value) / 255.0, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Draws backbuffer scaled by weight, added into a float target while
+// sub-frames are accumulated and copied out once they are all in.
+const char* const DefaultAccumulateShaderSource =
+    "#version 310 es\n"
+    "precision highp float;\n"
+    "\n"
+    "layout(location=0) uniform vec2 resolution;\n"
+    "layout(location=1) uniform sampler2D backbuffer;\n"
+    "layout(location=2) uniform float weight;\n"
+    "\n"
+    "layout(location=0) out vec4 fragColor;\n"
+    "\n"
+    "void main(void) {\n"
+    "    vec2 uv = gl_FragCoord.xy / resolution;\n"
+    "    fragColor = texture(backbuffer, uv) * weight;\n"
+    "}\n";
+
 const char* const ShaderToyTemplate =
     "#version 310 es\n"
     "\n"
@@ -0,0 +1,69 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::reset() {
+    scale = 1.0f;
+    averageMilliseconds = 0.0f;
+    cooldown = 0;
+}
+
+void DynamicResolution::setTargetMilliseconds(float milliseconds) {
+    targetMilliseconds = std::max(milliseconds, 1.0f);
+}
+
+float DynamicResolution::getTargetMilliseconds() const {
+    return targetMilliseconds;
+}
+
+void DynamicResolution::setMinScale(float minScale) {
+    this->minScale = std::clamp(minScale, ScaleStep, 1.0f);
+    scale = std::max(scale, this->minScale);
+}
+
+float DynamicResolution::getMinScale() const { return minScale; }
+
+float DynamicResolution::getScale() const { return scale; }
+
+float DynamicResolution::getAverageMilliseconds() const {
+    return averageMilliseconds;
+}
+
+bool DynamicResolution::update(float milliseconds) {
+    if (averageMilliseconds <= 0.0f) {
+        averageMilliseconds = milliseconds;
+    } else {
+        averageMilliseconds += 0.2f * (milliseconds - averageMilliseconds);
+    }
+
+    if (cooldown > 0) {
+        cooldown--;
+        return false;
+    }
+
+    const bool overBudget = averageMilliseconds > targetMilliseconds;
+    const bool underBudget =
+        averageMilliseconds < targetMilliseconds * UpscaleThreshold;
+
+    if (!overBudget && !(underBudget && scale < 1.0f)) {
+        return false;
+    }
+
+    // The cost of the pass is roughly proportional to the pixel count.
+    const float ratio = std::sqrt(targetMilliseconds * 0.9f /
+                                  std::max(averageMilliseconds, 0.01f));
+    float newScale = scale * std::clamp(ratio, 0.5f, 1.1f);
+    newScale = std::round(newScale / ScaleStep) * ScaleStep;
+    newScale = std::clamp(newScale, minScale, 1.0f);
+
+    if (newScale == scale) {
+        return false;
+    }
+
+    averageMilliseconds *= (newScale * newScale) / (scale * scale);
+    scale = newScale;
+    cooldown = CooldownFrames;
+
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Adjusts the render scale so that the measured GPU time of the shader pass
+// converges on a target frame time.
+class DynamicResolution {
+   private:
+    // The scale goes down as soon as the frame is over budget, but only goes
+    // up again once there is a comfortable margin.
+    const float UpscaleThreshold = 0.8f;
+    const float ScaleStep = 1.0f / 32.0f;
+    const int32_t CooldownFrames = 8;
+
+    float targetMilliseconds = 16.0f;
+    float minScale = 0.25f;
+    float scale = 1.0f;
+    float averageMilliseconds = 0.0f;
+    int32_t cooldown = 0;
+
+   public:
+    void reset();
+
+    void setTargetMilliseconds(float milliseconds);
+    float getTargetMilliseconds() const;
+
+    void setMinScale(float minScale);
+    float getMinScale() const;
+
+    float getScale() const;
+    float getAverageMilliseconds() const;
+
+    // Feeds one GPU time sample, returns true if the scale has changed.
+    bool update(float milliseconds);
+};
@@ -0,0 +1,149 @@
+#include "encoder_benchmark.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+
+#include "cpu_profiler.hpp"
+#include "video_sink.hpp"
+
+namespace {
+// A moving pattern with some noise, so that the encoder has to search for
+// motion and code residuals as it would for a rendered shader.
+void fillFrame(std::vector<uint8_t>& i420, int32_t width, int32_t height,
+               int32_t frame) {
+    uint8_t* y = i420.data();
+    uint32_t seed = 0x9e3779b9u * (frame + 1);
+
+    for (int32_t j = 0; j < height; j++) {
+        for (int32_t i = 0; i < width; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            const int32_t pattern =
+                ((i + frame * 4) ^ (j + frame * 2)) + (seed >> 29);
+            y[j * width + i] = static_cast<uint8_t>(pattern);
+        }
+    }
+
+    const int32_t chromaWidth = getI420ChromaWidth(width);
+    const int32_t chromaHeight = getI420ChromaHeight(height);
+    uint8_t* u = y + width * height;
+    uint8_t* v = u + chromaWidth * chromaHeight;
+
+    for (int32_t j = 0; j < chromaHeight; j++) {
+        for (int32_t i = 0; i < chromaWidth; i++) {
+            u[j * chromaWidth + i] = static_cast<uint8_t>(128 + i - frame);
+            v[j * chromaWidth + i] = static_cast<uint8_t>(128 + j + frame);
+        }
+    }
+}
+}  // namespace
+
+void EncoderBenchmark::start(const std::vector<Size>& sizes,
+                             const WebmEncoderOptions& options, int32_t kbps,
+                             unsigned long deadline) {
+    cancel();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.clear();
+        error.clear();
+    }
+
+    cancelled = false;
+    completedRuns = 0;
+    totalRuns = static_cast<int32_t>(sizes.size()) * WebmSpeedPresetCount;
+    running = true;
+
+    worker = std::thread(&EncoderBenchmark::run, this, sizes, options, kbps,
+                         deadline);
+}
+
+void EncoderBenchmark::cancel() {
+    cancelled = true;
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool EncoderBenchmark::isRunning() const { return running; }
+
+float EncoderBenchmark::getProgress() const {
+    return totalRuns > 0 ? static_cast<float>(completedRuns) / totalRuns : 0.0f;
+}
+
+std::vector<EncoderBenchmark::Result> EncoderBenchmark::getResults() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return results;
+}
+
+std::string EncoderBenchmark::getError() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return error;
+}
+
+void EncoderBenchmark::run(std::vector<Size> sizes,
+                           WebmEncoderOptions options, int32_t kbps,
+                           unsigned long deadline) {
+    CpuProfiler::getInstance().setThreadName("encoder benchmark");
+
+    const std::string fileName = (std::filesystem::temp_directory_path() /
+                                  "shader_editor_benchmark.webm")
+                                     .string();
+
+    for (const Size& size : sizes) {
+        std::vector<uint8_t> i420(getI420FrameSize(size.width, size.height));
+
+        for (int32_t preset = 0; preset < WebmSpeedPresetCount && !cancelled;
+             preset++) {
+            PROFILE_SCOPE("EncoderBenchmark run");
+
+            options.cpuUsed = WebmSpeedPresetCpuUsed[preset];
+
+            std::unique_ptr<WebmEncoder> encoder;
+            try {
+                encoder = std::make_unique<WebmEncoder>(
+                    fileName, 1001, 30000, size.width, size.height, kbps,
+                    options);
+            } catch (const std::string& e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = e;
+                cancelled = true;
+                break;
+            }
+
+            // Only the encoder is timed, not the frame generation.
+            std::chrono::steady_clock::duration elapsed{0};
+            int32_t frame = 0;
+            for (; frame < FramesPerRun && !cancelled; frame++) {
+                fillFrame(i420, size.width, size.height, frame);
+
+                const auto t0 = std::chrono::steady_clock::now();
+                encoder->addI420Frame(i420.data(), deadline);
+                elapsed += std::chrono::steady_clock::now() - t0;
+            }
+
+            const auto t0 = std::chrono::steady_clock::now();
+            encoder->finalize(deadline);
+            elapsed += std::chrono::steady_clock::now() - t0;
+            encoder = nullptr;
+
+            const double seconds =
+                std::chrono::duration<double>(elapsed).count();
+
+            if (!cancelled) {
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(
+                    {size, preset,
+                     seconds > 0.0 ? static_cast<float>(frame / seconds)
+                                   : 0.0f});
+            }
+
+            completedRuns++;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(fileName, ec);
+
+    running = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "webm_encoder.hpp"
+
+// Measures WebM encode throughput on synthetic frames for every speed preset
+// at a list of frame sizes. Runs on its own thread so that the UI stays
+// responsive.
+class EncoderBenchmark {
+   public:
+    struct Size {
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Result {
+        Size size;
+        int32_t preset;
+        float framesPerSecond;
+    };
+
+   private:
+    static const int32_t FramesPerRun = 30;
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::atomic<bool> cancelled{false};
+    std::atomic<int32_t> completedRuns{0};
+    int32_t totalRuns = 0;
+
+    std::mutex mutex;
+    std::vector<Result> results;
+    std::string error;
+
+    void run(std::vector<Size> sizes, WebmEncoderOptions options,
+             int32_t kbps, unsigned long deadline);
+
+   public:
+    ~EncoderBenchmark() { cancel(); }
+
+    // options gives the thread and partition counts, cpuUsed is taken from
+    // each preset in turn.
+    void start(const std::vector<Size>& sizes,
+               const WebmEncoderOptions& options, int32_t kbps,
+               unsigned long deadline);
+    void cancel();
+
+    bool isRunning() const;
+    float getProgress() const;
+
+    std::vector<Result> getResults();
+    std::string getError();
+};
@@ -0,0 +1,228 @@
+#include "export_manifest.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "app_log.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+const char* const ManifestHeader = "shader_editor export manifest 1";
+
+// The rest of the line, for paths that may contain spaces.
+std::string readRest(std::istringstream& in) {
+    std::string rest;
+    std::getline(in >> std::ws, rest);
+    return rest;
+}
+}  // namespace
+
+namespace shader_editor {
+std::string ExportManifest::getPath(const std::string& exportPath) {
+    return exportPath + ".resume";
+}
+
+bool ExportManifest::save(const std::string& path) const {
+    const std::string temporaryPath = path + ".tmp";
+
+    {
+        std::ofstream out(temporaryPath, std::ios::out | std::ios::trunc);
+        if (!out) {
+            AppLog::getInstance().error("Failed to open manifest: %s\n",
+                                        temporaryPath.c_str());
+            return false;
+        }
+
+        // Floats are written with enough digits to read back the same.
+        out << std::setprecision(9);
+        out << ManifestHeader << "\n";
+        out << "shader " << shaderPath << "\n";
+        out << "shader-time " << shaderTime << "\n";
+        out << "platform " << platform << "\n";
+        out << "seconds " << seconds << "\n";
+        out << "size " << width << " " << height << "\n";
+        out << "kbps " << kbps << "\n";
+        out << "deadline " << encodeDeadline << "\n";
+        out << "webm " << webmOptions.threads << " "
+            << webmOptions.tokenPartitions << " " << webmOptions.cpuUsed
+            << " " << webmOptions.vp9 << " " << webmOptions.tileColumns << " "
+            << webmOptions.rowMultithreading << " "
+            << webmOptions.frameParallel << "\n";
+        out << "segments " << segments << "\n";
+        out << "checkpoint " << checkpointSeconds << "\n";
+        out << "tile-size " << tileSize << "\n";
+        out << "subframes " << subframes << " " << shutterAngle << "\n";
+        out << "deduplicate " << deduplicate << "\n";
+        out << "camera " << cameraPosition.x << " " << cameraPosition.y << " "
+            << cameraPosition.z << " " << cameraRotation.x << " "
+            << cameraRotation.y << "\n";
+
+        for (const RecordingOutput& output : outputs) {
+            out << "output " << output.videoType << " " << output.width << " "
+                << output.height << " " << output.kbps << " "
+                << output.fileName << "\n";
+        }
+
+        for (const ShaderUniform& u : uniforms) {
+            out << "uniform " << u.type << " " << u.name;
+            switch (u.type) {
+                case UniformType::Float:
+                    out << " " << u.value.f;
+                    break;
+                case UniformType::Integer:
+                    out << " " << u.value.i;
+                    break;
+                case UniformType::Vector2:
+                    out << " " << u.value.vec2.x << " " << u.value.vec2.y;
+                    break;
+                case UniformType::Vector3:
+                    out << " " << u.value.vec3.x << " " << u.value.vec3.y
+                        << " " << u.value.vec3.z;
+                    break;
+                case UniformType::Vector4:
+                    out << " " << u.value.vec4.x << " " << u.value.vec4.y
+                        << " " << u.value.vec4.z << " " << u.value.vec4.w;
+                    break;
+                default:
+                    break;
+            }
+            out << "\n";
+        }
+
+        out << "completed " << completedCheckpoints << "\n";
+
+        out.close();
+        if (!out) {
+            AppLog::getInstance().error("Failed to write manifest: %s\n",
+                                        temporaryPath.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporaryPath, path, error);
+    if (error) {
+        AppLog::getInstance().error("Failed to replace manifest %s: %s\n",
+                                    path.c_str(), error.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ExportManifest::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        AppLog::getInstance().error("Failed to open manifest: %s\n",
+                                    path.c_str());
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != ManifestHeader) {
+        AppLog::getInstance().error("Not an export manifest: %s\n",
+                                    path.c_str());
+        return false;
+    }
+
+    *this = ExportManifest();
+
+    int32_t lineNumber = 1;
+    while (std::getline(in, line)) {
+        lineNumber++;
+
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key)) {
+            continue;
+        }
+
+        // Unknown keys are skipped, they may come from a later version.
+        if (key == "shader") {
+            shaderPath = readRest(fields);
+        } else if (key == "shader-time") {
+            fields >> shaderTime;
+        } else if (key == "platform") {
+            fields >> platform;
+        } else if (key == "seconds") {
+            fields >> seconds;
+        } else if (key == "size") {
+            fields >> width >> height;
+        } else if (key == "kbps") {
+            fields >> kbps;
+        } else if (key == "deadline") {
+            fields >> encodeDeadline;
+        } else if (key == "webm") {
+            fields >> webmOptions.threads >> webmOptions.tokenPartitions >>
+                webmOptions.cpuUsed >> webmOptions.vp9 >>
+                webmOptions.tileColumns >> webmOptions.rowMultithreading >>
+                webmOptions.frameParallel;
+        } else if (key == "segments") {
+            fields >> segments;
+        } else if (key == "checkpoint") {
+            fields >> checkpointSeconds;
+        } else if (key == "tile-size") {
+            fields >> tileSize;
+        } else if (key == "subframes") {
+            fields >> subframes >> shutterAngle;
+        } else if (key == "deduplicate") {
+            fields >> deduplicate;
+        } else if (key == "camera") {
+            fields >> cameraPosition.x >> cameraPosition.y >>
+                cameraPosition.z >> cameraRotation.x >> cameraRotation.y;
+        } else if (key == "output") {
+            RecordingOutput output;
+            fields >> output.videoType >> output.width >> output.height >>
+                output.kbps;
+            output.fileName = readRest(fields);
+            outputs.push_back(output);
+        } else if (key == "uniform") {
+            ShaderUniform u;
+            int32_t type = 0;
+            fields >> type >> u.name;
+            u.type = static_cast<UniformType>(type);
+            switch (u.type) {
+                case UniformType::Float:
+                    fields >> u.value.f;
+                    break;
+                case UniformType::Integer:
+                    fields >> u.value.i;
+                    break;
+                case UniformType::Vector2:
+                    fields >> u.value.vec2.x >> u.value.vec2.y;
+                    break;
+                case UniformType::Vector3:
+                    fields >> u.value.vec3.x >> u.value.vec3.y >>
+                        u.value.vec3.z;
+                    break;
+                case UniformType::Vector4:
+                    fields >> u.value.vec4.x >> u.value.vec4.y >>
+                        u.value.vec4.z >> u.value.vec4.w;
+                    break;
+                default:
+                    break;
+            }
+            uniforms.push_back(u);
+        } else if (key == "completed") {
+            fields >> completedCheckpoints;
+        }
+
+        if (fields.fail()) {
+            AppLog::getInstance().error("Invalid manifest line %d: %s\n",
+                                        lineNumber, line.c_str());
+            return false;
+        }
+    }
+
+    if (shaderPath.empty() || outputs.empty() || width <= 0 ||
+        height <= 0 || seconds <= 0.0f) {
+        AppLog::getInstance().error("Incomplete manifest: %s\n",
+                                    path.c_str());
+        return false;
+    }
+
+    return true;
+}
+}  // namespace shader_editor
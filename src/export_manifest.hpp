@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "common.hpp"
+#include "recording.hpp"
+#include "shader_program.hpp"
+
+namespace shader_editor {
+// Everything needed to continue a checkpointed export after the app was
+// closed or crashed: the settings it was started with, the uniforms and
+// camera the frames are rendered with and how many checkpoints are written
+// in full. Kept as a small text file next to the export, one setting per
+// line, and rewritten after every checkpoint.
+struct ExportManifest {
+    std::string shaderPath;
+    // Modification time of the shader when the export started, a resumed
+    // export warns if it changed since.
+    int64_t shaderTime = 0;
+    int32_t platform = 0;
+
+    float seconds = 0.0f;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t kbps = 0;
+    unsigned long encodeDeadline = 0;
+    WebmEncoderOptions webmOptions;
+
+    int32_t segments = 1;
+    float checkpointSeconds = 0.0f;
+    int32_t tileSize = 0;
+    int32_t subframes = 1;
+    float shutterAngle = 180.0f;
+    bool deduplicate = true;
+
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    glm::vec2 cameraRotation = glm::vec2(0.0f);
+
+    // The export file first, then the files written from the same frames.
+    std::vector<RecordingOutput> outputs;
+    // Uniforms set in the editor, matrices and textures are not kept.
+    std::vector<ShaderUniform> uniforms;
+
+    int32_t completedCheckpoints = 0;
+
+    // The manifest of an export to exportPath.
+    static std::string getPath(const std::string& exportPath);
+
+    // Replaces the file in one step, a crash while saving leaves the
+    // previous manifest.
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
+}  // namespace shader_editor
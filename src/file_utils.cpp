@@ -25,6 +25,11 @@
 std::vector<std::string> openDir(std::string path) {
     std::vector<std::string> files;
 
+    if (path.empty()) {
+        AppLog::getInstance().error("failed to openDir.\n");
+        return files;
+    }
+
 #if defined(_MSC_VER) || defined(__MINGW32__)
     if (path.back() != '\\' && path.back() != '/') {
         path.append("\\");
@@ -0,0 +1,128 @@
+#include "frame_accumulator.hpp"
+
+#include "app_log.hpp"
+#include "default_shader.hpp"
+
+using namespace shader_editor;
+
+namespace {
+float halton(int32_t index, int32_t base) {
+    float result = 0.0f;
+    float fraction = 1.0f;
+    while (index > 0) {
+        fraction /= static_cast<float>(base);
+        result += fraction * static_cast<float>(index % base);
+        index /= base;
+    }
+    return result;
+}
+}  // namespace
+
+bool FrameAccumulator::initialize(int32_t width, int32_t height) {
+    cleanup();
+
+    this->width = width;
+    this->height = height;
+
+    program.reset(new ShaderProgram());
+    program->compile("<default-vertex-shader>", "<default-accumulate-shader>",
+                     DefaultVertexShaderSource, DefaultAccumulateShaderSource,
+                     -1, -1);
+    if (!program->isOK()) {
+        AppLog::getInstance().error(
+            "Could not compile the accumulation shader\n");
+        cleanup();
+        return false;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
+                 GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &frameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture, 0);
+
+    // WebGL needs EXT_color_buffer_float for this.
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                          GL_FRAMEBUFFER_COMPLETE;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete) {
+        AppLog::getInstance().error(
+            "Half float render targets are not available, exporting one "
+            "sample per frame\n");
+        cleanup();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameAccumulator::cleanup() {
+    if (frameBuffer != 0) {
+        glDeleteFramebuffers(1, &frameBuffer);
+        frameBuffer = 0;
+    }
+
+    if (texture != 0) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+    program = nullptr;
+    width = 0;
+    height = 0;
+}
+
+void FrameAccumulator::clear() {
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void FrameAccumulator::add(GLuint sourceTexture, float weight,
+                           GLuint vertexArray) {
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+    draw(sourceTexture, weight, vertexArray);
+    glDisable(GL_BLEND);
+}
+
+void FrameAccumulator::resolve(GLuint targetFrameBuffer, GLuint vertexArray) {
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFrameBuffer);
+    draw(texture, 1.0f, vertexArray);
+}
+
+void FrameAccumulator::draw(GLuint sourceTexture, float weight,
+                            GLuint vertexArray) {
+    glViewport(0, 0, width, height);
+    glUseProgram(program->getProgram());
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sourceTexture);
+
+    program->setUniformValue("backbuffer", 0);
+    program->setUniformValue("resolution", glm::vec2(width, height));
+    program->setUniformValue("weight", weight);
+    program->applyUniforms();
+
+    glBindVertexArray(vertexArray);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    glBindVertexArray(0);
+}
+
+glm::vec2 FrameAccumulator::getJitter(int32_t index) {
+    // Index 0 of the sequence is the corner, start at 1.
+    return glm::vec2(halton(index + 1, 2) - 0.5f,
+                     halton(index + 1, 3) - 0.5f);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.hpp"
+#include "shader_program.hpp"
+
+// Averages several renders of one export frame in a half float target, for
+// supersampling and motion blur. Each sub-frame is rendered as usual and
+// added with additive blending, the average is written back into the
+// frame's framebuffer so that it is read back and encoded once.
+class FrameAccumulator {
+   private:
+    shader_editor::PShaderProgram program = nullptr;
+    GLuint frameBuffer = 0;
+    GLuint texture = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+
+    void draw(GLuint sourceTexture, float weight, GLuint vertexArray);
+
+   public:
+    ~FrameAccumulator() { cleanup(); }
+
+    // Fails if half float targets cannot be rendered to.
+    bool initialize(int32_t width, int32_t height);
+    void cleanup();
+
+    bool isInitialized() const { return frameBuffer != 0; }
+
+    // Starts a new average.
+    void clear();
+
+    // Adds sourceTexture, the size of the target, scaled by weight.
+    void add(GLuint sourceTexture, float weight, GLuint vertexArray);
+
+    // Writes the sum into targetFrameBuffer and leaves it bound for the
+    // readback.
+    void resolve(GLuint targetFrameBuffer, GLuint vertexArray);
+
+    // Subpixel offset of sub-frame index, within half a pixel of the center.
+    // A Halton sequence, so any number of sub-frames covers the pixel
+    // evenly.
+    static glm::vec2 getJitter(int32_t index);
+};
@@ -0,0 +1,102 @@
+#include "frame_hash.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAME_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "cpu_profiler.hpp"
+
+namespace {
+const size_t StripeSize = 64;
+const int32_t LaneCount = 8;
+
+const uint64_t Prime1 = 0x9e3779b185ebca87ULL;
+const uint64_t Prime2 = 0xc2b2ae3d27d4eb4fULL;
+const uint64_t Prime3 = 0x165667b19e3779f9ULL;
+
+// Mixed into each lane before the multiply so that zero bytes still spread.
+alignas(16) const uint64_t Keys[LaneCount] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL,
+    0x1f67b3b7a4a44072ULL, 0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+    0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL};
+
+// Each 64-bit lane accumulates the product of its key-mixed halves plus the
+// neighbouring lane's input, as in XXH3.
+#ifdef FRAME_HASH_SSE2
+void accumulateStripes(uint64_t* lanes, const uint8_t* data, size_t count) {
+    __m128i acc[LaneCount / 2];
+    __m128i keys[LaneCount / 2];
+    for (int32_t i = 0; i < LaneCount / 2; i++) {
+        acc[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes) + i);
+        keys[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(Keys) + i);
+    }
+
+    for (size_t stripe = 0; stripe < count; stripe++) {
+        const __m128i* p =
+            reinterpret_cast<const __m128i*>(data + stripe * StripeSize);
+        for (int32_t i = 0; i < LaneCount / 2; i++) {
+            const __m128i value = _mm_loadu_si128(p + i);
+            const __m128i mixed = _mm_xor_si128(value, keys[i]);
+            const __m128i product = _mm_mul_epu32(
+                mixed, _mm_shuffle_epi32(mixed, _MM_SHUFFLE(2, 3, 0, 1)));
+            const __m128i swapped =
+                _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+        }
+    }
+
+    for (int32_t i = 0; i < LaneCount / 2; i++) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes) + i, acc[i]);
+    }
+}
+#else
+void accumulateStripes(uint64_t* lanes, const uint8_t* data, size_t count) {
+    for (size_t stripe = 0; stripe < count; stripe++) {
+        uint64_t values[LaneCount];
+        memcpy(values, data + stripe * StripeSize, StripeSize);
+
+        for (int32_t i = 0; i < LaneCount; i++) {
+            const uint64_t mixed = values[i] ^ Keys[i];
+            lanes[i] += (mixed & 0xffffffffULL) * (mixed >> 32) + values[i ^ 1];
+        }
+    }
+}
+#endif
+
+uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+}  // namespace
+
+uint64_t hashFrame(const uint8_t* data, size_t size) {
+    PROFILE_SCOPE("hashFrame");
+
+    uint64_t lanes[LaneCount] = {Prime1, Prime2, Prime3, Prime1,
+                                 Prime2, Prime3, Prime1, Prime2};
+
+    const size_t stripes = size / StripeSize;
+    accumulateStripes(lanes, data, stripes);
+
+    // The tail is zero padded to a whole stripe.
+    const size_t tail = size - stripes * StripeSize;
+    if (tail > 0) {
+        uint8_t last[StripeSize] = {};
+        memcpy(last, data + stripes * StripeSize, tail);
+        accumulateStripes(lanes, last, 1);
+    }
+
+    uint64_t h = static_cast<uint64_t>(size) * Prime1;
+    for (int32_t i = 0; i < LaneCount; i++) {
+        h = (h ^ avalanche(lanes[i])) * Prime1;
+    }
+    return avalanche(h);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit hash of a frame buffer, meant to tell identical frames apart from
+// changed ones at memory bandwidth. The SSE2 and the scalar version give the
+// same result. Not suitable as a cryptographic or persistent hash.
+uint64_t hashFrame(const uint8_t* data, size_t size);
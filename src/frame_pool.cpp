@@ -0,0 +1,61 @@
+#include "frame_pool.hpp"
+
+void FramePool::initialize(size_t frameSize, int32_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->frameSize = frameSize;
+    buffers.clear();
+    for (int32_t i = 0; i < count; i++) {
+        buffers.push_back(std::make_unique<uint8_t[]>(frameSize));
+    }
+}
+
+void FramePool::cleanup() {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.clear();
+    frameSize = 0;
+}
+
+bool FramePool::acquire(PooledFrame& frame) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    const bool waited = buffers.empty();
+    available.wait(lock, [this] { return !buffers.empty(); });
+
+    frame.data = std::move(buffers.back());
+    buffers.pop_back();
+    return waited;
+}
+
+bool FramePool::tryAcquire(PooledFrame& frame) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (buffers.empty()) {
+        return false;
+    }
+
+    frame.data = std::move(buffers.back());
+    buffers.pop_back();
+    return true;
+}
+
+void FramePool::release(PooledFrame& frame) {
+    if (!frame.data) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::move(frame.data));
+    }
+
+    available.notify_one();
+}
+
+SharedFrame FramePool::share(PooledFrame& frame) {
+    return SharedFrame(new PooledFrame(std::move(frame)),
+                       [this](PooledFrame* shared) {
+                           release(*shared);
+                           delete shared;
+                       });
+}
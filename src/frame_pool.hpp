@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+struct PooledFrame {
+    std::unique_ptr<uint8_t[]> data;
+    int64_t frame = 0;
+};
+
+// A frame read by several consumers at once.
+typedef std::shared_ptr<PooledFrame> SharedFrame;
+
+// A fixed number of equally sized frame buffers. acquire() blocks while all
+// of them are in use, which is what throttles the producer when a later
+// pipeline stage falls behind.
+class FramePool {
+   private:
+    std::vector<std::unique_ptr<uint8_t[]>> buffers;
+    size_t frameSize = 0;
+
+    std::mutex mutex;
+    std::condition_variable available;
+
+   public:
+    // Must not be called while buffers are handed out.
+    void initialize(size_t frameSize, int32_t count);
+    void cleanup();
+
+    size_t getFrameSize() const { return frameSize; }
+
+    // Returns true if it had to wait for a buffer.
+    bool acquire(PooledFrame& frame);
+    // Never waits, fails if all buffers are in use.
+    bool tryAcquire(PooledFrame& frame);
+    void release(PooledFrame& frame);
+
+    // Takes over frame, its buffer returns to the pool once the last copy of
+    // the result is gone. The pool must outlive every copy.
+    SharedFrame share(PooledFrame& frame);
+};
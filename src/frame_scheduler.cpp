@@ -0,0 +1,48 @@
+#include "frame_scheduler.hpp"
+
+#include <algorithm>
+
+void FrameScheduler::invalidate() { pendingFrames = SettleFrames; }
+
+void FrameScheduler::setFrameRateCap(int32_t fps) {
+    frameRateCap = std::max(fps, 0);
+    nextFrameTime = 0;
+}
+
+int32_t FrameScheduler::getFrameRateCap() const { return frameRateCap; }
+
+bool FrameScheduler::isIdle() const { return idle; }
+
+void FrameScheduler::waitEvents(bool animating, double timeout) {
+#ifdef __EMSCRIPTEN__
+    // The browser drives the main loop.
+    glfwPollEvents();
+#else
+    idle = !animating && pendingFrames <= 0;
+
+    if (pendingFrames > 0) {
+        pendingFrames--;
+    }
+
+    if (idle) {
+        nextFrameTime = 0;
+        glfwWaitEventsTimeout(timeout);
+        return;
+    }
+
+    if (frameRateCap <= 0) {
+        glfwPollEvents();
+        return;
+    }
+
+    double now = glfwGetTime();
+    const double frameTime = std::max(nextFrameTime, now);
+
+    glfwPollEvents();
+    for (now = glfwGetTime(); now < frameTime; now = glfwGetTime()) {
+        glfwWaitEventsTimeout(frameTime - now);
+    }
+
+    nextFrameTime = frameTime + 1.0 / frameRateCap;
+#endif
+}
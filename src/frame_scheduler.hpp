@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common.hpp"
+
+class FrameScheduler {
+   private:
+    // Number of frames rendered after the last input so that ImGui can settle
+    // (hover states, popups and layout lag one or two frames behind).
+    const int32_t SettleFrames = 3;
+
+    int32_t pendingFrames = SettleFrames;
+    int32_t frameRateCap = 0;
+    double nextFrameTime = 0;
+    bool idle = false;
+
+   public:
+    void invalidate();
+
+    void setFrameRateCap(int32_t fps);
+    int32_t getFrameRateCap() const;
+
+    bool isIdle() const;
+
+    // Processes pending events. If nothing is animating and no redraw has
+    // been requested, blocks until an event arrives or the timeout expires.
+    void waitEvents(bool animating, double timeout);
+};
@@ -0,0 +1,527 @@
+#include "gif_encoder.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GIF_ENCODER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "cpu_profiler.hpp"
+
+namespace {
+// Colors of one histogram bin, averaged.
+struct PaletteBin {
+    int32_t color[3];
+    uint32_t count;
+};
+
+struct PaletteBox {
+    size_t begin;
+    size_t end;
+};
+
+const int32_t KMeansIterations = 8;
+
+void setPaletteColor(GifPalette& palette, int32_t index,
+                     const std::vector<PaletteBin>& bins, size_t begin,
+                     size_t end) {
+    uint64_t sum[3] = {0, 0, 0};
+    uint64_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        for (int32_t c = 0; c < 3; c++) {
+            sum[c] += static_cast<uint64_t>(bins[i].color[c]) * bins[i].count;
+        }
+        count += bins[i].count;
+    }
+
+    for (int32_t c = 0; c < 3; c++) {
+        palette.colors[index * 3 + c] =
+            static_cast<uint8_t>((sum[c] + count / 2) / count);
+    }
+}
+
+void refinePalette(GifPalette& palette, const std::vector<PaletteBin>& bins) {
+    PROFILE_SCOPE("refinePalette");
+
+    std::vector<uint64_t> sums(palette.count * 3);
+    std::vector<uint64_t> counts(palette.count);
+
+    for (int32_t iteration = 0; iteration < KMeansIterations; iteration++) {
+        const GifColorMapper mapper(palette);
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (const PaletteBin& bin : bins) {
+            const int32_t index =
+                mapper.findNearest(bin.color[0], bin.color[1], bin.color[2]);
+            for (int32_t c = 0; c < 3; c++) {
+                sums[index * 3 + c] +=
+                    static_cast<uint64_t>(bin.color[c]) * bin.count;
+            }
+            counts[index] += bin.count;
+        }
+
+        bool changed = false;
+        for (int32_t i = 0; i < palette.count; i++) {
+            // Colors nothing maps to keep their place.
+            if (counts[i] == 0) {
+                continue;
+            }
+
+            for (int32_t c = 0; c < 3; c++) {
+                const uint8_t value = static_cast<uint8_t>(
+                    (sums[i * 3 + c] + counts[i] / 2) / counts[i]);
+                changed = changed || value != palette.colors[i * 3 + c];
+                palette.colors[i * 3 + c] = value;
+            }
+        }
+
+        if (!changed) {
+            break;
+        }
+    }
+}
+
+class GifBitWriter {
+   private:
+    std::vector<uint8_t>& bytes;
+    uint32_t bits = 0;
+    int32_t bitCount = 0;
+
+   public:
+    explicit GifBitWriter(std::vector<uint8_t>& bytes) : bytes(bytes) {}
+
+    void put(uint32_t code, int32_t size) {
+        bits |= code << bitCount;
+        bitCount += size;
+        while (bitCount >= 8) {
+            bytes.push_back(static_cast<uint8_t>(bits & 0xff));
+            bits >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    void flush() {
+        if (bitCount > 0) {
+            bytes.push_back(static_cast<uint8_t>(bits & 0xff));
+        }
+        bits = 0;
+        bitCount = 0;
+    }
+};
+
+// Variable length LZW as GIF wants it, with an open addressing table of
+// prefix and next index pairs.
+void compressLzw(const uint8_t* indices, size_t count,
+                 std::vector<uint8_t>& out) {
+    PROFILE_SCOPE("compressLzw");
+
+    const int32_t MinCodeSize = 8;
+    const uint32_t ClearCode = 1 << MinCodeSize;
+    const uint32_t EndCode = ClearCode + 1;
+    const uint32_t MaxCode = 4095;
+    const int32_t HashBits = 13;
+    const uint32_t HashMask = (1 << HashBits) - 1;
+
+    std::vector<int32_t> keys(1 << HashBits);
+    std::vector<uint16_t> codes(1 << HashBits);
+
+    std::vector<uint8_t> data;
+    data.reserve(count);
+    GifBitWriter writer(data);
+
+    int32_t codeSize = MinCodeSize + 1;
+    uint32_t nextCode = EndCode;
+    std::fill(keys.begin(), keys.end(), -1);
+    writer.put(ClearCode, codeSize);
+
+    int32_t current = -1;
+    for (size_t i = 0; i < count; i++) {
+        const int32_t value = indices[i];
+        if (current < 0) {
+            current = value;
+            continue;
+        }
+
+        const int32_t key = (current << 8) | value;
+        uint32_t slot = (static_cast<uint32_t>(key) * 2654435761u) >>
+                        (32 - HashBits);
+        while (keys[slot] != -1 && keys[slot] != key) {
+            slot = (slot + 1) & HashMask;
+        }
+
+        if (keys[slot] == key) {
+            current = codes[slot];
+            continue;
+        }
+
+        writer.put(current, codeSize);
+
+        keys[slot] = key;
+        codes[slot] = static_cast<uint16_t>(++nextCode);
+        if (nextCode >= (1u << codeSize)) {
+            codeSize++;
+        }
+
+        // The table is full, start over.
+        if (nextCode == MaxCode) {
+            writer.put(ClearCode, codeSize);
+            std::fill(keys.begin(), keys.end(), -1);
+            codeSize = MinCodeSize + 1;
+            nextCode = EndCode;
+        }
+
+        current = value;
+    }
+
+    if (current >= 0) {
+        writer.put(current, codeSize);
+
+        // The decoder defines one more code on reading the last one, and
+        // reads the Clear code wider if that fills the current width.
+        if (nextCode + 1 == (1u << codeSize) && codeSize < 12) {
+            codeSize++;
+        }
+    }
+    writer.put(ClearCode, codeSize);
+    writer.put(EndCode, MinCodeSize + 1);
+    writer.flush();
+
+    // Image data goes out in sub-blocks of at most 255 bytes.
+    out.push_back(MinCodeSize);
+    for (size_t i = 0; i < data.size(); i += 255) {
+        const size_t size = std::min<size_t>(255, data.size() - i);
+        out.push_back(static_cast<uint8_t>(size));
+        out.insert(out.end(), data.begin() + i, data.begin() + i + size);
+    }
+    out.push_back(0);
+}
+
+void putUint16(std::vector<uint8_t>& out, int32_t value) {
+    out.push_back(static_cast<uint8_t>(value & 0xff));
+    out.push_back(static_cast<uint8_t>((value >> 8) & 0xff));
+}
+
+void putPalette(std::vector<uint8_t>& out, const GifPalette& palette) {
+    // Tables always have 256 entries, the unused ones are black.
+    out.insert(out.end(), palette.colors,
+               palette.colors + GifPaletteSize * 3);
+}
+}  // namespace
+
+void GifHistogram::add(const uint8_t* rgba, size_t pixelCount) {
+    PROFILE_SCOPE("GifHistogram::add");
+
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t* pixel = rgba + i * 4;
+        const size_t bin = ((pixel[0] >> 3) << 10) | ((pixel[1] >> 3) << 5) |
+                           (pixel[2] >> 3);
+        counts[bin]++;
+        sums[bin * 3 + 0] += pixel[0];
+        sums[bin * 3 + 1] += pixel[1];
+        sums[bin * 3 + 2] += pixel[2];
+    }
+}
+
+void GifHistogram::merge(const GifHistogram& other) {
+    for (size_t i = 0; i < counts.size(); i++) {
+        counts[i] += other.counts[i];
+    }
+    for (size_t i = 0; i < sums.size(); i++) {
+        sums[i] += other.sums[i];
+    }
+}
+
+GifPalette GifHistogram::buildPalette(GifPaletteMethod method) const {
+    PROFILE_SCOPE("GifHistogram::buildPalette");
+
+    std::vector<PaletteBin> bins;
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+
+        PaletteBin bin;
+        for (int32_t c = 0; c < 3; c++) {
+            bin.color[c] = static_cast<int32_t>(
+                (sums[i * 3 + c] + counts[i] / 2) / counts[i]);
+        }
+        bin.count = counts[i];
+        bins.push_back(bin);
+    }
+
+    GifPalette palette;
+    if (bins.empty()) {
+        palette.count = 1;
+        return palette;
+    }
+
+    // Median cut: keep splitting the box with the widest color range,
+    // weighted by its pixel count, at the median of that channel.
+    std::vector<PaletteBox> boxes = {{0, bins.size()}};
+    while (boxes.size() < static_cast<size_t>(GifPaletteSize)) {
+        size_t bestBox = 0;
+        int32_t bestAxis = 0;
+        uint64_t bestScore = 0;
+
+        for (size_t i = 0; i < boxes.size(); i++) {
+            const PaletteBox& box = boxes[i];
+            if (box.end - box.begin < 2) {
+                continue;
+            }
+
+            int32_t low[3] = {255, 255, 255};
+            int32_t high[3] = {0, 0, 0};
+            uint64_t count = 0;
+            for (size_t j = box.begin; j < box.end; j++) {
+                for (int32_t c = 0; c < 3; c++) {
+                    low[c] = std::min(low[c], bins[j].color[c]);
+                    high[c] = std::max(high[c], bins[j].color[c]);
+                }
+                count += bins[j].count;
+            }
+
+            for (int32_t c = 0; c < 3; c++) {
+                const uint64_t score =
+                    static_cast<uint64_t>(high[c] - low[c]) * count;
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestBox = i;
+                    bestAxis = c;
+                }
+            }
+        }
+
+        if (bestScore == 0) {
+            break;
+        }
+
+        const PaletteBox box = boxes[bestBox];
+        std::sort(bins.begin() + box.begin, bins.begin() + box.end,
+                  [bestAxis](const PaletteBin& a, const PaletteBin& b) {
+                      return a.color[bestAxis] < b.color[bestAxis];
+                  });
+
+        uint64_t total = 0;
+        for (size_t j = box.begin; j < box.end; j++) {
+            total += bins[j].count;
+        }
+
+        size_t split = box.begin + 1;
+        uint64_t below = bins[box.begin].count;
+        while (split < box.end - 1 && below * 2 < total) {
+            below += bins[split].count;
+            split++;
+        }
+
+        boxes[bestBox] = {box.begin, split};
+        boxes.push_back({split, box.end});
+    }
+
+    palette.count = static_cast<int32_t>(boxes.size());
+    for (int32_t i = 0; i < palette.count; i++) {
+        setPaletteColor(palette, i, bins, boxes[i].begin, boxes[i].end);
+    }
+
+    if (method == GifPaletteKMeans) {
+        refinePalette(palette, bins);
+    }
+
+    return palette;
+}
+
+GifColorMapper::GifColorMapper(const GifPalette& palette) {
+    const int32_t count = std::max(palette.count, 1);
+    paddedCount = (count + 3) / 4 * 4;
+
+    // Padding repeats the first color, ties go to the lower index.
+    for (int32_t i = 0; i < paddedCount; i++) {
+        const int32_t source = i < count ? i : 0;
+        redGreen[i * 2 + 0] = palette.colors[source * 3 + 0];
+        redGreen[i * 2 + 1] = palette.colors[source * 3 + 1];
+        blueZero[i * 2 + 0] = palette.colors[source * 3 + 2];
+        blueZero[i * 2 + 1] = 0;
+    }
+}
+
+uint8_t GifColorMapper::findNearest(int32_t r, int32_t g, int32_t b) const {
+    int32_t bestDistance = std::numeric_limits<int32_t>::max();
+    int32_t bestIndex = 0;
+
+#ifdef GIF_ENCODER_SSE2
+    // Four palette entries per step, pmaddwd squares and sums the red and
+    // green differences in one go.
+    const __m128i queryRedGreen = _mm_set1_epi32((g << 16) | r);
+    const __m128i queryBlue = _mm_set1_epi32(b);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i minDistance = _mm_set1_epi32(bestDistance);
+    __m128i minIndex = _mm_setzero_si128();
+
+    for (int32_t i = 0; i < paddedCount; i += 4) {
+        const __m128i redGreenDelta = _mm_sub_epi16(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(redGreen + i * 2)),
+            queryRedGreen);
+        const __m128i blueDelta = _mm_sub_epi16(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(blueZero + i * 2)),
+            queryBlue);
+        const __m128i distance =
+            _mm_add_epi32(_mm_madd_epi16(redGreenDelta, redGreenDelta),
+                          _mm_madd_epi16(blueDelta, blueDelta));
+
+        const __m128i closer = _mm_cmplt_epi32(distance, minDistance);
+        minDistance = _mm_or_si128(_mm_and_si128(closer, distance),
+                                   _mm_andnot_si128(closer, minDistance));
+        minIndex = _mm_or_si128(_mm_and_si128(closer, index),
+                                _mm_andnot_si128(closer, minIndex));
+        index = _mm_add_epi32(index, step);
+    }
+
+    alignas(16) int32_t distances[4];
+    alignas(16) int32_t indices[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(distances), minDistance);
+    _mm_store_si128(reinterpret_cast<__m128i*>(indices), minIndex);
+
+    for (int32_t lane = 0; lane < 4; lane++) {
+        if (distances[lane] < bestDistance ||
+            (distances[lane] == bestDistance && indices[lane] < bestIndex)) {
+            bestDistance = distances[lane];
+            bestIndex = indices[lane];
+        }
+    }
+#else
+    for (int32_t i = 0; i < paddedCount; i++) {
+        const int32_t dr = redGreen[i * 2 + 0] - r;
+        const int32_t dg = redGreen[i * 2 + 1] - g;
+        const int32_t db = blueZero[i * 2 + 0] - b;
+        const int32_t distance = dr * dr + dg * dg + db * db;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            bestIndex = i;
+        }
+    }
+#endif
+
+    return static_cast<uint8_t>(bestIndex);
+}
+
+uint8_t GifColorMapper::map(int32_t r, int32_t g, int32_t b) {
+    if (cache.empty()) {
+        cache.assign(1 << 18, 0xffff);
+    }
+
+    const size_t key = ((r >> 2) << 12) | ((g >> 2) << 6) | (b >> 2);
+    if (cache[key] == 0xffff) {
+        // Searched from the middle of the cell so the result does not
+        // depend on which color of the cell came first.
+        cache[key] = findNearest((r & ~3) | 2, (g & ~3) | 2, (b & ~3) | 2);
+    }
+    return static_cast<uint8_t>(cache[key]);
+}
+
+void mapGifFrame(const uint8_t* rgba, int32_t width, int32_t height,
+                 const GifPalette& palette, bool dither, uint8_t* indices) {
+    PROFILE_SCOPE("mapGifFrame");
+
+    GifColorMapper mapper(palette);
+
+    if (!dither) {
+        const size_t pixelCount = (size_t)width * height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            const uint8_t* pixel = rgba + i * 4;
+            indices[i] = mapper.map(pixel[0], pixel[1], pixel[2]);
+        }
+        return;
+    }
+
+    // Floyd-Steinberg, errors in 1/16 with a one pixel border on each side.
+    const size_t rowSize = (size_t)(width + 2) * 3;
+    std::vector<int32_t> errors(rowSize * 2);
+
+    for (int32_t y = 0; y < height; y++) {
+        int32_t* current = errors.data() + rowSize * (y & 1);
+        int32_t* next = errors.data() + rowSize * ((y + 1) & 1);
+        std::fill(next, next + rowSize, 0);
+
+        for (int32_t x = 0; x < width; x++) {
+            const uint8_t* pixel = rgba + ((size_t)y * width + x) * 4;
+            const int32_t* error = current + (x + 1) * 3;
+
+            int32_t color[3];
+            for (int32_t c = 0; c < 3; c++) {
+                color[c] = std::min(255, std::max(0, pixel[c] + error[c] / 16));
+            }
+
+            const uint8_t index = mapper.map(color[0], color[1], color[2]);
+            indices[(size_t)y * width + x] = index;
+
+            for (int32_t c = 0; c < 3; c++) {
+                const int32_t delta = color[c] - palette.colors[index * 3 + c];
+                current[(x + 2) * 3 + c] += delta * 7;
+                next[x * 3 + c] += delta * 3;
+                next[(x + 1) * 3 + c] += delta * 5;
+                next[(x + 2) * 3 + c] += delta;
+            }
+        }
+    }
+}
+
+void writeGifHeader(int32_t width, int32_t height,
+                    const GifPalette* globalPalette,
+                    std::vector<uint8_t>& out) {
+    const char signature[] = "GIF89a";
+    out.insert(out.end(), signature, signature + 6);
+
+    putUint16(out, width);
+    putUint16(out, height);
+    // 8 bit color resolution, a 256 entry global table if there is one.
+    out.push_back(globalPalette != nullptr ? 0xf7 : 0x70);
+    out.push_back(0);  // background color
+    out.push_back(0);  // pixel aspect ratio
+
+    if (globalPalette != nullptr) {
+        putPalette(out, *globalPalette);
+    }
+
+    // Loop forever.
+    const char application[] = "NETSCAPE2.0";
+    out.push_back(0x21);
+    out.push_back(0xff);
+    out.push_back(11);
+    out.insert(out.end(), application, application + 11);
+    out.push_back(3);
+    out.push_back(1);
+    putUint16(out, 0);
+    out.push_back(0);
+}
+
+void writeGifFrame(const uint8_t* indices, int32_t width, int32_t height,
+                   const GifPalette* localPalette, int32_t delay,
+                   std::vector<uint8_t>& out) {
+    // Graphic control extension, frames are drawn over the previous one.
+    out.push_back(0x21);
+    out.push_back(0xf9);
+    out.push_back(4);
+    out.push_back(1 << 2);
+    putUint16(out, delay);
+    out.push_back(0);  // transparent color, unused
+    out.push_back(0);
+
+    // Image descriptor.
+    out.push_back(0x2c);
+    putUint16(out, 0);
+    putUint16(out, 0);
+    putUint16(out, width);
+    putUint16(out, height);
+    out.push_back(localPalette != nullptr ? 0x87 : 0x00);
+
+    if (localPalette != nullptr) {
+        putPalette(out, *localPalette);
+    }
+
+    compressLzw(indices, (size_t)width * height, out);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    GifPaletteMedianCut = 0,
+    // Median cut refined with a few k-means iterations, slower but with
+    // less banding in gradients.
+    GifPaletteKMeans = 1,
+} GifPaletteMethod;
+
+const char* const GifPaletteMethodNames[] = {"median cut", "k-means"};
+
+struct GifEncoderOptions {
+    // One palette for the whole animation, built once all frames are in.
+    // Otherwise every frame gets its own palette and is encoded as soon as
+    // it arrives.
+    bool globalPalette = true;
+    // The global palette keeps every frame until the last one is in. Once
+    // they would take more than this, the export continues with per-frame
+    // palettes instead.
+    int64_t globalPaletteMemoryLimit = 512ll * 1024 * 1024;
+    GifPaletteMethod paletteMethod = GifPaletteMedianCut;
+    // Floyd-Steinberg error diffusion.
+    bool dither = true;
+    // 0 uses one thread per hardware thread.
+    int32_t threads = 0;
+};
+
+const int32_t GifPaletteSize = 256;
+
+struct GifPalette {
+    uint8_t colors[GifPaletteSize * 3] = {};
+    int32_t count = 0;
+};
+
+// Pixel counts and color sums of RGB quantized to 5 bits per channel.
+class GifHistogram {
+   private:
+    static const int32_t BinCount = 32 * 32 * 32;
+
+    std::vector<uint32_t> counts;
+    std::vector<uint64_t> sums;
+
+   public:
+    GifHistogram() : counts(BinCount), sums(BinCount * 3) {}
+
+    // rgba is tightly packed, alpha is ignored.
+    void add(const uint8_t* rgba, size_t pixelCount);
+    void merge(const GifHistogram& other);
+
+    GifPalette buildPalette(GifPaletteMethod method) const;
+};
+
+// Nearest palette color search. Each color is searched once, the result is
+// cached at 6 bits per channel.
+class GifColorMapper {
+   private:
+    // Padded to a multiple of 4 entries, laid out for pmaddwd: red and
+    // green pairs, blue and zero pairs.
+    alignas(16) int16_t redGreen[GifPaletteSize * 2];
+    alignas(16) int16_t blueZero[GifPaletteSize * 2];
+    int32_t paddedCount = 0;
+
+    std::vector<uint16_t> cache;
+
+   public:
+    explicit GifColorMapper(const GifPalette& palette);
+
+    uint8_t findNearest(int32_t r, int32_t g, int32_t b) const;
+    uint8_t map(int32_t r, int32_t g, int32_t b);
+};
+
+// Palette indices of a top-down RGBA frame.
+void mapGifFrame(const uint8_t* rgba, int32_t width, int32_t height,
+                 const GifPalette& palette, bool dither, uint8_t* indices);
+
+// Appends the header, the global palette if given and the loop extension.
+void writeGifHeader(int32_t width, int32_t height,
+                    const GifPalette* globalPalette, std::vector<uint8_t>& out);
+
+// Appends one frame: graphic control extension, image descriptor, the local
+// palette if given and the LZW compressed indices. delay is in 1/100 s.
+void writeGifFrame(const uint8_t* indices, int32_t width, int32_t height,
+                   const GifPalette* localPalette, int32_t delay,
+                   std::vector<uint8_t>& out);
+
+const uint8_t GifTrailer = 0x3b;
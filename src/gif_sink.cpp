@@ -0,0 +1,327 @@
+#include "gif_sink.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+
+namespace {
+// Per-frame palette frames being encoded or waiting for a worker, however
+// many cores there are. Huge frames get fewer workers instead.
+const size_t InFlightFrameMemoryBudget = 512 * 1024 * 1024;
+}  // namespace
+
+int32_t GifSink::getFrameDelay(int64_t first, int64_t end) {
+    const double centiseconds = 100.0 * 1001.0 / 30000.0;
+    return static_cast<int32_t>(llround(end * centiseconds) -
+                                llround(first * centiseconds));
+}
+
+GifSink::~GifSink() { stopWorkers(); }
+
+bool GifSink::open(const std::string& fileName,
+                   const GifEncoderOptions& options) {
+    this->options = options;
+
+    if (!file.open(fileName)) {
+        last_error = "Could not open " + fileName;
+        return false;
+    }
+
+#ifdef __EMSCRIPTEN__
+    // No worker threads here, frames are encoded inline.
+    threads = 0;
+#else
+    threads = options.threads;
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Each worker holds one frame while another waits for it in the queue,
+    // one more is held until the next frame arrives.
+    const size_t frameSize = (size_t)width * height * 4;
+    const size_t budgetFrames =
+        std::max((size_t)3, InFlightFrameMemoryBudget / frameSize);
+    const int32_t budgetThreads =
+        static_cast<int32_t>((budgetFrames - 1) / 2);
+    threads = std::min(threads, budgetThreads);
+#endif
+
+    if (!options.globalPalette) {
+        std::vector<uint8_t> header;
+        writeGifHeader(width, height, nullptr, header);
+        file.write(header.data(), header.size());
+
+        framePool.initialize((size_t)width * height * 4, getPoolSize());
+        AppLog::getInstance().info(
+            "GIF: %d threads, %d frames in flight (%.0f MB)\n",
+            std::max(threads, 1), getPoolSize(),
+            (size_t)width * height * 4 * getPoolSize() / (1024.0 * 1024.0));
+    }
+
+    startWorkers();
+    return true;
+}
+
+int32_t GifSink::getPoolSize() const { return std::max(threads, 1) * 2 + 1; }
+
+void GifSink::startWorkers() {
+    jobQueue.reset(std::max(threads, 1));
+    for (int32_t i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&GifSink::runWorker, this));
+    }
+}
+
+void GifSink::stopWorkers() {
+    jobQueue.close();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void GifSink::runWorker() {
+    CpuProfiler::getInstance().setThreadName("gif");
+
+    Job job;
+    while (jobQueue.pop(job)) {
+        // Keep draining after a failure so writeFrame() never blocks.
+        if (!writeFailed) {
+            processJob(job);
+        }
+        if (job.pooled.data) {
+            framePool.release(job.pooled);
+        }
+    }
+}
+
+void GifSink::processJob(const Job& job) {
+    PROFILE_SCOPE("GifSink::processJob");
+
+    const size_t pixelCount = (size_t)width * height;
+
+    if (job.histogramOnly) {
+        GifHistogram frameHistogram;
+        frameHistogram.add(job.pixels, pixelCount);
+
+        std::lock_guard<std::mutex> lock(histogramMutex);
+        histogram.merge(frameHistogram);
+        return;
+    }
+
+    const int64_t start = CpuProfiler::now();
+
+    GifPalette localPalette;
+    if (!options.globalPalette) {
+        GifHistogram frameHistogram;
+        frameHistogram.add(job.pixels, pixelCount);
+        localPalette = frameHistogram.buildPalette(options.paletteMethod);
+    }
+    const GifPalette& palette =
+        options.globalPalette ? globalPalette : localPalette;
+
+    std::vector<uint8_t> indices(pixelCount);
+    mapGifFrame(job.pixels, width, height, palette, options.dither,
+                indices.data());
+
+    std::vector<uint8_t> bytes;
+    writeGifFrame(indices.data(), width, height,
+                  options.globalPalette ? nullptr : &localPalette,
+                  job.delay, bytes);
+
+    encodeMicroseconds += (CpuProfiler::now() - start) / 1000;
+
+    deliver(job.index, bytes);
+}
+
+void GifSink::deliver(int64_t index, std::vector<uint8_t>& bytes) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+
+    pending[index] = std::move(bytes);
+    for (auto it = pending.find(nextWrite); it != pending.end();
+         it = pending.find(nextWrite)) {
+        if (!file.write(it->second.data(), it->second.size())) {
+            last_error = "Could not write frame";
+            writeFailed = true;
+        }
+        pending.erase(it);
+        nextWrite++;
+    }
+}
+
+bool GifSink::submitJob(Job& job) {
+    if (workers.empty()) {
+        processJob(job);
+        framePool.release(job.pooled);
+        return !writeFailed;
+    }
+
+    if (!jobQueue.push(std::move(job))) {
+        framePool.release(job.pooled);
+        return false;
+    }
+    return true;
+}
+
+bool GifSink::fallBackToFramePalettes() {
+    const size_t frameBytes = (size_t)width * height * 4;
+
+    AppLog::getInstance().info(
+        "GIF: %lld frames exceed the global palette memory limit of %lld "
+        "MB, using per-frame palettes\n",
+        static_cast<long long>(frames.size() + 1),
+        static_cast<long long>(options.globalPaletteMemoryLimit >> 20));
+
+    // Let the histogram jobs finish with the kept frames.
+    stopWorkers();
+    options.globalPalette = false;
+    histogram = GifHistogram();
+
+    std::vector<uint8_t> header;
+    writeGifHeader(width, height, nullptr, header);
+    file.write(header.data(), header.size());
+
+    framePool.initialize(frameBytes, getPoolSize());
+
+    // The kept frames are encoded as they would have been on arrival, the
+    // last one is held until the next frame gives its delay.
+    const int64_t keptCount = static_cast<int64_t>(frames.size());
+    startWorkers();
+    for (int64_t i = 0; i + 1 < keptCount; i++) {
+        Job job;
+        job.index = i;
+        job.pixels = frames[i].get();
+        job.delay = getFrameDelay(frameStarts[i], frameStarts[i + 1]);
+        submitJob(job);
+    }
+    stopWorkers();
+
+    if (keptCount > 0) {
+        Job job;
+        framePool.acquire(job.pooled);
+        job.pixels = job.pooled.data.get();
+        memcpy(job.pixels, frames.back().get(), frameBytes);
+        job.index = keptCount - 1;
+        held = std::move(job);
+        heldFrame = frameStarts.back();
+        hasHeld = true;
+    }
+
+    frames.clear();
+    frameStarts.clear();
+    startWorkers();
+    return !writeFailed;
+}
+
+bool GifSink::writeFrame(const uint8_t* pixels, int64_t frame) {
+    if (writeFailed) {
+        return false;
+    }
+
+    if (options.globalPalette &&
+        static_cast<int64_t>((frames.size() + 1) * width * height * 4) >
+            options.globalPaletteMemoryLimit) {
+        if (!fallBackToFramePalettes()) {
+            return false;
+        }
+    }
+
+    endFrame = frame + 1;
+
+    Job job;
+    if (options.globalPalette) {
+        frames.push_back(std::make_unique<uint8_t[]>((size_t)width * height *
+                                                     4));
+        frameStarts.push_back(frame);
+        job.pixels = frames.back().get();
+        job.histogramOnly = true;
+    } else {
+        framePool.acquire(job.pooled);
+        job.pixels = job.pooled.data.get();
+    }
+
+    // Read back frames are bottom-up.
+    libyuv::ARGBCopy(pixels, width * 4, job.pixels, width * 4, width,
+                     -height);
+
+    if (options.globalPalette) {
+        job.index = frameCount++;
+        return submitJob(job);
+    }
+
+    bool ok = true;
+    if (hasHeld) {
+        held.delay = getFrameDelay(heldFrame, frame);
+        ok = submitJob(held);
+    }
+
+    job.index = frameCount++;
+    held = std::move(job);
+    heldFrame = frame;
+    hasHeld = true;
+    return ok;
+}
+
+bool GifSink::writeDuplicateFrame(int64_t frame) {
+    endFrame = frame + 1;
+    return !writeFailed;
+}
+
+bool GifSink::finalize() {
+    if (hasHeld) {
+        held.delay = getFrameDelay(heldFrame, endFrame);
+        submitJob(held);
+        hasHeld = false;
+    }
+
+    stopWorkers();
+
+    if (options.globalPalette && !writeFailed) {
+        const int64_t start = CpuProfiler::now();
+        globalPalette = histogram.buildPalette(options.paletteMethod);
+        AppLog::getInstance().info(
+            "GIF palette: %d colors in %.1f ms\n", globalPalette.count,
+            (CpuProfiler::now() - start) / 1000000.0);
+
+        std::vector<uint8_t> header;
+        writeGifHeader(width, height, &globalPalette, header);
+        file.write(header.data(), header.size());
+
+        // Second pass over the kept frames, now with the palette known.
+        startWorkers();
+        for (int64_t i = 0; i < frameCount; i++) {
+            Job job;
+            job.index = i;
+            job.pixels = frames[i].get();
+            job.delay = getFrameDelay(
+                frameStarts[i], i + 1 < frameCount ? frameStarts[i + 1]
+                                                   : endFrame);
+            submitJob(job);
+        }
+        stopWorkers();
+    }
+
+    frames.clear();
+    frameStarts.clear();
+    framePool.cleanup();
+
+    const uint8_t trailer = GifTrailer;
+    file.write(&trailer, 1);
+
+    const bool ok = file.close() && !writeFailed;
+    file.logStats("GIF output");
+    AppLog::getInstance().info(
+        "GIF: %lld frames, %.1f ms encoding per frame on %d threads\n",
+        static_cast<long long>(frameCount),
+        frameCount > 0 ? encodeMicroseconds / 1000.0 / frameCount : 0.0,
+        std::max(threads, 1));
+
+    if (!ok && last_error.empty()) {
+        last_error = "Could not write file";
+    }
+    return ok;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "frame_pool.hpp"
+#include "gif_encoder.hpp"
+#include "output_file.hpp"
+#include "video_sink.hpp"
+
+// Animated GIF export. Palette generation, mapping and LZW compression of
+// each frame run on a pool of worker threads, finished frames are written
+// out in order.
+//
+// With a per-frame palette every frame is encoded as soon as it arrives,
+// from a fixed pool of frame buffers. A global palette needs every frame's
+// colors first: frames are kept in memory while their histograms are
+// gathered and are only encoded once the palette is known in finalize().
+// That is bounded by GifEncoderOptions::globalPaletteMemoryLimit, past it
+// the kept frames are encoded with their own palettes and the rest of the
+// export continues per frame.
+//
+// Duplicate frames only lengthen the delay of the frame before them, which
+// is why a frame is encoded once the next one has arrived.
+class GifSink : public VideoSink {
+   private:
+    struct Job {
+        PooledFrame pooled;
+        uint8_t* pixels = nullptr;
+        int64_t index = 0;
+        int32_t delay = 0;
+        bool histogramOnly = false;
+    };
+
+    GifEncoderOptions options;
+    OutputFile file;
+
+    int32_t threads = 1;
+    FramePool framePool;
+    BoundedQueue<Job> jobQueue;
+    std::vector<std::thread> workers;
+
+    // The frame written last, its delay is known once the next one is in.
+    Job held;
+    bool hasHeld = false;
+    int64_t heldFrame = 0;
+    // One past the last frame written or repeated.
+    int64_t endFrame = 0;
+
+    // Global palette mode only.
+    std::vector<std::unique_ptr<uint8_t[]>> frames;
+    std::vector<int64_t> frameStarts;
+    GifHistogram histogram;
+    GifPalette globalPalette;
+    std::mutex histogramMutex;
+
+    // Encoded frames that wait for the ones before them.
+    std::map<int64_t, std::vector<uint8_t>> pending;
+    int64_t nextWrite = 0;
+    std::mutex writeMutex;
+
+    int64_t frameCount = 0;
+    std::atomic<bool> writeFailed{false};
+    std::atomic<int64_t> encodeMicroseconds{0};
+
+    // Frames of the per-frame palette pool, enough for every worker.
+    int32_t getPoolSize() const;
+    void startWorkers();
+    void stopWorkers();
+    void runWorker();
+    void processJob(const Job& job);
+    bool submitJob(Job& job);
+    void deliver(int64_t index, std::vector<uint8_t>& bytes);
+    bool fallBackToFramePalettes();
+
+   public:
+    GifSink(int32_t width, int32_t height) : VideoSink(width, height) {}
+    ~GifSink();
+
+    // Delay in 1/100 s of a GIF frame shown from frame first up to end.
+    // GIF delays are whole centiseconds, single frames alternate between 3
+    // and 4 to average out to 29.97 fps.
+    static int32_t getFrameDelay(int64_t first, int64_t end);
+
+    bool open(const std::string& fileName, const GifEncoderOptions& options);
+    bool acceptsRgba() const override { return true; }
+    bool writeFrame(const uint8_t* pixels, int64_t frame) override;
+    bool acceptsDuplicateFrames() const override { return true; }
+    bool writeDuplicateFrame(int64_t frame) override;
+    bool finalize() override;
+};
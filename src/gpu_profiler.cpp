@@ -0,0 +1,100 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+
+const char* GpuProfiler::getPassName(GpuPass pass) {
+    switch (pass) {
+        case GPU_PASS_SHADER:
+            return "shader";
+        case GPU_PASS_COPY:
+            return "copy";
+        case GPU_PASS_IMGUI:
+            return "imgui";
+        case GPU_PASS_READBACK:
+            return "readback";
+        default:
+            return "";
+    }
+}
+
+void GpuProfiler::initialize() {
+    for (auto i = 0; i < GPU_PASS_COUNT; i++) {
+        passes[i].timer.initialize();
+        passes[i].samples.reserve(SampleCount);
+    }
+}
+
+void GpuProfiler::cleanup() {
+    for (auto i = 0; i < GPU_PASS_COUNT; i++) {
+        passes[i].timer.cleanup();
+        passes[i].samples.clear();
+        passes[i].nextSample = 0;
+        passes[i].updated = false;
+    }
+}
+
+void GpuProfiler::begin(GpuPass pass) { passes[pass].timer.begin(); }
+
+void GpuProfiler::end(GpuPass pass) { passes[pass].timer.end(); }
+
+void GpuProfiler::collect() {
+    for (auto i = 0; i < GPU_PASS_COUNT; i++) {
+        PassSamples& p = passes[i];
+        p.updated = false;
+
+        float milliseconds = 0.0f;
+        while (p.timer.poll(milliseconds)) {
+            if (static_cast<int32_t>(p.samples.size()) < SampleCount) {
+                p.samples.push_back(milliseconds);
+            } else {
+                p.samples[p.nextSample] = milliseconds;
+            }
+
+            p.nextSample = (p.nextSample + 1) % SampleCount;
+            p.lastMilliseconds = milliseconds;
+            p.updated = true;
+        }
+    }
+}
+
+bool GpuProfiler::getNewSample(GpuPass pass, float& milliseconds) const {
+    if (!passes[pass].updated) {
+        return false;
+    }
+
+    milliseconds = passes[pass].lastMilliseconds;
+    return true;
+}
+
+float GpuProfiler::getLastMilliseconds(GpuPass pass) const {
+    return passes[pass].lastMilliseconds;
+}
+
+float GpuProfiler::getPercentile(GpuPass pass, float percentile) const {
+    std::vector<float> sorted = passes[pass].samples;
+    if (sorted.empty()) {
+        return 0.0f;
+    }
+
+    const size_t n = std::min(
+        static_cast<size_t>(percentile / 100.0f * sorted.size()),
+        sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n];
+}
+
+void GpuProfiler::getHistogram(GpuPass pass, float maxMilliseconds,
+                               std::vector<float>& buckets) const {
+    std::fill(buckets.begin(), buckets.end(), 0.0f);
+    if (buckets.empty() || maxMilliseconds <= 0.0f) {
+        return;
+    }
+
+    const auto& samples = passes[pass].samples;
+    for (auto it = samples.cbegin(); it != samples.cend(); it++) {
+        const size_t bucket = std::min(
+            static_cast<size_t>(*it / maxMilliseconds * buckets.size()),
+            buckets.size() - 1);
+        buckets[bucket] += 1.0f;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "gpu_timer.hpp"
+
+typedef enum {
+    GPU_PASS_SHADER,
+    GPU_PASS_COPY,
+    GPU_PASS_IMGUI,
+    GPU_PASS_READBACK,
+    GPU_PASS_COUNT,
+} GpuPass;
+
+// Keeps a rolling window of GPU times for each render pass. Queries are only
+// read back once they have finished, a few frames after they were issued.
+class GpuProfiler {
+   private:
+    static const int32_t SampleCount = 240;
+
+    struct PassSamples {
+        GpuTimer timer;
+        std::vector<float> samples;
+        int32_t nextSample = 0;
+        float lastMilliseconds = 0.0f;
+        bool updated = false;
+    };
+
+    PassSamples passes[GPU_PASS_COUNT];
+
+   public:
+    static const char* getPassName(GpuPass pass);
+
+    void initialize();
+    void cleanup();
+
+    void begin(GpuPass pass);
+    void end(GpuPass pass);
+
+    // Reads every finished query, call once per frame.
+    void collect();
+
+    // Returns true if the pass got a new sample in the last collect().
+    bool getNewSample(GpuPass pass, float& milliseconds) const;
+
+    float getLastMilliseconds(GpuPass pass) const;
+    float getPercentile(GpuPass pass, float percentile) const;
+
+    // Distribution of the samples in the window, bucketed between 0 and
+    // maxMilliseconds.
+    void getHistogram(GpuPass pass, float maxMilliseconds,
+                      std::vector<float>& buckets) const;
+};
@@ -0,0 +1,75 @@
+#include "gpu_timer.hpp"
+
+void GpuTimer::initialize() {
+#ifndef __EMSCRIPTEN__
+    glGenQueries(QueryCount, queries);
+#endif
+}
+
+void GpuTimer::cleanup() {
+#ifndef __EMSCRIPTEN__
+    if (queries[0] != 0) {
+        glDeleteQueries(QueryCount, queries);
+    }
+#endif
+
+    for (int32_t i = 0; i < QueryCount; i++) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+
+    writeIndex = 0;
+    readIndex = 0;
+    running = false;
+}
+
+void GpuTimer::begin() {
+#ifndef __EMSCRIPTEN__
+    // Drop the sample rather than wait when every query is still in flight.
+    if (queries[0] == 0 || pending[writeIndex]) {
+        return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[writeIndex]);
+    running = true;
+#endif
+}
+
+void GpuTimer::end() {
+#ifndef __EMSCRIPTEN__
+    if (!running) {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[writeIndex] = true;
+    writeIndex = (writeIndex + 1) % QueryCount;
+    running = false;
+#endif
+}
+
+bool GpuTimer::poll(float& milliseconds) {
+#ifndef __EMSCRIPTEN__
+    if (!pending[readIndex]) {
+        return false;
+    }
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[readIndex], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available) {
+        return false;
+    }
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[readIndex], GL_QUERY_RESULT, &elapsed);
+
+    milliseconds = static_cast<float>(elapsed / 1.0e6);
+    pending[readIndex] = false;
+    readIndex = (readIndex + 1) % QueryCount;
+
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.hpp"
+
+// Measures GPU time between begin() and end() with a small ring of
+// GL_TIME_ELAPSED queries. Results are collected a few frames later so that
+// reading them never stalls the pipeline.
+class GpuTimer {
+   private:
+    static const int32_t QueryCount = 4;
+
+    GLuint queries[QueryCount] = {0};
+    bool pending[QueryCount] = {false};
+    int32_t writeIndex = 0;
+    int32_t readIndex = 0;
+    bool running = false;
+
+   public:
+    void initialize();
+    void cleanup();
+
+    void begin();
+    void end();
+
+    // Returns true and the oldest unread result if a query has finished.
+    // Call repeatedly to drain every finished query.
+    bool poll(float& milliseconds);
+};
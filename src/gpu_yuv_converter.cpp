@@ -0,0 +1,99 @@
+#include "gpu_yuv_converter.hpp"
+
+#include "app_log.hpp"
+#include "default_shader.hpp"
+
+using namespace shader_editor;
+
+bool GpuYuvConverter::isSupported(int32_t width, int32_t height) {
+    return width > 0 && height > 0 && width % 2 == 0 && height % 4 == 0;
+}
+
+bool GpuYuvConverter::initialize(int32_t width, int32_t height) {
+    cleanup();
+
+    if (!isSupported(width, height)) {
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+
+    program.reset(new ShaderProgram());
+    program->compile("<default-vertex-shader>", "<default-yuv-shader>",
+                     DefaultVertexShaderSource, DefaultYuvShaderSource, -1,
+                     -1);
+    if (!program->isOK()) {
+        AppLog::getInstance().error("Could not compile the I420 shader\n");
+        cleanup();
+        return false;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height * 3 / 2, 0, GL_RED,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &frameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture, 0);
+
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                          GL_FRAMEBUFFER_COMPLETE;
+
+    // GLES only guarantees RGBA reads, the single channel one is optional.
+    GLint readFormat = GL_RED;
+    GLint readType = GL_UNSIGNED_BYTE;
+    if (complete) {
+        glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &readFormat);
+        glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &readType);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete || readFormat != GL_RED || readType != GL_UNSIGNED_BYTE) {
+        AppLog::getInstance().info(
+            "GPU I420 conversion is not available, converting on the CPU\n");
+        cleanup();
+        return false;
+    }
+
+    return true;
+}
+
+void GpuYuvConverter::cleanup() {
+    if (frameBuffer != 0) {
+        glDeleteFramebuffers(1, &frameBuffer);
+        frameBuffer = 0;
+    }
+
+    if (texture != 0) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+    program = nullptr;
+    width = 0;
+    height = 0;
+}
+
+void GpuYuvConverter::convert(GLuint sourceTexture, GLuint vertexArray) {
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glViewport(0, 0, width, height * 3 / 2);
+    glUseProgram(program->getProgram());
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sourceTexture);
+
+    program->setUniformValue("backbuffer", 0);
+    program->setUniformValue("resolution", glm::vec2(width, height));
+    program->applyUniforms();
+
+    glBindVertexArray(vertexArray);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.hpp"
+#include "shader_program.hpp"
+
+// Converts a rendered frame to I420 on the GPU so that export reads back 1.5
+// bytes per pixel instead of 4 and skips the CPU conversion. The planes are
+// drawn into a single R8 target whose readback is a packed I420 frame.
+class GpuYuvConverter {
+   private:
+    shader_editor::PShaderProgram program = nullptr;
+    GLuint frameBuffer = 0;
+    GLuint texture = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+
+   public:
+    ~GpuYuvConverter() { cleanup(); }
+
+    // The chroma rows are packed two per target row, so the height has to
+    // be a multiple of 4.
+    static bool isSupported(int32_t width, int32_t height);
+
+    // Fails if the size is not supported or the target cannot be read back
+    // as GL_RED.
+    bool initialize(int32_t width, int32_t height);
+    void cleanup();
+
+    // Converts sourceTexture and leaves the target bound as the framebuffer
+    // for the readback.
+    void convert(GLuint sourceTexture, GLuint vertexArray);
+};
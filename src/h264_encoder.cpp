@@ -1,6 +1,8 @@
 #include "common.hpp"
 #include "mp4muxer.h"
+#include "output_file.hpp"
 #include "app_log.hpp"
+#include "cpu_profiler.hpp"
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #include <windows.h>
@@ -13,9 +15,9 @@
 namespace {
 int WriteCallback(int64_t offset, const void* buffer, size_t size,
                   void* token) {
-    FILE* f = (FILE*)token;
-    fseek(f, static_cast<long>(offset), SEEK_SET);
-    return fwrite(buffer, 1, size, f) != size;
+    // minimp4 passes the offset of every write, appends do not seek.
+    OutputFile* file = (OutputFile*)token;
+    return !file->seek(offset) || !file->write(buffer, size);
 }
 }  // namespace
 
@@ -63,6 +65,8 @@ void Finalize(void* pOpenH264Encoder, MP4E_mux_t* pMP4Muxer,
 
 void EncodeFrame(void* pEncoder, mp4_h26x_writer_t* pWriter, uint8_t* data,
                  int32_t iPicWidth, int32_t iPicHeight, int64_t timestamp) {
+    PROFILE_SCOPE("h264encoder::EncodeFrame");
+
     int32_t rv = 0;
 
     const int32_t ySize = iPicWidth * iPicHeight;
@@ -116,7 +120,8 @@ void EncodeFrame(void* pEncoder, mp4_h26x_writer_t* pWriter, uint8_t* data,
 
 bool CreateOpenH264Encoder(void** ppEncoder, MP4E_mux_t** ppMP4Muxer,
                            mp4_h26x_writer_t** ppMP4H264Writer,
-                           int32_t iPicWidth, int32_t iPicHeight, FILE* fp) {
+                           int32_t iPicWidth, int32_t iPicHeight,
+                           OutputFile* file) {
     int rv = 0;
     rv = _WelsCreateSVCEncoder(ppEncoder);
     assert(rv == 0);
@@ -169,7 +174,7 @@ bool CreateOpenH264Encoder(void** ppEncoder, MP4E_mux_t** ppMP4Muxer,
         pEncoder, 0, &videoFormat);
     assert(rv == 0);
 
-    MP4MuxOpen(fp, WriteCallback, iPicWidth, iPicHeight, ppMP4Muxer,
+    MP4MuxOpen(file, WriteCallback, iPicWidth, iPicHeight, ppMP4Muxer,
                ppMP4H264Writer);
 
     return true;
@@ -196,7 +201,8 @@ void EncodeFrame(void* pEncoder, mp4_h26x_writer_t* pWriter, uint8_t* data,
 
 bool CreateOpenH264Encoder(void** ppEncoder, MP4E_mux_t** ppMP4Muxer,
                            mp4_h26x_writer_t** ppMP4H264Writer,
-                           int32_t iPicWidth, int32_t iPicHeight, FILE* fp) {
+                           int32_t iPicWidth, int32_t iPicHeight,
+                           OutputFile* file) {
     return false;
 }
 
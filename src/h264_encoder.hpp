@@ -1,5 +1,7 @@
 #pragma once
 
+class OutputFile;
+
 namespace h264encoder {
 bool LoadEncoderLibrary();
 void UnloadEncoderLibrary();
@@ -12,7 +14,8 @@ void Finalize(void* pOpenH264Encoder, MP4E_mux_t* pMP4Muxer,
 
 bool CreateOpenH264Encoder(void** ppEncoder, MP4E_mux_t** pMP4Muxer,
                            mp4_h26x_writer_t** pMP4H264Writer,
-                           int32_t iPicWidth, int32_t iPicHeight, FILE* fp);
+                           int32_t iPicWidth, int32_t iPicHeight,
+                           OutputFile* file);
 
 void DestroyOpenH264Encoder(void* pOpenH264Encoder);
 
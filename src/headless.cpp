@@ -0,0 +1,186 @@
+#include "headless.hpp"
+#include "app_log.hpp"
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string.h>
+
+namespace {
+GL3WglProc getProcAddress(const char* name) {
+    return reinterpret_cast<GL3WglProc>(eglGetProcAddress(name));
+}
+
+bool hasExtension(const char* extensions, const char* name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+
+    const size_t len = strlen(name);
+    for (const char* p = strstr(extensions, name); p != nullptr;
+         p = strstr(p + len, name)) {
+        if ((p == extensions || p[-1] == ' ') &&
+            (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+EGLDisplay getDisplay() {
+    const char* clientExtensions =
+        eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto eglGetPlatformDisplayEXT =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+        if (eglGetPlatformDisplayEXT != nullptr) {
+            EGLDisplay display = eglGetPlatformDisplayEXT(
+                EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+}  // namespace
+
+bool HeadlessContext::isSupported() { return true; }
+
+bool HeadlessContext::initialize() {
+    EGLDisplay eglDisplay = getDisplay();
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        AppLog::getInstance().error("EGL: no display available\n");
+        return false;
+    }
+
+    EGLint major = 0, minor = 0;
+    if (!eglInitialize(eglDisplay, &major, &minor)) {
+        AppLog::getInstance().error("EGL: eglInitialize failed (0x%X)\n",
+                                    eglGetError());
+        return false;
+    }
+    display = eglDisplay;
+
+    AppLog::getInstance().info("EGL %d.%d (%s)\n", major, minor,
+                               eglQueryString(eglDisplay, EGL_VENDOR));
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        AppLog::getInstance().error("EGL: desktop OpenGL is not supported\n");
+        cleanup();
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE,     8,               EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,    8,               EGL_ALPHA_SIZE,      8,
+        EGL_NONE,
+    };
+
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1,
+                         &numConfigs) ||
+        numConfigs == 0) {
+        AppLog::getInstance().error("EGL: no suitable config\n");
+        cleanup();
+        return false;
+    }
+
+    // Same version the window path gets from GLFW on desktop, shaders are
+    // compiled for GLSL 4.20.
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION,
+        4,
+        EGL_CONTEXT_MINOR_VERSION,
+        2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+
+    context = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT,
+                               contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        AppLog::getInstance().error("EGL: eglCreateContext failed (0x%X)\n",
+                                    eglGetError());
+        context = nullptr;
+        cleanup();
+        return false;
+    }
+
+    // Everything is rendered into framebuffer objects, so no surface is
+    // needed where surfaceless contexts are supported.
+    const char* displayExtensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    bool current = hasExtension(displayExtensions,
+                                "EGL_KHR_surfaceless_context") &&
+                   eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                                  context);
+
+    if (!current) {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1,
+                                         EGL_NONE};
+        surface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+        if (surface == EGL_NO_SURFACE) {
+            surface = nullptr;
+        } else {
+            current = eglMakeCurrent(eglDisplay, surface, surface, context);
+        }
+    }
+
+    if (!current) {
+        AppLog::getInstance().error("EGL: eglMakeCurrent failed (0x%X)\n",
+                                    eglGetError());
+        cleanup();
+        return false;
+    }
+
+    if (gl3wInit2(getProcAddress) != 0) {
+        AppLog::getInstance().error("Failed to load OpenGL functions\n");
+        cleanup();
+        return false;
+    }
+
+    AppLog::getInstance().info("OpenGL %s (%s)\n", glGetString(GL_VERSION),
+                               glGetString(GL_RENDERER));
+
+    return true;
+}
+
+void HeadlessContext::cleanup() {
+    if (display == nullptr) {
+        return;
+    }
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if (surface != nullptr) {
+        eglDestroySurface(display, surface);
+        surface = nullptr;
+    }
+
+    if (context != nullptr) {
+        eglDestroyContext(display, context);
+        context = nullptr;
+    }
+
+    eglTerminate(display);
+    display = nullptr;
+}
+#else
+bool HeadlessContext::isSupported() { return false; }
+
+bool HeadlessContext::initialize() {
+    AppLog::getInstance().error("Headless rendering requires EGL\n");
+    return false;
+}
+
+void HeadlessContext::cleanup() {}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.hpp"
+
+// Offscreen OpenGL context for machines without a display. Prefers a
+// surfaceless EGL context (Mesa, including llvmpipe) and falls back to a 1x1
+// pbuffer. Only available when built with EGL (HAVE_EGL).
+class HeadlessContext {
+   private:
+    void* display = nullptr;
+    void* context = nullptr;
+    void* surface = nullptr;
+
+   public:
+    static bool isSupported();
+
+    HeadlessContext() {}
+    ~HeadlessContext() { cleanup(); }
+
+    // Creates the context, makes it current and loads the GL entry points.
+    bool initialize();
+    void cleanup();
+};
@@ -4,7 +4,9 @@
 #include <args.hxx>
 
 #include <iostream>
+#include <sstream>
 #include <memory>
+#include <stdio.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten/bind.h>
@@ -62,6 +64,77 @@ int main(const int argc, const char** const argv) {
     args::ValueFlag<int32_t> height(parser, "height", "window height",
                                     {"height"}, 768);
 
+    args::ValueFlag<int32_t> fps(parser, "fps",
+                                 "frame rate cap (0: vsync only)", {"fps"}, 0);
+
+    args::ValueFlag<std::string> trace(
+        parser, "trace", "write a chrome trace of CPU scopes on exit",
+        {"trace"});
+
+    args::Group headlessGroup(parser, "headless export:");
+    args::Flag headless(headlessGroup, "headless",
+                        "render without a window and export a video",
+                        {"headless"});
+    args::ValueFlag<std::string> shader(headlessGroup, "shader",
+                                        "fragment shader to render",
+                                        {"shader"});
+    args::ValueFlag<std::string> exportPath(
+        headlessGroup, "export",
+        "output file (.y4m, .webm, .mp4, .png or .gif), or a stream: - for "
+        "stdout, fifo:PATH or unix:PATH",
+        {"export"});
+    args::ValueFlagList<std::string> alsoExport(
+        headlessGroup, "also-export",
+        "a further output written from the same frames, may be repeated",
+        {"also-export"});
+    args::ValueFlag<std::string> ladder(
+        headlessGroup, "ladder",
+        "heights of smaller renditions downscaled from the same frames, "
+        "e.g. 1080,720",
+        {"ladder"});
+    args::ValueFlag<float> seconds(headlessGroup, "seconds",
+                                   "length of the video", {"seconds"}, 10.0f);
+    args::ValueFlag<std::string> resolution(headlessGroup, "resolution",
+                                            "video size as WIDTHxHEIGHT",
+                                            {"resolution"}, "1920x1080");
+    args::ValueFlag<int32_t> kbps(headlessGroup, "kbps", "WebM bitrate",
+                                  {"kbps"}, 8000);
+    args::Flag rawRgba(headlessGroup, "raw-rgba",
+                       "stream raw RGBA frames instead of Y4M",
+                       {"raw-rgba"});
+    args::Flag keepDuplicates(
+        headlessGroup, "keep-duplicates",
+        "encode frames identical to the previous one in full",
+        {"keep-duplicates"});
+    args::ValueFlag<int32_t> segments(
+        headlessGroup, "segments",
+        "number of time segments encoded in parallel", {"segments"}, 1);
+    args::ValueFlag<float> checkpoint(
+        headlessGroup, "checkpoint",
+        "write the export in pieces of this many seconds that are kept if "
+        "it is interrupted, with a manifest to resume from (0: off)",
+        {"checkpoint"}, 0.0f);
+    args::ValueFlag<std::string> resume(
+        headlessGroup, "resume",
+        "continue the interrupted export of this manifest (EXPORT.resume)",
+        {"resume"});
+    args::ValueFlag<int32_t> tileSize(
+        headlessGroup, "tile-size",
+        "render frames in tiles of this size (0: only when too large)",
+        {"tile-size"}, 0);
+    args::ValueFlag<int32_t> subframes(
+        headlessGroup, "subframes",
+        "samples averaged into each frame for antialiasing and motion blur",
+        {"subframes"}, 1);
+    args::ValueFlag<float> shutter(
+        headlessGroup, "shutter",
+        "degrees of the frame interval the subframes are spread over",
+        {"shutter"}, 180.0f);
+    args::ValueFlag<std::string> platform(
+        headlessGroup, "platform",
+        "shader platform (default, glsl-sandbox, glsl-canvas, shadertoy)",
+        {"platform"}, "default");
+
     args::Positional<std::string> assetPath(parser, "asset path",
                                             "path to asset", ".");
 
@@ -95,6 +168,133 @@ int main(const int argc, const char** const argv) {
         return 1;
     }
 
+    if (fps.Get() < 0) {
+        std::cerr << "fps must be 0 or greater." << std::endl
+                  << std::endl
+                  << parser;
+        return 1;
+    }
+
+    shader_editor::HeadlessOptions options;
+
+    if (headless) {
+        if (!resume && (!shader || !exportPath)) {
+            std::cerr << "--headless requires --shader and --export, or "
+                         "--resume."
+                      << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        options.resumePath = resume.Get();
+        options.shaderPath = shader.Get();
+        options.exportPath = exportPath.Get();
+        options.extraExportPaths = alsoExport.Get();
+        options.seconds = seconds.Get();
+        options.kbps = kbps.Get();
+        options.rawRgba = rawRgba.Get();
+        options.keepDuplicates = keepDuplicates.Get();
+
+        // Chroma planes are subsampled 2x2, so both sides must be even.
+        if (sscanf(resolution.Get().c_str(), "%dx%d", &options.width,
+                   &options.height) != 2 ||
+            options.width <= 0 || options.height <= 0 ||
+            options.width % 2 != 0 || options.height % 2 != 0) {
+            std::cerr << "resolution must be WIDTHxHEIGHT with even sizes."
+                      << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        if (options.seconds <= 0.0f) {
+            std::cerr << "seconds must be greater than 0." << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        options.segments = segments.Get();
+        if (options.segments <= 0) {
+            std::cerr << "segments must be greater than 0." << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        options.checkpointSeconds = checkpoint.Get();
+        if (options.checkpointSeconds < 0.0f) {
+            std::cerr << "checkpoint must be 0 or greater." << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        options.tileSize = tileSize.Get();
+        if (options.tileSize < 0 || options.tileSize % 2 != 0) {
+            std::cerr << "tile-size must be an even size or 0." << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        if (ladder) {
+            std::stringstream heights(ladder.Get());
+            std::string item;
+            while (std::getline(heights, item, ',')) {
+                int32_t rungHeight = 0;
+                if (sscanf(item.c_str(), "%d", &rungHeight) != 1 ||
+                    rungHeight <= 0 || rungHeight % 2 != 0 ||
+                    rungHeight >= options.height) {
+                    std::cerr << "ladder must be even heights below the "
+                                 "resolution's."
+                              << std::endl
+                              << std::endl
+                              << parser;
+                    return 1;
+                }
+                options.ladderHeights.push_back(rungHeight);
+            }
+        }
+
+        options.subframes = subframes.Get();
+        options.shutterAngle = shutter.Get();
+        if (options.subframes <= 0) {
+            std::cerr << "subframes must be greater than 0." << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        if (options.shutterAngle < 0.0f || options.shutterAngle > 360.0f) {
+            std::cerr << "shutter must be between 0 and 360." << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+
+        const auto platformCount =
+            IM_ARRAYSIZE(shader_editor::AppShaderPlatformNames);
+
+        bool platformFound = false;
+        for (auto i = 0; i < platformCount; i++) {
+            if (platform.Get().compare(
+                    shader_editor::AppShaderPlatformNames[i]) == 0) {
+                options.platform =
+                    static_cast<shader_editor::AppShaderPlatform>(i);
+                platformFound = true;
+            }
+        }
+
+        if (!platformFound) {
+            std::cerr << "unknown platform: " << platform.Get() << std::endl
+                      << std::endl
+                      << parser;
+            return 1;
+        }
+    }
+
     if (log.Get().compare("detail") == 0) {
         AppLog::getInstance().setLogLevel(AppLogLevel::Detail);
     }
@@ -108,7 +308,22 @@ int main(const int argc, const char** const argv) {
         AppLog::getInstance().setLogLevel(AppLogLevel::Error);
     }
 
+#ifndef __EMSCRIPTEN__
+    if (headless) {
+        if (trace) {
+            app.startCpuTrace(trace.Get());
+        }
+
+        return app.runHeadless(options);
+    }
+#endif
+
     app.start(width.Get(), height.Get(), assetPath.Get(), top.Get());
+    app.setFrameRateCap(fps.Get());
+
+    if (trace) {
+        app.startCpuTrace(trace.Get());
+    }
 
 #ifdef __EMSCRIPTEN__
     ImGui::GetIO().SetClipboardTextFn = SetClipboardTextImpl;
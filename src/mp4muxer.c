@@ -1,9 +1,11 @@
 #define MINIMP4_IMPLEMENTATION
 #include "mp4muxer.h"
 
-void MP4MuxOpen(FILE* fp, write_callback callback, int32_t width,
+#include <string.h>
+
+void MP4MuxOpen(void* token, write_callback callback, int32_t width,
                 int32_t height, MP4E_mux_t** mux, mp4_h26x_writer_t** mp4wr) {
-    *mux = MP4E_open(0, 0, fp, callback);
+    *mux = MP4E_open(0, 0, token, callback);
     *mp4wr = malloc(sizeof(mp4_h26x_writer_t));
     mp4_h26x_write_init(*mp4wr, *mux, width, height, 0);
 }
@@ -16,3 +18,126 @@ void MP4MuxClose(MP4E_mux_t* mux, mp4_h26x_writer_t* mp4wr) {
 void MP4MuxWrite(mp4_h26x_writer_t* mp4wr, const uint8_t* nal, int32_t length) {
     mp4_h26x_write_nal(mp4wr, nal, length, 90000 * 1001 / 30000);
 }
+
+static int MP4MuxWriteFile(int64_t offset, const void* buffer, size_t size,
+                           void* token) {
+    FILE* fp = (FILE*)token;
+    fseek(fp, (long)offset, SEEK_SET);
+    return fwrite(buffer, 1, size, fp) != size;
+}
+
+static int MP4MuxReadFile(int64_t offset, void* buffer, size_t size,
+                          void* token) {
+    FILE* fp = (FILE*)token;
+    fseek(fp, (long)offset, SEEK_SET);
+    return fread(buffer, 1, size, fp) != size;
+}
+
+static uint8_t* MP4MuxReserve(uint8_t** buffer, size_t* capacity,
+                              size_t size) {
+    if (size > *capacity) {
+        uint8_t* grown = realloc(*buffer, size);
+        if (grown == NULL) {
+            return NULL;
+        }
+        *buffer = grown;
+        *capacity = size;
+    }
+    return *buffer;
+}
+
+static int MP4MuxWriteParameterSet(mp4_h26x_writer_t* mp4wr, const void* nal,
+                                   int bytes, uint8_t** buffer,
+                                   size_t* capacity) {
+    if (!MP4MuxReserve(buffer, capacity, bytes + 4)) {
+        return 0;
+    }
+
+    memcpy(*buffer, "\0\0\0\1", 4);
+    memcpy(*buffer + 4, nal, bytes);
+    MP4MuxWrite(mp4wr, *buffer, bytes + 4);
+    return 1;
+}
+
+int MP4MuxJoin(FILE* fp, FILE* const* parts, int32_t count, int32_t width,
+               int32_t height) {
+    MP4E_mux_t* mux = NULL;
+    mp4_h26x_writer_t* mp4wr = NULL;
+    uint8_t* buffer = NULL;
+    size_t capacity = 0;
+    int ok = 1;
+    int32_t i;
+
+    MP4MuxOpen(fp, MP4MuxWriteFile, width, height, &mux, &mp4wr);
+
+    for (i = 0; i < count && ok; i++) {
+        MP4D_demux_t mp4;
+        int32_t set;
+        unsigned sample;
+        long size;
+
+        fseek(parts[i], 0, SEEK_END);
+        size = ftell(parts[i]);
+        if (!MP4D_open(&mp4, MP4MuxReadFile, parts[i], size) ||
+            mp4.track_count == 0) {
+            ok = 0;
+            break;
+        }
+
+        // The parameter sets are stored in the sample description, not in
+        // the samples. Repeated ones are ignored by the writer.
+        for (set = 0; ok; set++) {
+            int bytes = 0;
+            const void* sps = MP4D_read_sps(&mp4, 0, set, &bytes);
+            if (sps == NULL) {
+                break;
+            }
+            ok = MP4MuxWriteParameterSet(mp4wr, sps, bytes, &buffer,
+                                         &capacity);
+        }
+
+        for (set = 0; ok; set++) {
+            int bytes = 0;
+            const void* pps = MP4D_read_pps(&mp4, 0, set, &bytes);
+            if (pps == NULL) {
+                break;
+            }
+            ok = MP4MuxWriteParameterSet(mp4wr, pps, bytes, &buffer,
+                                         &capacity);
+        }
+
+        for (sample = 0; ok && sample < mp4.track[0].sample_count; sample++) {
+            unsigned bytes = 0;
+            unsigned timestamp = 0;
+            unsigned duration = 0;
+            unsigned pos = 0;
+            MP4D_file_offset_t offset = MP4D_frame_offset(
+                &mp4, 0, sample, &bytes, &timestamp, &duration);
+
+            if (!MP4MuxReserve(&buffer, &capacity, bytes) ||
+                MP4MuxReadFile(offset, buffer, bytes, parts[i])) {
+                ok = 0;
+                break;
+            }
+
+            // Samples hold length prefixed NAL units, the writer expects
+            // start codes.
+            while (pos + 4 <= bytes) {
+                const uint32_t length =
+                    ((uint32_t)buffer[pos] << 24) |
+                    ((uint32_t)buffer[pos + 1] << 16) |
+                    ((uint32_t)buffer[pos + 2] << 8) | buffer[pos + 3];
+                memcpy(buffer + pos, "\0\0\0\1", 4);
+                pos += 4 + length;
+            }
+
+            MP4MuxWrite(mp4wr, buffer, bytes);
+        }
+
+        MP4D_close(&mp4);
+    }
+
+    free(buffer);
+    MP4MuxClose(mux, mp4wr);
+    return ok;
+}
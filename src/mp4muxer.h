@@ -16,13 +16,18 @@ typedef int (*write_callback)(int64_t, const void* buffer, size_t size,
 #ifdef __cplusplus
 extern "C" {
 #endif
-void MP4MuxOpen(FILE* fp, write_callback callback, int32_t width,
+void MP4MuxOpen(void* token, write_callback callback, int32_t width,
                 int32_t height, MP4E_mux_t** mux, mp4_h26x_writer_t** mp4wr);
 
 void MP4MuxClose(MP4E_mux_t* mux, mp4_h26x_writer_t* mp4wr);
 
 void MP4MuxWrite(mp4_h26x_writer_t* mp4wr, const uint8_t* nal, int32_t length);
 
+// Writes the H.264 tracks of the MP4 files in parts, in order, as one track
+// into fp. Returns 0 if a part could not be read.
+int MP4MuxJoin(FILE* fp, FILE* const* parts, int32_t count, int32_t width,
+               int32_t height);
+
 #ifdef __cplusplus
 }
 #endif
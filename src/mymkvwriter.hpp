@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "mkvmuxer.hpp"
+#include "output_file.hpp"
 
 class MyMkvWriter : public mkvmuxer::IMkvWriter {
    public:
@@ -18,10 +19,11 @@ class MyMkvWriter : public mkvmuxer::IMkvWriter {
     virtual mkvmuxer::int32 Write(const void* buffer, mkvmuxer::uint32 length);
     virtual void ElementStartNotify(mkvmuxer::uint64 element_id, mkvmuxer::int64 position);
 
-    void Notify();
+    bool IsOpen() const;
+    bool Preallocate(mkvmuxer::int64 size);
+    const OutputFile& GetFile() const;
+    bool Notify();
 
    private:
-    FILE* fp;
-    mkvmuxer::uint64 pos;
-    mkvmuxer::uint64 len;
+    OutputFile file;
 };
@@ -0,0 +1,182 @@
+#include "output_file.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#endif
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+
+namespace {
+int seekFile(FILE* fp, int64_t offset) {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    return _fseeki64(fp, offset, SEEK_SET);
+#else
+    return fseeko(fp, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+}  // namespace
+
+bool OutputFile::open(const std::string& fileName, size_t bufferSize) {
+    close();
+
+    fp = fopen(fileName.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    // The buffer below replaces the stdio one.
+    setvbuf(fp, nullptr, _IONBF, 0);
+
+    this->bufferSize = bufferSize;
+    buffer = std::make_unique<uint8_t[]>(bufferSize);
+    buffered = 0;
+    cursor = 0;
+    bufferStart = 0;
+    filePosition = 0;
+    failed = false;
+
+    bytesWritten = 0;
+    flushCount = 0;
+    seekCount = 0;
+    patchCount = 0;
+    writeMilliseconds = 0;
+    return true;
+}
+
+bool OutputFile::preallocate(int64_t size) {
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+    // Keeping the size means nothing needs truncating if less is written.
+    return fp != nullptr && size > 0 &&
+           fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0,
+                     static_cast<off_t>(size)) == 0;
+#else
+    return false;
+#endif
+}
+
+bool OutputFile::writeAt(int64_t offset, const void* data, size_t size) {
+    PROFILE_SCOPE("OutputFile::writeAt");
+
+    const auto t0 = std::chrono::steady_clock::now();
+
+    if (offset != filePosition) {
+        seekCount++;
+        if (seekFile(fp, offset) != 0) {
+            failed = true;
+        }
+    }
+
+    if (!failed && fwrite(data, 1, size, fp) != size) {
+        failed = true;
+    }
+
+    filePosition = offset + static_cast<int64_t>(size);
+    bytesWritten += static_cast<int64_t>(size);
+    flushCount++;
+
+    writeMilliseconds += std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - t0)
+                             .count();
+    return !failed;
+}
+
+bool OutputFile::write(const void* data, size_t size) {
+    if (fp == nullptr || failed) {
+        return false;
+    }
+
+    if (cursor + size > bufferSize) {
+        if (!flush()) {
+            return false;
+        }
+
+        // Chunks larger than the buffer gain nothing from the copy.
+        if (size >= bufferSize) {
+            const bool ok = writeAt(bufferStart, data, size);
+            bufferStart += static_cast<int64_t>(size);
+            return ok;
+        }
+    }
+
+    memcpy(buffer.get() + cursor, data, size);
+    cursor += size;
+    buffered = std::max(buffered, cursor);
+    return true;
+}
+
+bool OutputFile::seek(int64_t position) {
+    if (fp == nullptr || failed) {
+        return false;
+    }
+
+    if (position == this->position()) {
+        return true;
+    }
+
+    // Patches of data that is still buffered are applied in memory.
+    if (position >= bufferStart &&
+        position <= bufferStart + static_cast<int64_t>(buffered)) {
+        cursor = static_cast<size_t>(position - bufferStart);
+        patchCount++;
+        return true;
+    }
+
+    if (!flush()) {
+        return false;
+    }
+
+    bufferStart = position;
+    return true;
+}
+
+bool OutputFile::flush() {
+    if (fp == nullptr || failed) {
+        return false;
+    }
+
+    if (buffered > 0 && !writeAt(bufferStart, buffer.get(), buffered)) {
+        return false;
+    }
+
+    bufferStart += static_cast<int64_t>(cursor);
+    buffered = 0;
+    cursor = 0;
+    return true;
+}
+
+bool OutputFile::close() {
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = flush();
+
+    const auto t0 = std::chrono::steady_clock::now();
+    ok = fclose(fp) == 0 && ok;
+    writeMilliseconds += std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - t0)
+                             .count();
+
+    fp = nullptr;
+    buffer.reset();
+    bufferSize = 0;
+    return ok;
+}
+
+void OutputFile::logStats(const std::string& label) const {
+    const double megabytes = bytesWritten / (1024.0 * 1024.0);
+    const double seconds = writeMilliseconds / 1000.0;
+
+    AppLog::getInstance().info(
+        "%s: wrote %.1f MB in %.1f ms (%.1f MB/s), %lld writes, %lld seeks, "
+        "%lld buffered patches\n",
+        label.c_str(), megabytes, writeMilliseconds,
+        seconds > 0.0 ? megabytes / seconds : 0.0,
+        static_cast<long long>(flushCount), static_cast<long long>(seekCount),
+        static_cast<long long>(patchCount));
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Write-behind buffered output shared by the video writers. Sequential
+// appends are copied into one large buffer and written out in big chunks.
+// Seeking back into the buffered range, as the muxers do to patch element
+// sizes, only moves the cursor. The file itself is only seeked for patches
+// of data that was already written out.
+class OutputFile {
+   private:
+    FILE* fp = nullptr;
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t bufferSize = 0;
+    // Bytes in the buffer and the write cursor within them, the buffer
+    // starts at bufferStart in the file.
+    size_t buffered = 0;
+    size_t cursor = 0;
+    int64_t bufferStart = 0;
+    // Where fp currently points, to skip redundant seeks.
+    int64_t filePosition = 0;
+    bool failed = false;
+
+    int64_t bytesWritten = 0;
+    int64_t flushCount = 0;
+    int64_t seekCount = 0;
+    int64_t patchCount = 0;
+    double writeMilliseconds = 0;
+
+    bool writeAt(int64_t offset, const void* data, size_t size);
+
+   public:
+    static const size_t DefaultBufferSize = 4 * 1024 * 1024;
+
+    OutputFile() {}
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile() { close(); }
+
+    bool open(const std::string& fileName,
+              size_t bufferSize = DefaultBufferSize);
+    bool isOpen() const { return fp != nullptr; }
+
+    // Reserves disk space for the expected size up front so the file system
+    // does not extend the file on every flush. Only a hint, it does nothing
+    // where fallocate is not available.
+    bool preallocate(int64_t size);
+
+    bool write(const void* data, size_t size);
+    bool seek(int64_t position);
+    int64_t position() const { return bufferStart + cursor; }
+    bool flush();
+    bool close();
+
+    int64_t getBytesWritten() const { return bytesWritten; }
+    int64_t getFlushCount() const { return flushCount; }
+    int64_t getSeekCount() const { return seekCount; }
+    int64_t getPatchCount() const { return patchCount; }
+    double getWriteMilliseconds() const { return writeMilliseconds; }
+
+    void logStats(const std::string& label) const;
+};
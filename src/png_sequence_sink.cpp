@@ -0,0 +1,154 @@
+#include "png_sequence_sink.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <stb_image_write.h>
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Frames being compressed or waiting for a worker, however many cores there
+// are. Huge frames get fewer workers instead.
+const size_t InFlightFrameMemoryBudget = 512 * 1024 * 1024;
+}  // namespace
+
+std::string PngSequenceSink::getFrameFileName(const std::string& fileName,
+                                              int64_t frame) {
+    char number[32];
+    snprintf(number, sizeof(number), "_%06lld",
+             static_cast<long long>(frame));
+
+    const fs::path path(fileName);
+    return (path.parent_path() / (path.stem().string() + number + ".png"))
+        .string();
+}
+
+PngSequenceSink::~PngSequenceSink() { stopWorkers(); }
+
+bool PngSequenceSink::open(const std::string& fileName, int32_t threads) {
+    this->fileName = fileName;
+
+    const size_t frameSize = (size_t)width * height * 4;
+
+#ifdef __EMSCRIPTEN__
+    // No worker threads here, frames are compressed inline.
+    threads = 0;
+    int32_t frameCount = 1;
+#else
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Each worker holds one frame while another waits for it in the queue.
+    const int32_t budgetThreads = static_cast<int32_t>(
+        std::max((size_t)1, InFlightFrameMemoryBudget / frameSize / 2));
+    threads = std::min(threads, budgetThreads);
+    int32_t frameCount = threads * 2;
+#endif
+
+    framePool.initialize(frameSize, frameCount);
+    if (threads > 0) {
+        frameQueue.reset(threads);
+    }
+    for (int32_t i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&PngSequenceSink::runWorker, this));
+    }
+
+    AppLog::getInstance().info(
+        "Writing PNG frames to %s with %d threads, %d frames in flight "
+        "(%.0f MB)\n",
+        getFrameFileName(fileName, 0).c_str(), std::max(threads, 1),
+        frameCount, frameSize * frameCount / (1024.0 * 1024.0));
+    return true;
+}
+
+bool PngSequenceSink::writePng(const PooledFrame& frame) {
+    PROFILE_SCOPE("PngSequenceSink::writePng");
+
+    const int64_t start = CpuProfiler::now();
+    const std::string frameFileName = getFrameFileName(fileName, frame.frame);
+    const bool ok = stbi_write_png(frameFileName.c_str(), width, height, 4,
+                                   frame.data.get(), width * 4) != 0;
+    compressMicroseconds += (CpuProfiler::now() - start) / 1000;
+
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        last_error = "Could not write " + frameFileName;
+        writeFailed = true;
+        return false;
+    }
+
+    std::error_code ec;
+    const auto size = fs::file_size(frameFileName, ec);
+    if (!ec) {
+        bytesWritten += static_cast<int64_t>(size);
+    }
+    return true;
+}
+
+void PngSequenceSink::runWorker() {
+    CpuProfiler::getInstance().setThreadName("png");
+
+    PooledFrame frame;
+    while (frameQueue.pop(frame)) {
+        // Keep draining after a failure so writeFrame() never blocks.
+        if (!writeFailed) {
+            writePng(frame);
+        }
+        framePool.release(frame);
+    }
+}
+
+void PngSequenceSink::stopWorkers() {
+    frameQueue.close();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+bool PngSequenceSink::writeFrame(const uint8_t* pixels, int64_t frame) {
+    if (writeFailed) {
+        return false;
+    }
+
+    PooledFrame item;
+    item.frame = frame;
+    framePool.acquire(item);
+
+    // Read back frames are bottom-up.
+    libyuv::ARGBCopy(pixels, width * 4, item.data.get(), width * 4, width,
+                     -height);
+    frameCount++;
+
+    if (workers.empty()) {
+        const bool ok = writePng(item);
+        framePool.release(item);
+        return ok;
+    }
+
+    if (!frameQueue.push(std::move(item))) {
+        framePool.release(item);
+        return false;
+    }
+    return true;
+}
+
+bool PngSequenceSink::finalize() {
+    stopWorkers();
+    framePool.cleanup();
+
+    const double megabytes = bytesWritten / (1024.0 * 1024.0);
+    AppLog::getInstance().info(
+        "Wrote %lld PNG frames, %.1f MB, %.1f ms compressing on average\n",
+        static_cast<long long>(frameCount), megabytes,
+        frameCount > 0 ? compressMicroseconds / 1000.0 / frameCount : 0.0);
+
+    return !writeFailed;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "frame_pool.hpp"
+#include "video_sink.hpp"
+
+// Writes every frame as a numbered, lossless PNG next to fileName:
+// "frames.png" becomes frames_000000.png, frames_000001.png and so on.
+//
+// Deflate is far slower than reading the frames back, so frames are
+// compressed on a pool of worker threads. The frame buffers come from a
+// fixed pool, writeFrame() blocks once all of them are in flight, which
+// keeps memory flat however long the export is. The pool and the number of
+// workers are limited by a memory budget rather than the core count.
+class PngSequenceSink : public VideoSink {
+   private:
+    std::string fileName;
+
+    FramePool framePool;
+    BoundedQueue<PooledFrame> frameQueue;
+    std::vector<std::thread> workers;
+
+    std::mutex errorMutex;
+    std::atomic<bool> writeFailed{false};
+    std::atomic<int64_t> bytesWritten{0};
+    std::atomic<int64_t> compressMicroseconds{0};
+    int64_t frameCount = 0;
+
+    bool writePng(const PooledFrame& frame);
+    void runWorker();
+    void stopWorkers();
+
+   public:
+    PngSequenceSink(int32_t width, int32_t height)
+        : VideoSink(width, height) {}
+    ~PngSequenceSink();
+
+    static std::string getFrameFileName(const std::string& fileName,
+                                        int64_t frame);
+
+    // threads 0 uses one thread per hardware thread.
+    bool open(const std::string& fileName, int32_t threads = 0);
+    bool acceptsRgba() const override { return true; }
+    bool writeFrame(const uint8_t* pixels, int64_t frame) override;
+    bool finalize() override;
+};
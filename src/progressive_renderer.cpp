@@ -0,0 +1,109 @@
+#include "progressive_renderer.hpp"
+
+#include <algorithm>
+
+void ProgressiveRenderer::initialize() { timer.initialize(); }
+
+void ProgressiveRenderer::cleanup() {
+    timer.cleanup();
+    cancel();
+}
+
+void ProgressiveRenderer::setTileSize(GLint tileSize) {
+    if (this->tileSize == tileSize) {
+        return;
+    }
+
+    this->tileSize = std::max(tileSize, 16);
+    tileMilliseconds = 0.0f;
+    cancel();
+}
+
+GLint ProgressiveRenderer::getTileSize() const { return tileSize; }
+
+void ProgressiveRenderer::setBudgetMilliseconds(float milliseconds) {
+    budgetMilliseconds = std::max(milliseconds, 1.0f);
+}
+
+float ProgressiveRenderer::getBudgetMilliseconds() const {
+    return budgetMilliseconds;
+}
+
+float ProgressiveRenderer::getTileMilliseconds() const {
+    return tileMilliseconds;
+}
+
+void ProgressiveRenderer::start(GLint width, GLint height) {
+    this->width = width;
+    this->height = height;
+    columns = (width + tileSize - 1) / tileSize;
+    rows = (height + tileSize - 1) / tileSize;
+    nextTile = 0;
+    active = columns * rows > 0;
+}
+
+void ProgressiveRenderer::cancel() {
+    nextTile = 0;
+    active = false;
+}
+
+bool ProgressiveRenderer::isActive() const { return active; }
+
+int32_t ProgressiveRenderer::getTileCount() const { return columns * rows; }
+
+int32_t ProgressiveRenderer::getCompletedTiles() const { return nextTile; }
+
+int32_t ProgressiveRenderer::getTilesPerUpdate() {
+    float milliseconds = 0.0f;
+    while (timer.poll(milliseconds)) {
+        tileMilliseconds = tileMilliseconds > 0.0f
+                               ? tileMilliseconds * 0.8f + milliseconds * 0.2f
+                               : milliseconds;
+    }
+
+    // Without a measurement (or without timer queries at all) one tile per
+    // update is the only safe choice.
+    int32_t tiles = 1;
+    if (tileMilliseconds > 0.0f) {
+        tiles = std::max(
+            static_cast<int32_t>(budgetMilliseconds / tileMilliseconds), 1);
+    }
+
+    return std::min(tiles, getTileCount() - nextTile);
+}
+
+void ProgressiveRenderer::beginTile() {
+    const GLint x = (nextTile % columns) * tileSize;
+    const GLint y = (nextTile / columns) * tileSize;
+    const GLint w = std::min(tileSize, width - x);
+    const GLint h = std::min(tileSize, height - y);
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, y, w, h);
+
+    // Only full-size tiles are timed so that samples are comparable.
+    timing = w == tileSize && h == tileSize;
+    if (timing) {
+        timer.begin();
+    }
+}
+
+bool ProgressiveRenderer::endTile() {
+    if (timing) {
+        timer.end();
+        timing = false;
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+
+    // Hand each tile to the GPU right away instead of queueing the whole
+    // batch, which keeps single submissions short.
+    glFlush();
+
+    nextTile++;
+    if (nextTile >= getTileCount()) {
+        active = false;
+    }
+
+    return !active;
+}
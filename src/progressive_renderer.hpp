@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.hpp"
+#include "gpu_timer.hpp"
+
+// Splits a frame into scissored tiles drawn in raster order over several
+// updates, so that a heavy shader only takes a bounded amount of GPU time per
+// update.
+class ProgressiveRenderer {
+   private:
+    GpuTimer timer;
+
+    GLint tileSize = 128;
+    float budgetMilliseconds = 8.0f;
+
+    // Smoothed GPU time of one full-size tile, 0 until the first sample.
+    float tileMilliseconds = 0.0f;
+
+    GLint width = 0;
+    GLint height = 0;
+    int32_t columns = 0;
+    int32_t rows = 0;
+    int32_t nextTile = 0;
+    bool active = false;
+    bool timing = false;
+
+   public:
+    void initialize();
+    void cleanup();
+
+    void setTileSize(GLint tileSize);
+    GLint getTileSize() const;
+
+    void setBudgetMilliseconds(float milliseconds);
+    float getBudgetMilliseconds() const;
+
+    float getTileMilliseconds() const;
+
+    // Starts a new frame covering width x height pixels.
+    void start(GLint width, GLint height);
+    void cancel();
+
+    bool isActive() const;
+    int32_t getTileCount() const;
+    int32_t getCompletedTiles() const;
+
+    // Returns how many tiles fit into the budget for this update.
+    int32_t getTilesPerUpdate();
+
+    // Scissors to the next tile; the caller draws the full-screen quad.
+    void beginTile();
+
+    // Submits the tile, returns true once the last tile of the frame is done.
+    bool endTile();
+};
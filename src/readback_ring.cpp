@@ -0,0 +1,243 @@
+#include "readback_ring.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+
+bool ReadbackRing::isBufferStorageSupported() {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* name =
+            reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name != nullptr && strcmp(name, "GL_ARB_buffer_storage") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+#endif
+}
+
+void ReadbackRing::initialize(int32_t width, int32_t height, int32_t depth,
+                              GLenum format) {
+    cleanup();
+
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    persistent = isBufferStorageSupported();
+    slots.resize(std::max(depth, 2));
+
+    const GLsizeiptr size = static_cast<GLsizeiptr>(getFrameSize());
+
+    for (auto& slot : slots) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+#ifndef __EMSCRIPTEN__
+        if (persistent) {
+            // Coherent, so that no extra barrier is needed between the read
+            // and the fence.
+            const GLbitfield flags =
+                GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags);
+            slot.mapped = static_cast<const uint8_t*>(
+                glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags));
+            continue;
+        }
+#endif
+
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+#ifdef __EMSCRIPTEN__
+    staging.resize(static_cast<size_t>(size));
+#endif
+}
+
+void ReadbackRing::cleanup() {
+    for (auto& slot : slots) {
+        if (slot.fence != nullptr) {
+            glDeleteSync(slot.fence);
+        }
+
+        if (slot.mapped != nullptr) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        glDeleteBuffers(1, &slot.buffer);
+    }
+
+    slots.clear();
+    head = 0;
+    tail = 0;
+    pending = 0;
+    acquired = false;
+
+    stallCount = 0;
+    stallMilliseconds = 0.0;
+    maxStallMilliseconds = 0.0;
+    lostCount = 0;
+}
+
+bool ReadbackRing::isFull() const {
+    return pending == static_cast<int32_t>(slots.size());
+}
+
+bool ReadbackRing::isEmpty() const { return pending == 0; }
+
+bool ReadbackRing::isPersistent() const { return persistent; }
+
+size_t ReadbackRing::getFrameSize() const {
+    return static_cast<size_t>(width) * height * (format == GL_RED ? 1 : 4);
+}
+
+void ReadbackRing::read(int64_t frame) {
+    Slot& slot = slots[head];
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (format == GL_RED) {
+        // Single byte rows need not be 4 byte aligned.
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    } else {
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = frame;
+
+    head = (head + 1) % static_cast<int32_t>(slots.size());
+    pending++;
+}
+
+bool ReadbackRing::waitFence(Slot& slot, bool wait) {
+    if (slot.fence == nullptr) {
+        return true;
+    }
+
+    GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+#ifndef __EMSCRIPTEN__
+    if (wait && result == GL_TIMEOUT_EXPIRED) {
+        PROFILE_SCOPE("ReadbackRing stall");
+
+        const auto t0 = std::chrono::steady_clock::now();
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(slot.fence, 0, 1000000);
+        }
+
+        const double milliseconds =
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - t0)
+                .count();
+        stallCount++;
+        stallMilliseconds += milliseconds;
+        maxStallMilliseconds = std::max(maxStallMilliseconds, milliseconds);
+    }
+#else
+    // WebGL cannot block on a fence, the read below synchronizes instead.
+    if (wait) {
+        result = GL_ALREADY_SIGNALED;
+    }
+#endif
+
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+        return false;
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    return true;
+}
+
+bool ReadbackRing::acquire(bool wait, const uint8_t*& pixels, int64_t& frame) {
+    if (pending == 0 || acquired) {
+        return false;
+    }
+
+    Slot& slot = slots[tail];
+    if (!waitFence(slot, wait)) {
+        return false;
+    }
+
+    const GLsizeiptr size = static_cast<GLsizeiptr>(getFrameSize());
+
+    if (persistent) {
+        pixels = slot.mapped;
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+#ifdef __EMSCRIPTEN__
+        // clang-format off
+        EM_ASM({
+            Module.ctx.getBufferSubData(
+                Module.ctx.PIXEL_PACK_BUFFER,
+                0,
+                HEAPU8.subarray($0, $0 + $1));
+        }, staging.data(), size);
+        // clang-format on
+        pixels = staging.data();
+#else
+        pixels = static_cast<const uint8_t*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+#endif
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    if (pixels == nullptr) {
+        AppLog::getInstance().error(
+            "Could not map readback buffer, frame %lld is lost\n",
+            static_cast<long long>(slot.frame));
+        lostCount++;
+        tail = (tail + 1) % static_cast<int32_t>(slots.size());
+        pending--;
+        return false;
+    }
+
+    frame = slot.frame;
+    acquired = true;
+    return true;
+}
+
+void ReadbackRing::release() {
+    if (!acquired) {
+        return;
+    }
+
+#ifndef __EMSCRIPTEN__
+    if (!persistent) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[tail].buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+#endif
+
+    tail = (tail + 1) % static_cast<int32_t>(slots.size());
+    pending--;
+    acquired = false;
+}
+
+int64_t ReadbackRing::getStallCount() const { return stallCount; }
+
+double ReadbackRing::getStallMilliseconds() const { return stallMilliseconds; }
+
+double ReadbackRing::getMaxStallMilliseconds() const {
+    return maxStallMilliseconds;
+}
+
+int64_t ReadbackRing::getLostCount() const { return lostCount; }
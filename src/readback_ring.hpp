@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+
+// Asynchronous framebuffer readback through a ring of pixel pack buffers.
+// Every read is followed by a fence and a buffer is only mapped once its
+// fence has signalled, so the CPU waits only when all buffers are in flight.
+// Buffers are mapped persistently where ARB_buffer_storage is available.
+class ReadbackRing {
+   private:
+    struct Slot {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        const uint8_t* mapped = nullptr;
+        int64_t frame = -1;
+    };
+
+    std::vector<Slot> slots;
+    int32_t width = 0;
+    int32_t height = 0;
+    GLenum format = GL_RGBA;
+    int32_t head = 0;
+    int32_t tail = 0;
+    int32_t pending = 0;
+    bool persistent = false;
+    bool acquired = false;
+
+#ifdef __EMSCRIPTEN__
+    std::vector<uint8_t> staging;
+#endif
+
+    int64_t stallCount = 0;
+    double stallMilliseconds = 0.0;
+    double maxStallMilliseconds = 0.0;
+    int64_t lostCount = 0;
+
+    static bool isBufferStorageSupported();
+    bool waitFence(Slot& slot, bool wait);
+
+   public:
+    ~ReadbackRing() { cleanup(); }
+
+    // format is GL_RGBA or GL_RED, always read as unsigned bytes.
+    void initialize(int32_t width, int32_t height, int32_t depth,
+                    GLenum format = GL_RGBA);
+    void cleanup();
+
+    bool isFull() const;
+    bool isEmpty() const;
+    bool isPersistent() const;
+
+    // Size in bytes of one frame handed out by acquire().
+    size_t getFrameSize() const;
+
+    // Starts reading the bound read framebuffer into the next buffer. The
+    // ring must not be full.
+    void read(int64_t frame);
+
+    // Gets the oldest pending frame. Without wait, fails if its fence has not
+    // signalled yet; with wait, blocks and accounts the time as a stall. A
+    // frame whose buffer cannot be mapped is dropped and counted as lost.
+    bool acquire(bool wait, const uint8_t*& pixels, int64_t& frame);
+
+    // Returns the buffer handed out by acquire() to the ring.
+    void release();
+
+    int64_t getStallCount() const;
+    double getStallMilliseconds() const;
+    double getMaxStallMilliseconds() const;
+
+    // Frames dropped because their buffer could not be mapped.
+    int64_t getLostCount() const;
+};
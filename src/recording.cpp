@@ -1,6 +1,579 @@
 #include "recording.hpp"
 #include "file_utils.hpp"
-#include <math.h>
+#include "cpu_profiler.hpp"
+#include "app_log.hpp"
+#include "video_join.hpp"
+#include "stream_sink.hpp"
+#include "scaled_sink.hpp"
+#include "frame_hash.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+#ifdef __EMSCRIPTEN__
+void downloadFile(const std::string& fileName) {
+    std::string buff;
+    readText(fileName, buff);
+    EM_ASM({
+        const a = document.createElement("a");
+        document.body.appendChild(a);
+        a.style = "display: none";
+        const data =HEAPU8.subarray($0, $0 + $1); 
+        const blob = new Blob([data], { type: "octet/stream" });
+        const url = window.URL.createObjectURL(blob);
+        a.href = url;
+        a.download = UTF8ToString($2);
+        a.click();
+        document.body.removeChild(a);
+        window.URL.revokeObjectURL(url);
+    }, buff.c_str(), buff.size(), fileName.c_str());
+}
+#endif
+
+// Whole frames of a tiled export that may be in flight at once, at 16K
+// each one takes hundreds of megabytes.
+const size_t TiledFrameMemoryBudget = 1024 * 1024 * 1024;
+}  // namespace
+
+void TileGrid::initialize(int32_t width, int32_t height, int32_t tileWidth,
+                          int32_t tileHeight) {
+    this->width = width;
+    this->height = height;
+
+    if (tileWidth <= 0 || tileHeight <= 0 ||
+        (tileWidth >= width && tileHeight >= height)) {
+        this->tileWidth = width;
+        this->tileHeight = height;
+        columns = 1;
+        rows = 1;
+        return;
+    }
+
+    this->tileWidth = std::min(tileWidth & ~1, width);
+    this->tileHeight = std::min(tileHeight & ~1, height);
+    columns = (width + this->tileWidth - 1) / this->tileWidth;
+    rows = (height + this->tileHeight - 1) / this->tileHeight;
+}
+
+void TileGrid::getRect(int32_t tile, int32_t& x, int32_t& y, int32_t& w,
+                       int32_t& h) const {
+    // Rows are counted from the top, where the I420 planes start.
+    const int32_t top = (tile / columns) * tileHeight;
+    x = (tile % columns) * tileWidth;
+    w = std::min(tileWidth, width - x);
+    h = std::min(tileHeight, height - top);
+    y = height - top - h;
+}
+
+void RecordingSegment::start(int32_t bufferWidth, int32_t bufferHeight,
+                             const TileGrid& tiles, bool gpuYuv,
+                             int32_t readbackDepth, bool deduplicate,
+                             std::vector<std::unique_ptr<VideoSink>> sinks) {
+    cleanup();
+
+    const bool tiled = tiles.getCount() > 1;
+
+    this->bufferWidth = bufferWidth;
+    this->bufferHeight = bufferHeight;
+    this->tiles = tiles;
+    this->readbackDepth = readbackDepth;
+
+    rgbaOutput = false;
+    yuvOutput = false;
+    bool duplicates = true;
+    for (std::unique_ptr<VideoSink>& sink : sinks) {
+        rgbaOutput = rgbaOutput || sink->acceptsRgba();
+        yuvOutput = yuvOutput || !sink->acceptsRgba();
+        duplicates = duplicates && sink->acceptsDuplicateFrames();
+
+        auto worker = std::make_unique<SinkWorker>();
+        worker->sink = std::move(sink);
+        this->sinks.push_back(std::move(worker));
+    }
+
+    this->gpuYuv = gpuYuv && !tiled && !rgbaOutput;
+    this->deduplicate = deduplicate && !tiled && duplicates;
+    for (std::unique_ptr<SinkWorker>& worker : this->sinks) {
+        worker->sink->setDuplicateFrames(this->deduplicate);
+    }
+
+    const size_t rgbaSize = (size_t)tiles.tileWidth * tiles.tileHeight * 4;
+    const size_t yuvSize = getI420FrameSize(bufferWidth, bufferHeight);
+    const size_t stitchSize = (size_t)bufferWidth * bufferHeight * 4;
+    const bool convert = tiled || (!this->gpuYuv && yuvOutput);
+    frameSize = this->gpuYuv ? yuvSize : rgbaSize;
+
+    if (this->gpuYuv) {
+        readback.initialize(bufferWidth, bufferHeight * 3 / 2, readbackDepth,
+                            GL_RED);
+    } else {
+        readback.initialize(tiles.tileWidth, tiles.tileHeight, readbackDepth);
+    }
+
+    backpressureCount = 0;
+    backpressureMilliseconds = 0;
+    hasPreviousHash = false;
+    duplicateCount = 0;
+    if (this->deduplicate) {
+        previousFrame = std::make_unique<uint8_t[]>(frameSize);
+    } else {
+        previousFrame.reset();
+    }
+
+#ifdef __EMSCRIPTEN__
+    // No worker threads here, the stages run inline on the render thread.
+    if (yuvOutput) {
+        yuvPool.initialize(yuvSize, 1);
+    }
+    if (tiled && rgbaOutput) {
+        stitchPool.initialize(stitchSize, 1);
+    }
+#else
+    // One more buffer than fits in a queue so the stage that consumes it
+    // can hold one while the queue is full. Huge tiled frames are limited by
+    // memory instead, with at least one being stitched while one encodes.
+    int32_t frameCount = PipelineDepth + 1;
+    if (tiled) {
+        const size_t tiledSize =
+            (yuvOutput ? yuvSize : 0) + (rgbaOutput ? stitchSize : 0);
+        frameCount = static_cast<int32_t>(std::max(
+            (size_t)2, std::min((size_t)frameCount,
+                                TiledFrameMemoryBudget / tiledSize)));
+    }
+
+    // Read back frames wait for the converter, then for the sinks that
+    // take them as they are.
+    int32_t rgbaCount = convert ? PipelineDepth + 1 : 0;
+    if (!tiled && !this->gpuYuv && rgbaOutput) {
+        rgbaCount += PipelineDepth + 1;
+    }
+
+    if (rgbaCount > 0) {
+        rgbaPool.initialize(rgbaSize, rgbaCount);
+    }
+    if (yuvOutput) {
+        yuvPool.initialize(yuvSize, frameCount);
+    }
+    if (tiled && rgbaOutput) {
+        stitchPool.initialize(stitchSize, frameCount);
+    }
+    rgbaQueue.reset(PipelineDepth);
+
+    if (tiled) {
+        converterThread = std::thread(&RecordingSegment::runStitcher, this);
+    } else if (convert) {
+        converterThread = std::thread(&RecordingSegment::runConverter, this);
+    }
+
+    for (std::unique_ptr<SinkWorker>& worker : this->sinks) {
+        worker->queue.reset(frameCount - 1);
+        worker->thread =
+            std::thread(&RecordingSegment::runEncoder, this, worker.get());
+    }
+#endif
+}
+
+void RecordingSegment::update(bool isLastFrame, int64_t currentFrame,
+                              int32_t tile) {
+    // Make room for this frame, this is the only place the render thread
+    // waits for the GPU.
+    if (readback.isFull()) {
+        writeNextFrame(true);
+    }
+
+    // Tiles are tagged with their frame and index in one number.
+    readback.read(currentFrame * tiles.getCount() + tile);
+
+    // Write out whatever the GPU has already finished.
+    while (writeNextFrame(false)) {
+    }
+
+    if (isLastFrame && tile + 1 == tiles.getCount()) {
+        while (!readback.isEmpty()) {
+            writeNextFrame(true);
+        }
+
+        AppLog::getInstance().info(
+            "Readback: %d buffers%s, %lld stalls, %.1f ms total, %.1f ms max\n",
+            readbackDepth, readback.isPersistent() ? " (persistent)" : "",
+            static_cast<long long>(readback.getStallCount()),
+            readback.getStallMilliseconds(),
+            readback.getMaxStallMilliseconds());
+
+        // A frame lost in the readback leaves the files a frame short, or a
+        // tiled frame incomplete.
+        lostFrames = readback.getLostCount();
+        readback.cleanup();
+
+        finish();
+    }
+}
+
+bool RecordingSegment::writeNextFrame(bool wait) {
+    const uint8_t* pixels = nullptr;
+    int64_t frame = 0;
+
+    if (!readback.acquire(wait, pixels, frame)) {
+        return false;
+    }
+
+    writeOneFrame(pixels, frame);
+    readback.release();
+    return true;
+}
+
+void RecordingSegment::cleanup() {
+    readback.cleanup();
+    stopPipeline();
+}
+
+const ReadbackRing& RecordingSegment::getReadback() const { return readback; }
+
+int64_t RecordingSegment::getBackpressureCount() const {
+    return backpressureCount;
+}
+
+double RecordingSegment::getBackpressureMilliseconds() const {
+    return backpressureMilliseconds;
+}
+
+int64_t RecordingSegment::getDuplicateCount() const { return duplicateCount; }
+
+bool RecordingSegment::hasSucceeded() const { return succeeded; }
+
+void RecordingSegment::writeOneFrame(const uint8_t* pixels,
+                                     int64_t currentFrame) {
+    PROFILE_SCOPE("RecordingSegment::writeOneFrame");
+
+    // Hashed straight from the readback buffer, a duplicate never waits for
+    // a pool buffer.
+    bool duplicate = false;
+    if (deduplicate) {
+        const uint64_t hash = hashFrame(pixels, frameSize);
+        duplicate = hasPreviousHash && hash == previousHash &&
+                    memcmp(pixels, previousFrame.get(), frameSize) == 0;
+        previousHash = hash;
+        hasPreviousHash = true;
+
+        if (duplicate) {
+            duplicateCount++;
+        } else {
+            memcpy(previousFrame.get(), pixels, frameSize);
+        }
+    }
+
+#ifdef __EMSCRIPTEN__
+    // Sinks write straight from the readback buffer or the one conversion.
+    const uint8_t* rgba = gpuYuv ? nullptr : pixels;
+    const uint8_t* yuv = gpuYuv ? pixels : nullptr;
+    int64_t frame = currentFrame;
+    PooledFrame converted;
+
+    if (tiles.getCount() > 1) {
+        if (!addTile(pixels, currentFrame)) {
+            return;
+        }
+        rgba = stitchedRgba.data.get();
+        yuv = stitchedYuv.data.get();
+        frame = stitchedYuv.data ? stitchedYuv.frame : stitchedRgba.frame;
+    } else if (duplicate) {
+        rgba = nullptr;
+        yuv = nullptr;
+    } else if (!gpuYuv && yuvOutput) {
+        yuvPool.acquire(converted);
+        convertFrame(pixels, converted.data.get());
+        yuv = converted.data.get();
+    }
+
+    for (std::unique_ptr<SinkWorker>& worker : sinks) {
+        encodeFrame(*worker, worker->sink->acceptsRgba() ? rgba : yuv, frame);
+    }
+
+    yuvPool.release(converted);
+    yuvPool.release(stitchedYuv);
+    stitchPool.release(stitchedRgba);
+#else
+    // Frames converted on the GPU, or not needed in I420, go straight to
+    // the sinks.
+    const bool direct = tiles.getCount() == 1 && (gpuYuv || !yuvOutput);
+    FramePool& pool = gpuYuv ? yuvPool : rgbaPool;
+
+    if (duplicate && direct) {
+        deliverDuplicate(currentFrame);
+        return;
+    }
+
+    PooledFrame item;
+    item.frame = currentFrame;
+
+    if (duplicate) {
+        rgbaQueue.push(std::move(item));
+        return;
+    }
+
+    // The pool only runs dry when the converter and encoders are behind by
+    // more than the queues hold, that is the backpressure on the renderer.
+    const int64_t waitStart = CpuProfiler::now();
+    if (pool.acquire(item)) {
+        backpressureCount++;
+        backpressureMilliseconds +=
+            (CpuProfiler::now() - waitStart) / 1000000.0;
+    }
+
+    memcpy(item.data.get(), pixels, pool.getFrameSize());
+
+    if (direct) {
+        const SharedFrame frame = pool.share(item);
+        deliver(gpuYuv ? nullptr : frame, gpuYuv ? frame : nullptr);
+    } else if (!rgbaQueue.push(std::move(item))) {
+        pool.release(item);
+    }
+#endif
+}
+
+void RecordingSegment::convertFrame(const uint8_t* rgbaBuffer,
+                                    uint8_t* yuvBuffer) const {
+    PROFILE_SCOPE("RecordingSegment::convertFrame");
+
+    const int32_t ySize = bufferWidth * bufferHeight;
+    const int32_t uSize = getI420ChromaWidth(bufferWidth) *
+                          getI420ChromaHeight(bufferHeight);
+
+    const int32_t yStride = bufferWidth;
+    const int32_t uStride = getI420ChromaWidth(bufferWidth);
+    const int32_t vStride = uStride;
+
+    uint8_t* yBuffer = yuvBuffer;
+    uint8_t* uBuffer = yBuffer + ySize;
+    uint8_t* vBuffer = uBuffer + uSize;
+
+    libyuv::ABGRToI420(rgbaBuffer, bufferWidth * 4, yBuffer, yStride, uBuffer,
+                       uStride, vBuffer, vStride, bufferWidth, -bufferHeight);
+}
+
+void RecordingSegment::stitchTile(const uint8_t* rgbaBuffer, int32_t tile,
+                                  uint8_t* rgbaFrame,
+                                  uint8_t* yuvFrame) const {
+    PROFILE_SCOPE("RecordingSegment::stitchTile");
+
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t w = 0;
+    int32_t h = 0;
+    tiles.getRect(tile, x, y, w, h);
+
+    // Only the bottom left w x h of a tile at the edge is inside the frame.
+    const int32_t tileStride = tiles.tileWidth * 4;
+
+    if (rgbaFrame) {
+        // Sinks take RGBA frames bottom-up, as they are read back.
+        libyuv::ARGBCopy(rgbaBuffer, tileStride,
+                         rgbaFrame + ((size_t)y * bufferWidth + x) * 4,
+                         bufferWidth * 4, w, h);
+    }
+
+    if (!yuvFrame) {
+        return;
+    }
+
+    // I420 rows go top-down, the tile is flipped into its place. Tiles
+    // start at even rows and columns from the top left, so each one covers
+    // whole chroma samples.
+    const int32_t top = bufferHeight - y - h;
+    const int32_t yStride = bufferWidth;
+    const int32_t uStride = getI420ChromaWidth(bufferWidth);
+    const int32_t vStride = uStride;
+    const size_t ySize = (size_t)bufferWidth * bufferHeight;
+    const size_t uSize =
+        (size_t)uStride * getI420ChromaHeight(bufferHeight);
+
+    uint8_t* yBuffer = yuvFrame + (size_t)top * yStride + x;
+    uint8_t* uBuffer = yuvFrame + ySize + (size_t)(top / 2) * uStride + x / 2;
+    uint8_t* vBuffer =
+        yuvFrame + ySize + uSize + (size_t)(top / 2) * vStride + x / 2;
+
+    libyuv::ABGRToI420(rgbaBuffer, tileStride, yBuffer, yStride, uBuffer,
+                       uStride, vBuffer, vStride, w, -h);
+}
+
+bool RecordingSegment::addTile(const uint8_t* rgbaBuffer, int64_t tag) {
+    const int32_t tile = static_cast<int32_t>(tag % tiles.getCount());
+    const int64_t frame = tag / tiles.getCount();
+
+    if (rgbaOutput && !stitchedRgba.data) {
+        stitchPool.acquire(stitchedRgba);
+        stitchedRgba.frame = frame;
+    }
+    if (yuvOutput && !stitchedYuv.data) {
+        yuvPool.acquire(stitchedYuv);
+        stitchedYuv.frame = frame;
+    }
+
+    stitchTile(rgbaBuffer, tile, stitchedRgba.data.get(),
+               stitchedYuv.data.get());
+
+    // The frame is complete with its last tile.
+    return tile + 1 == tiles.getCount();
+}
+
+void RecordingSegment::deliver(const SharedFrame& rgba,
+                               const SharedFrame& yuv) {
+    for (std::unique_ptr<SinkWorker>& worker : sinks) {
+        SharedFrame frame = worker->sink->acceptsRgba() ? rgba : yuv;
+        worker->queue.push(std::move(frame));
+    }
+}
+
+void RecordingSegment::deliverDuplicate(int64_t frame) {
+    // Duplicates of the previous frame come without pixels.
+    const SharedFrame duplicate = std::make_shared<PooledFrame>();
+    duplicate->frame = frame;
+    deliver(duplicate, duplicate);
+}
+
+void RecordingSegment::encodeFrame(SinkWorker& worker, const uint8_t* buffer,
+                                   int64_t frame) {
+    PROFILE_SCOPE("RecordingSegment::encodeFrame");
+
+    // Keep draining after a failure so the earlier stages never block on a
+    // full queue.
+    if (worker.failed) {
+        return;
+    }
+
+    const bool ok = buffer ? worker.sink->writeFrame(buffer, frame)
+                           : worker.sink->writeDuplicateFrame(frame);
+    if (!ok) {
+        worker.failed = true;
+    }
+}
+
+void RecordingSegment::runConverter() {
+    CpuProfiler::getInstance().setThreadName("converter");
+
+    PooledFrame rgba;
+    while (rgbaQueue.pop(rgba)) {
+        // Duplicates have nothing to convert.
+        if (!rgba.data) {
+            deliverDuplicate(rgba.frame);
+            continue;
+        }
+
+        PooledFrame yuv;
+        yuv.frame = rgba.frame;
+        yuvPool.acquire(yuv);
+
+        convertFrame(rgba.data.get(), yuv.data.get());
+
+        // Sinks that take RGBA share the read back frame.
+        const SharedFrame sharedRgba =
+            rgbaOutput ? rgbaPool.share(rgba) : nullptr;
+        rgbaPool.release(rgba);
+
+        deliver(sharedRgba, yuvPool.share(yuv));
+    }
+}
+
+void RecordingSegment::runStitcher() {
+    CpuProfiler::getInstance().setThreadName("stitcher");
+
+    PooledFrame rgba;
+    while (rgbaQueue.pop(rgba)) {
+        const bool complete = addTile(rgba.data.get(), rgba.frame);
+        rgbaPool.release(rgba);
+
+        // Shared out, the stitched frames are empty for the next frame.
+        if (complete) {
+            deliver(rgbaOutput ? stitchPool.share(stitchedRgba) : nullptr,
+                    yuvOutput ? yuvPool.share(stitchedYuv) : nullptr);
+        }
+    }
+
+    // An unfinished frame is dropped when the recording is cancelled.
+    stitchPool.release(stitchedRgba);
+    yuvPool.release(stitchedYuv);
+}
+
+void RecordingSegment::runEncoder(SinkWorker* worker) {
+    CpuProfiler::getInstance().setThreadName("encoder");
+
+    SharedFrame frame;
+    while (worker->queue.pop(frame)) {
+        encodeFrame(*worker, frame->data.get(), frame->frame);
+
+        // Gives the buffer back once every sink is done with it.
+        frame = nullptr;
+    }
+}
+
+void RecordingSegment::stopPipeline() {
+    rgbaQueue.close();
+    if (converterThread.joinable()) {
+        converterThread.join();
+    }
+
+    for (std::unique_ptr<SinkWorker>& worker : sinks) {
+        worker->queue.close();
+    }
+    for (std::unique_ptr<SinkWorker>& worker : sinks) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    sinks.clear();
+    stitchPool.release(stitchedRgba);
+    yuvPool.release(stitchedYuv);
+    rgbaPool.cleanup();
+    yuvPool.cleanup();
+    stitchPool.cleanup();
+}
+
+void RecordingSegment::finish() {
+    // Closing the first queue lets each stage drain and exit in turn.
+    rgbaQueue.close();
+    if (converterThread.joinable()) {
+        converterThread.join();
+    }
+
+    for (std::unique_ptr<SinkWorker>& worker : sinks) {
+        worker->queue.close();
+    }
+
+    succeeded = lostFrames == 0;
+    if (lostFrames > 0) {
+        AppLog::getInstance().error("Lost %lld frames in the readback\n",
+                                    static_cast<long long>(lostFrames));
+    }
+
+    for (std::unique_ptr<SinkWorker>& worker : sinks) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+
+        if (worker->failed) {
+            AppLog::getInstance().error("Could not encode frame: %s\n",
+                                        worker->sink->lastError().c_str());
+            succeeded = false;
+        }
+
+        if (!worker->sink->finalize()) {
+            AppLog::getInstance().error("Could not finalize video: %s\n",
+                                        worker->sink->lastError().c_str());
+            succeeded = false;
+        }
+    }
+
+#ifndef __EMSCRIPTEN__
+    AppLog::getInstance().info(
+        "Encode pipeline: %lld backpressure waits, %.1f ms total\n",
+        static_cast<long long>(backpressureCount), backpressureMilliseconds);
+#endif
+
+    stopPipeline();
+}
 
 bool Recording::getIsRecording() { return isRecording; }
 
@@ -8,232 +581,494 @@ void Recording::start(const int32_t bufferWidth, const int32_t bufferHeight,
                       const std::string& fileName, const int32_t videoType,
                       const int32_t webmBitrate,
                       const unsigned long webmEncodeDeadline) {
-    this->isRecording = true;
+    cleanup();
+    resumable = false;
 
-    this->videoType = videoType;
     this->bufferWidth = bufferWidth;
     this->bufferHeight = bufferHeight;
 
-    const int32_t ySize = bufferWidth * bufferHeight;
-    const int32_t uSize = ySize / 4;
-    const int32_t vSize = uSize;
-    yuvBuffer = std::make_unique<uint8_t[]>(ySize + uSize + vSize);
-
-    switch (videoType) {
-        case 0: {
-            fp = fopen(fileName.c_str(), "wb");
-            fprintf(fp,
-                    "YUV4MPEG2 W%d H%d F30000:1001 Ip A0:0 C420 XYSCSS=420\n",
-                    bufferWidth, bufferHeight);
-        } break;
-        case 1: {
-            pWebmEncoder = std::make_unique<WebmEncoder>(
-                fileName, 1001, 30000, bufferWidth, bufferHeight, webmBitrate);
-        } break;
-        case 2: {
-            fp = fopen(fileName.c_str(), "wb");
-            void* pEncoder = nullptr;
-            h264encoder::CreateOpenH264Encoder(&pEncoder, &pMP4Muxer,
-                                               &pMP4H264Writer, bufferWidth,
-                                               bufferHeight, fp);
-            delete pOpenH264Encoder;
-            pOpenH264Encoder = pEncoder;
-        } break;
+    outputs.clear();
+    outputs.push_back({fileName, videoType});
+    for (const RecordingOutput& output : extraOutputs) {
+        if (output.fileName != fileName) {
+            outputs.push_back(output);
+        }
+    }
+
+    bool joinable = true;
+    int32_t webmCount = 0;
+    for (RecordingOutput& output : outputs) {
+        if (output.width <= 0 || output.height <= 0) {
+            output.width = bufferWidth;
+            output.height = bufferHeight;
+        }
+        if (output.kbps <= 0) {
+            output.kbps = webmBitrate;
+        }
+
+        joinable = joinable && !StreamSink::isStreamTarget(output.fileName) &&
+                   output.videoType != 4 && output.videoType != 5;
+        if (output.videoType == 1) {
+            webmCount++;
+        }
+    }
+
+    tiles.initialize(bufferWidth, bufferHeight, tileSizeRequested,
+                     tileSizeRequested);
+    gpuYuv = gpuYuvRequested && tiles.getCount() == 1;
+
+    // A stream has a single reader and cannot be joined from parts. PNG and
+    // GIF frames are already compressed in parallel. Tiled frames already
+    // take all the memory one recording should, they are only split into
+    // checkpoints written one after another.
+    int32_t count = 1;
+    activeSegmentCount = 1;
+    checkpointed = false;
+#ifndef __EMSCRIPTEN__
+    const bool parallel = segmentCountRequested > 1 &&
+                          tiles.getCount() == 1 &&
+                          segmentedFrameCount >= segmentCountRequested;
+    if (checkpointFrames > 0 && segmentedFrameCount > checkpointFrames &&
+        joinable) {
+        count = static_cast<int32_t>(
+            (segmentedFrameCount + checkpointFrames - 1) / checkpointFrames);
+        activeSegmentCount =
+            parallel ? std::min(segmentCountRequested, count) : 1;
+        checkpointed = true;
+    } else if (parallel && joinable) {
+        count = segmentCountRequested;
+        activeSegmentCount = count;
+    }
+#endif
+
+    if (checkpointFrames > 0 && !checkpointed) {
+        AppLog::getInstance().info(
+            "Not checkpointing, the export is too short or its files cannot "
+            "be joined\n");
+    }
+
+    // The segments' and outputs' encoders share the cores instead of each
+    // starting one thread per core.
+    segmentWebmOptions = webmOptions;
+    const int32_t encoderCount = activeSegmentCount * std::max(webmCount, 1);
+    if (encoderCount > 1 && segmentWebmOptions.threads == 0) {
+        segmentWebmOptions.threads = std::max(
+            1, static_cast<int32_t>(std::thread::hardware_concurrency()) /
+                   encoderCount);
+    }
+    this->webmEncodeDeadline = webmEncodeDeadline;
+
+    const int32_t resumed =
+        checkpointed ? std::min(resumedCheckpoints, count) : 0;
+    for (int32_t i = 0; i < count; i++) {
+        Segment segment;
+        if (checkpointed) {
+            segment.firstFrame = checkpointFrames * i;
+            segment.endFrame =
+                std::min(checkpointFrames * (i + 1), segmentedFrameCount);
+        } else {
+            segment.firstFrame = segmentedFrameCount * i / count;
+            segment.endFrame = segmentedFrameCount * (i + 1) / count;
+        }
+        segment.nextFrame = i < resumed ? segment.endFrame : segment.firstFrame;
+
+        for (const RecordingOutput& output : outputs) {
+            segment.fileNames.push_back(
+                count > 1 ? output.fileName + ".part" + std::to_string(i)
+                          : output.fileName);
+        }
+        segments.push_back(std::move(segment));
+    }
+
+    // Resumed segments are only as good as their files.
+    for (int32_t i = 0; i < resumed; i++) {
+        for (const std::string& part : segments[i].fileNames) {
+            FILE* fp = fopen(part.c_str(), "rb");
+            if (fp == nullptr) {
+                AppLog::getInstance().error("Cannot resume without %s\n",
+                                            part.c_str());
+                segments.clear();
+                checkpointed = false;
+                return;
+            }
+            fclose(fp);
+        }
     }
+
+    // Failing from here on removes the files of the segments opened.
+    isRecording = true;
+    openedSegments = resumed;
+    completedSegments = resumed;
+    while (openedSegments < segments.size() &&
+           openedSegments <
+               static_cast<size_t>(resumed + activeSegmentCount)) {
+        if (!openSegment(segments[openedSegments++])) {
+            cleanup();
+            return;
+        }
+    }
+
+    if (outputs.size() > 1) {
+        AppLog::getInstance().info("Writing %d files from each frame\n",
+                                   static_cast<int32_t>(outputs.size()));
+        for (const RecordingOutput& output : outputs) {
+            AppLog::getInstance().info("  %s: %dx%d\n",
+                                       output.fileName.c_str(), output.width,
+                                       output.height);
+        }
+    }
+
+    nextSegment = resumed < count ? resumed : 0;
+
+    if (resumed > 0) {
+        AppLog::getInstance().info(
+            "Resuming at frame %lld, %d of %d segments are done\n",
+            static_cast<long long>(segments[resumed - 1].endFrame), resumed,
+            count);
+    }
+
+    // Nothing left to render, only the joining failed last time.
+    if (resumed == count && count > 1) {
+        finish();
+    }
+}
+
+bool Recording::openSegment(Segment& segment) {
+    std::vector<std::unique_ptr<VideoSink>> sinks;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const RecordingOutput& output = outputs[i];
+
+        auto sink = VideoSink::create(
+            output.videoType, segment.fileNames[i], output.width,
+            output.height, output.kbps, webmEncodeDeadline,
+            segmentWebmOptions, gifOptions);
+        if (sink && (output.width != bufferWidth ||
+                     output.height != bufferHeight)) {
+            sink = std::make_unique<ScaledSink>(bufferWidth, bufferHeight,
+                                                output.width, output.height,
+                                                std::move(sink));
+        }
+        if (!sink) {
+            return false;
+        }
+        if (segment.endFrame > segment.firstFrame) {
+            sink->reserve(segment.endFrame - segment.firstFrame);
+        }
+        if (sink->acceptsRgba()) {
+            gpuYuv = false;
+        }
+        sinks.push_back(std::move(sink));
+    }
+
+    segment.writer = std::make_unique<RecordingSegment>();
+    segment.writer->start(bufferWidth, bufferHeight, tiles, gpuYuv,
+                          readbackDepth, deduplicateFrames, std::move(sinks));
+    return true;
+}
+
+bool Recording::finishSegment() {
+    while (completedSegments < static_cast<int32_t>(segments.size())) {
+        const Segment& segment = segments[completedSegments];
+        if (segment.nextFrame < segment.endFrame ||
+            (segment.writer && !segment.writer->hasSucceeded())) {
+            break;
+        }
+        completedSegments++;
+    }
+
+    // A checkpoint that could not be written stops the export there, the
+    // ones before it are kept to resume from.
+    for (size_t i = 0; i < segments.size(); i++) {
+        const Segment& segment = segments[i];
+        if (checkpointed && segment.writer &&
+            segment.nextFrame == segment.endFrame &&
+            !segment.writer->hasSucceeded()) {
+            AppLog::getInstance().error("Could not write segment %d\n",
+                                        static_cast<int32_t>(i));
+            return false;
+        }
+    }
+
+    if (openedSegments < segments.size() &&
+        !openSegment(segments[openedSegments++])) {
+        AppLog::getInstance().error("Could not open segment %d\n",
+                                    static_cast<int32_t>(openedSegments - 1));
+        return false;
+    }
+    return true;
 }
 
 void Recording::update(bool isLastFrame, int64_t currentFrame,
-                       GLuint writeBuffer, GLuint readBuffer) {
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, writeBuffer);
-    glReadPixels(0, 0, bufferWidth, bufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+                       int32_t tile) {
+    if (segments.size() == 1) {
+        segments[0].writer->update(isLastFrame, currentFrame, tile);
+        if (isLastFrame && tile + 1 == tiles.getCount()) {
+            finish();
+        }
+        return;
+    }
 
-    if (currentFrame > 0) {
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffer);
+    // Segments take turns one frame each, so that all their encoders are
+    // kept busy.
+    Segment& segment = segments[nextSegment];
+    if (tile + 1 < tiles.getCount()) {
+        segment.writer->update(false, currentFrame, tile);
+        return;
+    }
 
-#ifdef __EMSCRIPTEN__
-        {
-            auto size = bufferWidth * bufferHeight * 4;
-            auto ptr = std::make_unique<uint8_t[]>(size);
-            // clang-format on
-            EM_ASM({
-                Module.ctx.getBufferSubData(
-                    Module.ctx.PIXEL_PACK_BUFFER,
-                    0,
-                    HEAPU8.subarray($0, $0 + $1));
-            }, ptr.get(), size);
-            // clang-format off
-            writeOneFrame(ptr.get(), currentFrame);
+    segment.nextFrame = currentFrame + 1;
+    segment.writer->update(segment.nextFrame == segment.endFrame,
+                           currentFrame, tile);
+
+    if (segment.nextFrame == segment.endFrame && !finishSegment()) {
+        cleanup();
+        return;
+    }
+
+    for (size_t i = 1; i <= segments.size(); i++) {
+        const size_t next = (nextSegment + i) % segments.size();
+        if (segments[next].writer &&
+            segments[next].nextFrame < segments[next].endFrame) {
+            nextSegment = next;
+            return;
         }
-#else
-        {
-            auto* ptr = static_cast<const uint8_t*>(glMapBufferRange(
-                GL_PIXEL_PACK_BUFFER, 0, bufferWidth * bufferHeight * 4,
-                GL_MAP_READ_BIT));
-
-            if (ptr != nullptr) {
-                writeOneFrame(ptr, currentFrame);
-                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
-                ptr = nullptr;
-            }
+    }
+
+    finish();
+}
+
+void Recording::setExtraOutputs(const std::vector<RecordingOutput>& outputs) {
+    extraOutputs = outputs;
+}
+
+void Recording::setSegments(int32_t count, int64_t frameCount) {
+    segmentCountRequested = std::max(count, 1);
+    segmentedFrameCount = frameCount;
+}
+
+int32_t Recording::getSegmentCount() const {
+    return static_cast<int32_t>(segments.size());
+}
+
+void Recording::setCheckpoints(int64_t frames) {
+    checkpointFrames = std::max<int64_t>(frames, 0);
+}
+
+bool Recording::isCheckpointed() const { return checkpointed; }
+
+void Recording::setResumedCheckpoints(int32_t count) {
+    resumedCheckpoints = std::max(count, 0);
+}
+
+int32_t Recording::getCompletedCheckpoints() const {
+    return checkpointed ? completedSegments : 0;
+}
+
+bool Recording::isResumable() const { return resumable; }
+
+const std::vector<RecordingOutput>& Recording::getOutputs() const {
+    return outputs;
+}
+
+int64_t Recording::getNextFrame(int64_t frame) const {
+    if (segments.size() <= 1) {
+        return frame;
+    }
+
+    return segments[nextSegment].nextFrame;
+}
+
+void Recording::setReadbackDepth(int32_t depth) { readbackDepth = depth; }
+
+int32_t Recording::getReadbackDepth() const { return readbackDepth; }
+
+void Recording::setWebmEncoderOptions(const WebmEncoderOptions& options) {
+    webmOptions = options;
+}
+
+void Recording::setGifEncoderOptions(const GifEncoderOptions& options) {
+    gifOptions = options;
+}
+
+void Recording::setGpuYuvConversion(bool enabled) {
+    gpuYuvRequested = enabled;
+}
+
+bool Recording::isGpuYuv() const { return gpuYuv; }
+
+void Recording::setFrameDeduplication(bool enabled) {
+    deduplicateFrames = enabled;
+}
+
+bool Recording::getFrameDeduplication() const { return deduplicateFrames; }
+
+void Recording::setTileSize(int32_t size) { tileSizeRequested = size; }
+
+const TileGrid& Recording::getTiles() const { return tiles; }
+
+int64_t Recording::getReadbackStallCount() const {
+    int64_t count = 0;
+    for (const Segment& segment : segments) {
+        if (!segment.writer) {
+            continue;
         }
-#endif
+        count += segment.writer->getReadback().getStallCount();
+    }
+    return count;
+}
+
+double Recording::getReadbackStallMilliseconds() const {
+    double milliseconds = 0;
+    for (const Segment& segment : segments) {
+        if (!segment.writer) {
+            continue;
+        }
+        milliseconds += segment.writer->getReadback().getStallMilliseconds();
+    }
+    return milliseconds;
+}
+
+int64_t Recording::getBackpressureCount() const {
+    int64_t count = 0;
+    for (const Segment& segment : segments) {
+        if (!segment.writer) {
+            continue;
+        }
+        count += segment.writer->getBackpressureCount();
     }
+    return count;
+}
 
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+double Recording::getBackpressureMilliseconds() const {
+    double milliseconds = 0;
+    for (const Segment& segment : segments) {
+        if (!segment.writer) {
+            continue;
+        }
+        milliseconds += segment.writer->getBackpressureMilliseconds();
+    }
+    return milliseconds;
+}
 
-    if (isLastFrame) {
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, writeBuffer);
+int64_t Recording::getDuplicateFrameCount() const {
+    int64_t count = 0;
+    for (const Segment& segment : segments) {
+        if (!segment.writer) {
+            continue;
+        }
+        count += segment.writer->getDuplicateCount();
+    }
+    return count;
+}
 
-#ifdef __EMSCRIPTEN__
-        {
-            auto size = bufferWidth * bufferHeight * 4;
-            auto ptr = std::make_unique<uint8_t[]>(size);
-            EM_ASM({ Module.ctx.getBufferSubData(Module.ctx.PIXEL_PACK_BUFFER, 0, HEAPU8.subarray($0, $0 + $1)); }, ptr.get(), size);
-            writeOneFrame(ptr.get(), currentFrame);
+void Recording::cleanup() {
+    for (Segment& segment : segments) {
+        if (segment.writer) {
+            segment.writer->cleanup();
         }
-#else
-        {
-            auto* ptr = static_cast<const uint8_t*>(glMapBufferRange(
-                GL_PIXEL_PACK_BUFFER, 0, bufferWidth * bufferHeight * 4,
-                GL_MAP_READ_BIT));
-
-            if (ptr != nullptr) {
-                writeOneFrame(ptr, currentFrame);
-                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
-                ptr = nullptr;
+    }
+
+    // An unfinished segmented recording leaves its parts behind, a
+    // checkpointed one keeps the finished ones to resume from.
+    if (isRecording) {
+        resumable = checkpointed;
+        removeSegmentFiles(checkpointed);
+    }
+
+    segments.clear();
+    isRecording = false;
+}
+
+void Recording::finish() {
+    isRecording = false;
+
+    // The parts are kept when joining fails so that nothing is lost, and
+    // parts with missing frames are not joined at all.
+    if (segments.size() > 1) {
+        bool complete = true;
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (segments[i].writer && !segments[i].writer->hasSucceeded()) {
+                AppLog::getInstance().error("Segment %d is incomplete\n",
+                                            static_cast<int32_t>(i));
+                complete = false;
             }
         }
-#endif
 
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (complete && joinSegments()) {
+            removeSegmentFiles();
+        } else {
+            resumable = checkpointed;
+        }
+    }
 
-        switch (videoType) {
-            case 0: {
-                fclose(fp);
-                fp = nullptr;
 #ifdef __EMSCRIPTEN__
-                {
-                    std::string buff;
-                    readText("video.y4m", buff);
-                    EM_ASM({
-                        const a = document.createElement("a");
-                        document.body.appendChild(a);
-                        a.style = "display: none";
-                        const data =HEAPU8.subarray($0, $0 + $1); 
-                        const blob = new Blob([data], { type: "octet/stream" });
-                        const url = window.URL.createObjectURL(blob);
-                        a.href = url;
-                        a.download = "video.y4m";
-                        a.click();
-                        document.body.removeChild(a);
-                        window.URL.revokeObjectURL(url);
-                    }, buff.c_str(), buff.size());
-                }
-#endif
-            } break;
-            case 1: {
-                pWebmEncoder->finalize(webmEncodeDeadline);
-#ifdef __EMSCRIPTEN__
-                {
-                    std::string buff;
-                    readText("video.webm", buff);
-                    EM_ASM({
-                        const a = document.createElement("a");
-                        document.body.appendChild(a);
-                        a.style = "display: none";
-                        const data =HEAPU8.subarray($0, $0 + $1); 
-                        const blob = new Blob([data], { type: "octet/stream" });
-                        const url = window.URL.createObjectURL(blob);
-                        a.href = url;
-                        a.download = "video.webm";
-                        a.click();
-                        document.body.removeChild(a);
-                        window.URL.revokeObjectURL(url);
-                    }, buff.c_str(), buff.size());
-                }
-#endif
-            } break;
-            case 2: {
-                if (pOpenH264Encoder != nullptr) {
-                    h264encoder::Finalize(pOpenH264Encoder, pMP4Muxer,
-                                          pMP4H264Writer);
-                    fclose(fp);
-
-                    pOpenH264Encoder = nullptr;
-                    pMP4Muxer = nullptr;
-                    pMP4H264Writer = nullptr;
-                    fp = nullptr;
-#ifdef __EMSCRIPTEN__
-                    {
-                        std::string buff;
-                        readText("video.mp4", buff);
-                        EM_ASM({
-                            const a = document.createElement("a");
-                            document.body.appendChild(a);
-                            a.style = "display: none";
-                            const data =HEAPU8.subarray($0, $0 + $1); 
-                            const blob = new Blob([data], { type: "octet/stream" });
-                            const url = window.URL.createObjectURL(blob);
-                            a.href = url;
-                            a.download = "video.mp4";
-                            a.click();
-                            document.body.removeChild(a);
-                            window.URL.revokeObjectURL(url);
-                        }, buff.c_str(), buff.size());
-                    }
+    for (const RecordingOutput& output : outputs) {
+        downloadFile(output.fileName);
+    }
 #endif
-                }
-            } break;
-        }
+}
 
-        isRecording = false;
+bool Recording::joinSegments() {
+    bool joined = true;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        joined = joinSegments(i) && joined;
     }
+    return joined;
 }
 
-void Recording::cleanup() {
-    if (pOpenH264Encoder != nullptr) {
-        h264encoder::DestroyOpenH264Encoder(pOpenH264Encoder);
-        pOpenH264Encoder = nullptr;
+bool Recording::joinSegments(size_t output) {
+    const auto t0 = std::chrono::steady_clock::now();
+
+    const std::string& fileName = outputs[output].fileName;
+    const int32_t width = outputs[output].width;
+    const int32_t height = outputs[output].height;
+
+    std::vector<std::string> parts;
+    std::vector<int64_t> firstFrames;
+    for (const Segment& segment : segments) {
+        parts.push_back(segment.fileNames[output]);
+        firstFrames.push_back(segment.firstFrame);
     }
-}
 
-void Recording::writeOneFrame(const uint8_t* rgbaBuffer, int64_t currentFrame) {
-    const int32_t ySize = bufferWidth * bufferHeight;
-    const int32_t uSize = ySize / 4;
-    const int32_t vSize = uSize;
+    bool ok = false;
+    switch (outputs[output].videoType) {
+        case 0:
+            ok = joinY4mFiles(parts, fileName);
+            break;
+        case 1:
+            ok = joinWebmFiles(parts, firstFrames, width, height, fileName);
+            break;
+        case 2:
+            ok = joinMp4Files(parts, width, height, fileName);
+            break;
+    }
 
-    const int32_t yStride = bufferWidth;
-    const int32_t uStride = bufferWidth / 2;
-    const int32_t vStride = uStride;
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - t0)
+                               .count();
 
-    uint8_t* yBuffer = yuvBuffer.get();
-    uint8_t* uBuffer = yBuffer + ySize;
-    uint8_t* vBuffer = uBuffer + uSize;
+    if (ok) {
+        AppLog::getInstance().info("Joined %d segments in %.2fs\n",
+                                   static_cast<int32_t>(segments.size()),
+                                   seconds);
+    } else {
+        AppLog::getInstance().error("Could not join %d segments into %s\n",
+                                    static_cast<int32_t>(segments.size()),
+                                    fileName.c_str());
+    }
 
-    switch (videoType) {
-        case 0: {
-            libyuv::ABGRToI420(rgbaBuffer, bufferWidth * 4, yBuffer, yStride,
-                               uBuffer, uStride, vBuffer, vStride, bufferWidth,
-                               -bufferHeight);
-
-            fputs("FRAME\n", fp);
-            fwrite(yuvBuffer.get(), sizeof(uint8_t),
-                   (int64_t)ySize + uSize + vSize, fp);
-        } break;
-        case 1: {
-            pWebmEncoder->addRGBAFrame(rgbaBuffer, webmEncodeDeadline);
-        } break;
-        case 2: {
-            if (pOpenH264Encoder != nullptr) {
-                libyuv::ABGRToI420(rgbaBuffer, bufferWidth * 4, yBuffer,
-                                   yStride, uBuffer, uStride, vBuffer, vStride,
-                                   bufferWidth, -bufferHeight);
-                int64_t timestamp = roundl((currentFrame + 1) * 1001 / 30000);
-                h264encoder::EncodeFrame(pOpenH264Encoder, pMP4H264Writer,
-                                         yuvBuffer.get(), bufferWidth,
-                                         bufferHeight, timestamp);
+    return ok;
+}
+
+void Recording::removeSegmentFiles(bool keepFinished) {
+    const size_t first = keepFinished ? completedSegments : 0;
+    for (size_t index = first; index < segments.size(); index++) {
+        const Segment& segment = segments[index];
+        for (size_t i = 0; i < segment.fileNames.size(); i++) {
+            if (segment.fileNames[i] != outputs[i].fileName) {
+                remove(segment.fileNames[i].c_str());
             }
-        } break;
+        }
     }
 }
 
@@ -1,30 +1,212 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "common.hpp"
-#include "mp4muxer.h"
-#include "webm_encoder.hpp"
-#include "h264_encoder.hpp"
-#include "recording.hpp"
+#include "bounded_queue.hpp"
+#include "frame_pool.hpp"
+#include "readback_ring.hpp"
+#include "video_sink.hpp"
 
-class Recording {
+// Splits a frame too large to render at once into tiles of at most
+// tileWidth x tileHeight, numbered in rows from the top left. Tiles start
+// at even offsets so that they can be converted to I420 on their own.
+struct TileGrid {
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t tileWidth = 0;
+    int32_t tileHeight = 0;
+    int32_t columns = 1;
+    int32_t rows = 1;
+
+    // A tile size of 0, or one that covers the frame, means a single tile.
+    void initialize(int32_t width, int32_t height, int32_t tileWidth,
+                    int32_t tileHeight);
+
+    int32_t getCount() const { return columns * rows; }
+
+    // Rectangle of a tile in GL window coordinates, x and y from the bottom
+    // left. Tiles in the last row and column may be cut short.
+    void getRect(int32_t tile, int32_t& x, int32_t& y, int32_t& w,
+                 int32_t& h) const;
+};
+
+// Writes one or more video files of the same frames: reads frames back
+// through its own ring, converts them once and hands them to each sink on
+// that sink's own encoder thread.
+class RecordingSegment {
    private:
+    // Frames that may wait between two pipeline stages.
+    static const int32_t PipelineDepth = 4;
+
+    // A sink with the queue of frames it has yet to write. Each sink runs
+    // at its own pace, a slow one only holds back the others once its queue
+    // and the shared frame buffers are full.
+    struct SinkWorker {
+        std::unique_ptr<VideoSink> sink;
+        BoundedQueue<SharedFrame> queue;
+        std::thread thread;
+        std::atomic<bool> failed{false};
+    };
+
     int32_t bufferWidth = 0;
     int32_t bufferHeight = 0;
-    std::unique_ptr<uint8_t[]> yuvBuffer = nullptr;
 
-    std::unique_ptr<WebmEncoder> pWebmEncoder = nullptr;
-    unsigned long webmEncodeDeadline = 0;
+    // Tiles are read back one at a time and stitched into whole frames by
+    // the converter thread, only the frames in flight are ever full size.
+    TileGrid tiles;
+    PooledFrame stitchedRgba;
+    PooledFrame stitchedYuv;
+
+    ReadbackRing readback;
+    int32_t readbackDepth = 3;
+
+    // Frames are read back already converted to I420 by the GPU.
+    bool gpuYuv = false;
+    // Whether any sink takes RGBA frames, and any takes I420 frames.
+    bool rgbaOutput = false;
+    bool yuvOutput = false;
+    // Size of a read back frame.
+    size_t frameSize = 0;
+
+    // Frames that are the same as the one before are passed on without
+    // pixels and the sinks repeat their previous frame. A matching hash is
+    // confirmed against a copy of the previous frame.
+    bool deduplicate = false;
+    bool hasPreviousHash = false;
+    uint64_t previousHash = 0;
+    std::unique_ptr<uint8_t[]> previousFrame;
+    int64_t duplicateCount = 0;
 
-    void* pOpenH264Encoder = nullptr;
-    MP4E_mux_t* pMP4Muxer = nullptr;
-    mp4_h26x_writer_t* pMP4H264Writer = nullptr;
+    // The render thread copies each frame out of the readback buffer into
+    // rgbaPool, the converter thread turns it into I420 in yuvPool and the
+    // sinks' encoder threads write it out. Frames that need no conversion go
+    // from the render thread to the sinks directly, duplicates go through
+    // the queues with no data. Tiles are stitched into stitchPool for the
+    // sinks that take RGBA.
+    std::vector<std::unique_ptr<SinkWorker>> sinks;
+    FramePool rgbaPool;
+    FramePool yuvPool;
+    FramePool stitchPool;
+    BoundedQueue<PooledFrame> rgbaQueue;
+    std::thread converterThread;
 
+    int64_t backpressureCount = 0;
+    double backpressureMilliseconds = 0;
+
+    int64_t lostFrames = 0;
+    bool succeeded = false;
+
+   public:
+    ~RecordingSegment() { cleanup(); }
+
+    // Frames are bufferWidth x bufferHeight, split into tiles unless the
+    // grid has a single tile. Tiled frames are neither converted on the GPU
+    // nor deduplicated, and frames are only deduplicated if every sink can
+    // repeat one.
+    void start(int32_t bufferWidth, int32_t bufferHeight,
+               const TileGrid& tiles, bool gpuYuv, int32_t readbackDepth,
+               bool deduplicate,
+               std::vector<std::unique_ptr<VideoSink>> sinks);
+
+    // Reads the bound framebuffer as tile of frame currentFrame and writes
+    // out the frames whose readback has completed. The last tile of the
+    // last frame flushes and finalizes the files.
+    void update(bool isLastFrame, int64_t currentFrame, int32_t tile = 0);
+
+    void cleanup();
+
+    const ReadbackRing& getReadback() const;
+    int64_t getBackpressureCount() const;
+    double getBackpressureMilliseconds() const;
+    int64_t getDuplicateCount() const;
+
+    // Whether every file was encoded and finalized, once the last frame has
+    // been passed to update().
+    bool hasSucceeded() const;
+
+   private:
+    bool writeNextFrame(bool wait);
+    void writeOneFrame(const uint8_t* pixels, int64_t currentFrame);
+
+    void convertFrame(const uint8_t* rgbaBuffer, uint8_t* yuvBuffer) const;
+    void stitchTile(const uint8_t* rgbaBuffer, int32_t tile,
+                    uint8_t* rgbaFrame, uint8_t* yuvFrame) const;
+    bool addTile(const uint8_t* rgbaBuffer, int64_t tag);
+
+    // Passes a frame to every sink, in the format the sink takes.
+    void deliver(const SharedFrame& rgba, const SharedFrame& yuv);
+    void deliverDuplicate(int64_t frame);
+    void encodeFrame(SinkWorker& worker, const uint8_t* buffer,
+                     int64_t frame);
+    void runConverter();
+    void runStitcher();
+    void runEncoder(SinkWorker* worker);
+    void stopPipeline();
+    void finish();
+};
+
+// A file written by Recording. A size or bitrate of 0 is the recording's
+// own, smaller outputs are downscaled from the rendered frames.
+struct RecordingOutput {
+    std::string fileName;
     int32_t videoType = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t kbps = 0;
+};
+
+class Recording {
+   private:
+    struct Segment {
+        // Created when the segment is opened, none for a resumed one.
+        std::unique_ptr<RecordingSegment> writer;
+        // One file per output.
+        std::vector<std::string> fileNames;
+        int64_t firstFrame = 0;
+        int64_t endFrame = 0;
+        int64_t nextFrame = 0;
+    };
+
+    int32_t bufferWidth = 0;
+    int32_t bufferHeight = 0;
+
     bool isRecording = false;
 
-    FILE* fp = nullptr;
+    // The file passed to start() first, then the extra outputs.
+    std::vector<RecordingOutput> outputs;
+    std::vector<RecordingOutput> extraOutputs;
+
+    int32_t readbackDepth = 3;
+    unsigned long webmEncodeDeadline = 0;
+    WebmEncoderOptions webmOptions;
+    // The encoder options of each segment, with the cores shared out.
+    WebmEncoderOptions segmentWebmOptions;
+    GifEncoderOptions gifOptions;
+    bool gpuYuvRequested = false;
+    bool gpuYuv = false;
+    bool deduplicateFrames = true;
+
+    int32_t tileSizeRequested = 0;
+    TileGrid tiles;
+
+    int32_t segmentCountRequested = 1;
+    int64_t segmentedFrameCount = 0;
+    std::vector<Segment> segments;
+    size_t nextSegment = 0;
+
+    // Checkpointed recordings open segments in order as earlier ones
+    // finish, with at most activeSegmentCount open at once.
+    int64_t checkpointFrames = 0;
+    int32_t resumedCheckpoints = 0;
+    int32_t activeSegmentCount = 1;
+    size_t openedSegments = 0;
+    int32_t completedSegments = 0;
+    bool checkpointed = false;
+    bool resumable = false;
 
    public:
     bool getIsRecording();
@@ -34,12 +216,103 @@ class Recording {
                const int32_t webmBitrate,
                const unsigned long webmEncodeDeadline);
 
-    void update(bool isLastFrame, int64_t currentFrame, GLuint writeBuffer, GLuint readBuffer);
+    // Further files written from the same frames as the one passed to
+    // start(). Frames are rendered, read back and converted once, each file
+    // is encoded on its own thread. Applied on the next start().
+    void setExtraOutputs(const std::vector<RecordingOutput>& outputs);
+
+    // Reads the bound framebuffer as frame currentFrame, or as one tile of
+    // it, and writes out the frames whose readback has completed.
+    // isLastFrame ends a serial recording after its last tile, a segmented
+    // one ends after the last frame of each segment.
+    void update(bool isLastFrame, int64_t currentFrame, int32_t tile = 0);
+
+    // Splits the next recording into count time ranges of a frameCount
+    // frame export. Each range is encoded into its own file concurrently and
+    // the files are joined at the end. Frames have to be rendered in the
+    // order getNextFrame() gives.
+    void setSegments(int32_t count, int64_t frameCount);
+    int32_t getSegmentCount() const;
+
+    // The frame to render next, frame itself unless segmented.
+    int64_t getNextFrame(int64_t frame) const;
+
+    // Writes the next recording in segments of this many frames that are
+    // finished in order, up to setSegments()' count at a time, so that an
+    // interrupted export keeps the segments it finished. Needs the frame
+    // count of setSegments() and files that can be joined. 0 disables.
+    void setCheckpoints(int64_t frames);
+
+    // Whether the current recording is written in checkpoints.
+    bool isCheckpointed() const;
+
+    // Skips the first count segments of the next checkpointed recording,
+    // their files are left from an interrupted one.
+    void setResumedCheckpoints(int32_t count);
+
+    // Leading segments of the current checkpointed recording that are
+    // written in full, resumed ones included.
+    int32_t getCompletedCheckpoints() const;
+
+    // Whether the last checkpointed recording stopped with segments left on
+    // disk, either unfinished or not joined, that it can be resumed from.
+    bool isResumable() const;
+
+    // The files of the current recording, with their sizes and bitrates
+    // filled in.
+    const std::vector<RecordingOutput>& getOutputs() const;
+
+    // Number of frames that may be in flight between the GPU and the
+    // encoder, applied on the next start().
+    void setReadbackDepth(int32_t depth);
+    int32_t getReadbackDepth() const;
+
+    // Applied on the next start().
+    void setWebmEncoderOptions(const WebmEncoderOptions& options);
+    void setGifEncoderOptions(const GifEncoderOptions& options);
+
+    // Reads back I420 frames that were converted on the GPU instead of RGBA,
+    // applied on the next start(). The caller then binds the converted frame
+    // for update() while isGpuYuv() is true.
+    void setGpuYuvConversion(bool enabled);
+    bool isGpuYuv() const;
+
+    // Skips converting and encoding frames identical to the previous one,
+    // for the formats that can repeat a frame. Applied on the next start().
+    void setFrameDeduplication(bool enabled);
+    bool getFrameDeduplication() const;
+
+    // Renders frames in square tiles of this size, which must be even, so
+    // that no texture or viewport is larger than a tile. 0 renders whole
+    // frames. Applied on the next start(), a tiled recording is never
+    // segmented.
+    void setTileSize(int32_t size);
+
+    // Tiles of the current recording, the caller renders each tile of a
+    // frame with its offset and passes it to update().
+    const TileGrid& getTiles() const;
+
+    // Totals over all segments.
+    int64_t getReadbackStallCount() const;
+    double getReadbackStallMilliseconds() const;
+
+    // Times the render thread had to wait for a free frame buffer because
+    // the encoder fell behind.
+    int64_t getBackpressureCount() const;
+    double getBackpressureMilliseconds() const;
+
+    // Frames that were not encoded because they repeated the previous one.
+    int64_t getDuplicateFrameCount() const;
 
     void cleanup();
 
     ~Recording();
 
    private:
-    void writeOneFrame(const uint8_t* rgbaBuffer, int64_t currentFrame);
+    bool openSegment(Segment& segment);
+    bool finishSegment();
+    void finish();
+    bool joinSegments();
+    bool joinSegments(size_t output);
+    void removeSegmentFiles(bool keepFinished = false);
 };
@@ -0,0 +1,378 @@
+#include "replay_buffer.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// libyuv
+#include <libyuv.h>
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+#include "mymkvwriter.hpp"
+
+bool ReplayBuffer::start(int32_t sourceWidth, int32_t sourceHeight,
+                         const ReplayOptions& options) {
+    stop();
+
+    this->options = options;
+    this->sourceWidth = sourceWidth;
+    this->sourceHeight = sourceHeight;
+
+    // I420 needs even sizes.
+    const int32_t downscale = std::max(options.downscale, 1);
+    width = std::max(2, sourceWidth / downscale & ~1);
+    height = std::max(2, sourceHeight / downscale & ~1);
+
+    if (!initializeEncoder()) {
+        return false;
+    }
+
+    glGenRenderbuffers(1, &renderBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &frameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, renderBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    readback.initialize(width, height, ReadbackDepth);
+    framePool.initialize((size_t)width * height * 4, PoolSize);
+    frameQueue.reset(PoolSize);
+
+    startTime = -1.0;
+    nextCaptureTime = 0;
+    chunkFrameCount = 0;
+    droppedFrames = 0;
+
+    encoderThread = std::thread(&ReplayBuffer::runEncoder, this);
+    running = true;
+
+    AppLog::getInstance().info("Instant replay: keeping %d s at %dx%d\n",
+                               options.seconds, width, height);
+    return true;
+}
+
+bool ReplayBuffer::initializeEncoder() {
+    vpx_codec_iface_t* iface = vpx_codec_vp8_cx();
+
+    vpx_codec_err_t err = vpx_codec_enc_config_default(iface, &config, 0);
+    if (err == VPX_CODEC_OK) {
+        config.g_w = width;
+        config.g_h = height;
+        config.g_timebase.num = 1;
+        config.g_timebase.den = 1000;
+        config.rc_target_bitrate = options.kbps;
+        config.rc_end_usage = VPX_CBR;
+        // Each frame's packet has to come out as soon as it is encoded.
+        config.g_lag_in_frames = 0;
+        config.g_threads = 2;
+        // Keyframes are forced at the start of each chunk.
+        config.kf_mode = VPX_KF_DISABLED;
+
+        err = vpx_codec_enc_init(&codec, iface, &config, 0);
+    }
+
+    if (err != VPX_CODEC_OK) {
+        AppLog::getInstance().error("Could not start instant replay: %s\n",
+                                    vpx_codec_err_to_string(err));
+        return false;
+    }
+
+    // The replay shares the CPU with the preview, speed over quality.
+    vpx_codec_control(&codec, VP8E_SET_CPUUSED, 8);
+
+    image = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, width, height, 1);
+    if (image == nullptr) {
+        AppLog::getInstance().error(
+            "Could not allocate instant replay image\n");
+        vpx_codec_destroy(&codec);
+        return false;
+    }
+    return true;
+}
+
+void ReplayBuffer::stop() {
+    if (saveThread.joinable()) {
+        saveThread.join();
+    }
+
+    if (!running) {
+        return;
+    }
+    running = false;
+
+    frameQueue.close();
+    if (encoderThread.joinable()) {
+        encoderThread.join();
+    }
+
+    readback.cleanup();
+    framePool.cleanup();
+
+    vpx_codec_destroy(&codec);
+    vpx_img_free(image);
+    image = nullptr;
+
+    glDeleteFramebuffers(1, &frameBuffer);
+    frameBuffer = 0;
+    glDeleteRenderbuffers(1, &renderBuffer);
+    renderBuffer = 0;
+
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    chunks.clear();
+    bufferedBytes = 0;
+}
+
+bool ReplayBuffer::isRunning() const { return running; }
+
+int32_t ReplayBuffer::getSourceWidth() const { return sourceWidth; }
+
+int32_t ReplayBuffer::getSourceHeight() const { return sourceHeight; }
+
+const ReplayOptions& ReplayBuffer::getOptions() const { return options; }
+
+void ReplayBuffer::capture(GLuint sourceFrameBuffer, int32_t renderWidth,
+                           int32_t renderHeight, double time) {
+    if (!running) {
+        return;
+    }
+
+    PROFILE_SCOPE("ReplayBuffer::capture");
+
+    drainReadback();
+
+    if (startTime < 0) {
+        startTime = time;
+        nextCaptureTime = time;
+    }
+
+    if (time < nextCaptureTime) {
+        return;
+    }
+
+    // After a slow frame the next capture is a full interval later, not
+    // immediately.
+    nextCaptureTime += 1.0 / FramesPerSecond;
+    if (nextCaptureTime <= time) {
+        nextCaptureTime = time + 1.0 / FramesPerSecond;
+    }
+
+    if (readback.isFull()) {
+        droppedFrames++;
+        return;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFrameBuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+    glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    readback.read(llround((time - startTime) * 1000.0));
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ReplayBuffer::drainReadback() {
+    const uint8_t* pixels = nullptr;
+    int64_t timestamp = 0;
+
+    while (readback.acquire(false, pixels, timestamp)) {
+        PooledFrame frame;
+        frame.frame = timestamp;
+
+        // The queue holds as many frames as the pool, so the push never
+        // blocks.
+        if (framePool.tryAcquire(frame)) {
+            memcpy(frame.data.get(), pixels, framePool.getFrameSize());
+            frameQueue.push(std::move(frame));
+        } else {
+            droppedFrames++;
+        }
+
+        readback.release();
+    }
+}
+
+void ReplayBuffer::runEncoder() {
+    CpuProfiler::getInstance().setThreadName("replay");
+
+    PooledFrame frame;
+    while (frameQueue.pop(frame)) {
+        encodeFrame(frame);
+        framePool.release(frame);
+    }
+}
+
+void ReplayBuffer::encodeFrame(const PooledFrame& frame) {
+    PROFILE_SCOPE("ReplayBuffer::encodeFrame");
+
+    // Read back frames are bottom-up.
+    libyuv::ABGRToI420(frame.data.get(), width * 4, image->planes[0],
+                       image->stride[0], image->planes[1], image->stride[1],
+                       image->planes[2], image->stride[2], width, -height);
+
+    const vpx_enc_frame_flags_t flags =
+        chunkFrameCount == 0 ? VPX_EFLAG_FORCE_KF : 0;
+    chunkFrameCount = (chunkFrameCount + 1) % ChunkFrames;
+
+    const vpx_codec_err_t err =
+        vpx_codec_encode(&codec, image, frame.frame, 1000 / FramesPerSecond,
+                         flags, VPX_DL_REALTIME);
+    if (err != VPX_CODEC_OK) {
+        droppedFrames++;
+        return;
+    }
+
+    vpx_codec_iter_t iter = NULL;
+    const vpx_codec_cx_pkt_t* packet;
+    while ((packet = vpx_codec_get_cx_data(&codec, &iter)) != NULL) {
+        if (packet->kind == VPX_CODEC_CX_FRAME_PKT) {
+            addPacket(packet);
+        }
+    }
+}
+
+void ReplayBuffer::addPacket(const vpx_codec_cx_pkt_t* packet) {
+    Packet item;
+    const uint8_t* data = static_cast<const uint8_t*>(packet->data.frame.buf);
+    item.data.assign(data, data + packet->data.frame.sz);
+    item.timestamp = packet->data.frame.pts;
+    item.key = (packet->data.frame.flags & VPX_FRAME_IS_KEY) != 0;
+
+    std::lock_guard<std::mutex> lock(chunkMutex);
+
+    if (item.key) {
+        chunks.emplace_back();
+    } else if (chunks.empty()) {
+        // Cannot be decoded without the keyframe before it.
+        return;
+    }
+
+    chunks.back().bytes += item.data.size();
+    bufferedBytes += item.data.size();
+    chunks.back().packets.push_back(std::move(item));
+
+    trimChunks();
+}
+
+void ReplayBuffer::trimChunks() {
+    const int64_t newest = chunks.back().packets.back().timestamp;
+    const int64_t length = options.seconds * 1000LL;
+    const size_t maxBytes = (size_t)options.memoryMegabytes * 1024 * 1024;
+
+    // The oldest chunk goes once the ones after it cover the length on
+    // their own, or when over the memory limit.
+    while (chunks.size() > 1) {
+        const bool covered =
+            newest - chunks[1].packets.front().timestamp >= length;
+        if (!covered && bufferedBytes <= maxBytes) {
+            break;
+        }
+
+        bufferedBytes -= chunks.front().bytes;
+        chunks.pop_front();
+    }
+}
+
+bool ReplayBuffer::save(const std::string& fileName) {
+    if (saving) {
+        AppLog::getInstance().error("An instant replay is still being saved\n");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        if (chunks.empty()) {
+            AppLog::getInstance().error("Instant replay is still empty\n");
+            return false;
+        }
+    }
+
+    if (saveThread.joinable()) {
+        saveThread.join();
+    }
+
+    saving = true;
+    saveThread = std::thread(&ReplayBuffer::writeWebm, this, fileName);
+    return true;
+}
+
+bool ReplayBuffer::isSaving() const { return saving; }
+
+void ReplayBuffer::writeWebm(const std::string& fileName) {
+    CpuProfiler::getInstance().setThreadName("replay save");
+    PROFILE_SCOPE("ReplayBuffer::writeWebm");
+
+    // Copied so that the encoder only waits for the copy, not the write.
+    std::vector<Chunk> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        snapshot.assign(chunks.begin(), chunks.end());
+    }
+
+    MyMkvWriter writer(fileName);
+    mkvmuxer::Segment segment;
+    const bool initialized = writer.IsOpen() && segment.Init(&writer);
+    segment.set_mode(mkvmuxer::Segment::Mode::kFile);
+    bool ok = initialized;
+
+    // Tracks default to VP8.
+    const uint64_t track = ok ? segment.AddVideoTrack(width, height, 1) : 0;
+    ok = ok && track != 0;
+
+    const int64_t first = snapshot.front().packets.front().timestamp;
+    const int64_t last = snapshot.back().packets.back().timestamp;
+    const uint64_t duration = 1000000000ULL / FramesPerSecond;
+
+    for (const Chunk& chunk : snapshot) {
+        for (const Packet& packet : chunk.packets) {
+            if (!ok) {
+                break;
+            }
+
+            mkvmuxer::Frame frame;
+            ok = frame.Init(packet.data.data(), packet.data.size());
+            frame.set_track_number(track);
+            frame.set_timestamp((packet.timestamp - first) * 1000000ULL);
+            frame.set_is_key(packet.key);
+            frame.set_duration(duration);
+            ok = ok && segment.AddGenericFrame(&frame);
+        }
+    }
+
+    if (initialized) {
+        ok = segment.Finalize() && ok;
+        ok = writer.Notify() && ok;
+    }
+
+    if (ok) {
+        AppLog::getInstance().info("Saved %.1f s of instant replay to %s\n",
+                                   (last - first) / 1000.0, fileName.c_str());
+    } else {
+        AppLog::getInstance().error("Could not save instant replay to %s\n",
+                                    fileName.c_str());
+    }
+
+    saving = false;
+}
+
+double ReplayBuffer::getBufferedSeconds() const {
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    if (chunks.empty()) {
+        return 0.0;
+    }
+    return (chunks.back().packets.back().timestamp -
+            chunks.front().packets.front().timestamp) /
+           1000.0;
+}
+
+size_t ReplayBuffer::getBufferedBytes() const {
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    return bufferedBytes;
+}
+
+int64_t ReplayBuffer::getDroppedFrames() const { return droppedFrames; }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// libvpx
+#include <vpx/vp8cx.h>
+#include <vpx/vpx_encoder.h>
+
+#include "common.hpp"
+#include "bounded_queue.hpp"
+#include "frame_pool.hpp"
+#include "readback_ring.hpp"
+
+struct ReplayOptions {
+    // Length of the preview that is kept.
+    int32_t seconds = 30;
+    // The preview is captured at 1/downscale of the window size.
+    int32_t downscale = 2;
+    int32_t kbps = 4000;
+    // Upper bound of the encoded video held, older chunks are dropped first
+    // even if that leaves less than seconds.
+    int32_t memoryMegabytes = 64;
+};
+
+// Instant replay: keeps the last few seconds of the preview as VP8 in
+// memory so that a moment seen while editing can be saved afterwards.
+//
+// The render thread only blits each frame to a smaller target and starts an
+// asynchronous readback of it. Frames are encoded on a worker thread into
+// chunks that each start with a keyframe, the ring drops whole chunks from
+// the front. Nothing on the render thread waits: frames are dropped when
+// the readback or the encoder falls behind.
+class ReplayBuffer {
+   private:
+    static const int32_t FramesPerSecond = 30;
+    // A keyframe every second, the ring is trimmed in steps of that.
+    static const int32_t ChunkFrames = FramesPerSecond;
+    static const int32_t ReadbackDepth = 3;
+    static const int32_t PoolSize = 3;
+
+    struct Packet {
+        std::vector<uint8_t> data;
+        // Milliseconds since start().
+        int64_t timestamp = 0;
+        bool key = false;
+    };
+
+    struct Chunk {
+        std::vector<Packet> packets;
+        size_t bytes = 0;
+    };
+
+    ReplayOptions options;
+    int32_t sourceWidth = 0;
+    int32_t sourceHeight = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    bool running = false;
+
+    GLuint frameBuffer = 0;
+    GLuint renderBuffer = 0;
+    ReadbackRing readback;
+    double startTime = 0;
+    double nextCaptureTime = 0;
+
+    // Read back frames go to the encoder thread, PooledFrame::frame holds
+    // their timestamp.
+    FramePool framePool;
+    BoundedQueue<PooledFrame> frameQueue;
+    std::thread encoderThread;
+
+    vpx_codec_ctx_t codec;
+    vpx_codec_enc_cfg_t config;
+    vpx_image_t* image = nullptr;
+    int32_t chunkFrameCount = 0;
+
+    mutable std::mutex chunkMutex;
+    // The last chunk is the one being encoded into.
+    std::deque<Chunk> chunks;
+    size_t bufferedBytes = 0;
+
+    std::thread saveThread;
+    std::atomic<bool> saving{false};
+
+    std::atomic<int64_t> droppedFrames{0};
+
+    bool initializeEncoder();
+    void runEncoder();
+    void encodeFrame(const PooledFrame& frame);
+    void addPacket(const vpx_codec_cx_pkt_t* packet);
+    void trimChunks();
+    void drainReadback();
+    void writeWebm(const std::string& fileName);
+
+   public:
+    ~ReplayBuffer() { stop(); }
+
+    // Starts capturing a preview of sourceWidth x sourceHeight, the buffer
+    // is emptied. Fails if the encoder cannot be created.
+    bool start(int32_t sourceWidth, int32_t sourceHeight,
+               const ReplayOptions& options);
+    void stop();
+
+    bool isRunning() const;
+    int32_t getSourceWidth() const;
+    int32_t getSourceHeight() const;
+    const ReplayOptions& getOptions() const;
+
+    // Called with each presented frame, the renderWidth x renderHeight
+    // region of sourceFrameBuffer is scaled to the capture size. Frames
+    // come in at most at 30 fps, time is in seconds.
+    void capture(GLuint sourceFrameBuffer, int32_t renderWidth,
+                 int32_t renderHeight, double time);
+
+    // Writes what is buffered as a WebM file on a background thread. Fails
+    // if nothing is buffered yet or a save is still running.
+    bool save(const std::string& fileName);
+    bool isSaving() const;
+
+    double getBufferedSeconds() const;
+    size_t getBufferedBytes() const;
+    int64_t getDroppedFrames() const;
+};
@@ -0,0 +1,84 @@
+#include "scaled_sink.hpp"
+
+#include <libyuv.h>
+
+#include "cpu_profiler.hpp"
+
+ScaledSink::ScaledSink(int32_t width, int32_t height, int32_t outputWidth,
+                       int32_t outputHeight, std::unique_ptr<VideoSink> sink)
+    : VideoSink(width, height),
+      sink(std::move(sink)),
+      outputWidth(outputWidth),
+      outputHeight(outputHeight) {
+    const size_t size =
+        this->sink->acceptsRgba()
+            ? (size_t)outputWidth * outputHeight * 4
+            : getI420FrameSize(outputWidth, outputHeight);
+    scaled = std::make_unique<uint8_t[]>(size);
+}
+
+void ScaledSink::reserve(int64_t frameCount) { sink->reserve(frameCount); }
+
+bool ScaledSink::acceptsRgba() const { return sink->acceptsRgba(); }
+
+bool ScaledSink::writeFrame(const uint8_t* pixels, int64_t frame) {
+    PROFILE_SCOPE("ScaledSink::writeFrame");
+
+    // Box filtering averages every source pixel, downscaling does not
+    // alias.
+    if (sink->acceptsRgba()) {
+        libyuv::ARGBScale(pixels, width * 4, width, height, scaled.get(),
+                          outputWidth * 4, outputWidth, outputHeight,
+                          libyuv::kFilterBox);
+    } else {
+        const int32_t uStride = getI420ChromaWidth(width);
+        const uint8_t* yPlane = pixels;
+        const uint8_t* uPlane = yPlane + (size_t)width * height;
+        const uint8_t* vPlane =
+            uPlane + (size_t)uStride * getI420ChromaHeight(height);
+
+        const int32_t outputUStride = getI420ChromaWidth(outputWidth);
+        uint8_t* outputYPlane = scaled.get();
+        uint8_t* outputUPlane =
+            outputYPlane + (size_t)outputWidth * outputHeight;
+        uint8_t* outputVPlane =
+            outputUPlane +
+            (size_t)outputUStride * getI420ChromaHeight(outputHeight);
+
+        libyuv::I420Scale(yPlane, width, uPlane, uStride, vPlane, uStride,
+                          width, height, outputYPlane, outputWidth,
+                          outputUPlane, outputUStride, outputVPlane,
+                          outputUStride, outputWidth, outputHeight,
+                          libyuv::kFilterBox);
+    }
+
+    if (!sink->writeFrame(scaled.get(), frame)) {
+        last_error = sink->lastError();
+        return false;
+    }
+    return true;
+}
+
+bool ScaledSink::acceptsDuplicateFrames() const {
+    return sink->acceptsDuplicateFrames();
+}
+
+bool ScaledSink::writeDuplicateFrame(int64_t frame) {
+    if (!sink->writeDuplicateFrame(frame)) {
+        last_error = sink->lastError();
+        return false;
+    }
+    return true;
+}
+
+void ScaledSink::setDuplicateFrames(bool enabled) {
+    sink->setDuplicateFrames(enabled);
+}
+
+bool ScaledSink::finalize() {
+    if (!sink->finalize()) {
+        last_error = sink->lastError();
+        return false;
+    }
+    return true;
+}
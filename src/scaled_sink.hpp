@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+
+#include "video_sink.hpp"
+
+// Feeds a sink of a smaller size, for a ladder of renditions rendered once.
+// Frames are scaled on the encoder thread that writes them, so every rung
+// of the ladder scales and encodes in parallel with the others.
+class ScaledSink : public VideoSink {
+   private:
+    std::unique_ptr<VideoSink> sink;
+    int32_t outputWidth = 0;
+    int32_t outputHeight = 0;
+    std::unique_ptr<uint8_t[]> scaled;
+
+   public:
+    // Frames of width x height are scaled to outputWidth x outputHeight,
+    // the size sink was created with, in the format sink takes.
+    ScaledSink(int32_t width, int32_t height, int32_t outputWidth,
+               int32_t outputHeight, std::unique_ptr<VideoSink> sink);
+
+    void reserve(int64_t frameCount) override;
+    bool acceptsRgba() const override;
+    bool writeFrame(const uint8_t* pixels, int64_t frame) override;
+    bool acceptsDuplicateFrames() const override;
+    bool writeDuplicateFrame(int64_t frame) override;
+    void setDuplicateFrames(bool enabled) override;
+    bool finalize() override;
+};
@@ -15,6 +15,8 @@
 
 #include "../SPIRV-Cross/spirv_glsl.hpp"
 
+#include "cpu_profiler.hpp"
+
 namespace {
 const char *const TemplateFileName = "<template>";
 
@@ -74,6 +76,8 @@ namespace shader_compiler {
 void validate(EShLanguage shaderStage, bool isGlslEs,
               const std::string &sourceFileName,
               const std::string &sourceFileText, ValidateResult &result) {
+    PROFILE_SCOPE("shader_compiler::validate");
+
     std::string entryPoint = "main";
     std::map<std::string, std::string> defines;
     bool isHlsl = false;
@@ -203,6 +207,8 @@ void compile(EShLanguage shaderStage, int32_t version, bool isGlslEs,
              const std::string &sourceFileName,
              const std::string &sourceFileText,
              const std::string &templateFileText, CompileResult &result) {
+    PROFILE_SCOPE("shader_compiler::compile");
+
     std::string entryPoint = "main";
     std::map<std::string, std::string> defines;
     bool disableSourceCode = false;
@@ -321,8 +327,12 @@ void compile(EShLanguage shaderStage, int32_t version, bool isGlslEs,
     }
 
     auto includer = Includer(sourceFileName, sourceFileText);
-    isCompiled = shader->parse(&glslang::DefaultTBuiltInResource,
-                               isGlslEs ? 100 : 110, false, messages, includer);
+    {
+        PROFILE_SCOPE("glslang parse");
+        isCompiled =
+            shader->parse(&glslang::DefaultTBuiltInResource,
+                          isGlslEs ? 100 : 110, false, messages, includer);
+    }
     const auto &dependencies = includer.getDependencies();
 
     setStringIfNotNull(shaderLog, shader->getInfoLog());
@@ -331,7 +341,10 @@ void compile(EShLanguage shaderStage, int32_t version, bool isGlslEs,
     if (isCompiled) {
         program->addShader(shader);
 
-        isLinked = program->link(messages) && program->mapIO();
+        {
+            PROFILE_SCOPE("glslang link");
+            isLinked = program->link(messages) && program->mapIO();
+        }
 
         setStringIfNotNull(programLog, program->getInfoLog());
         setStringIfNotNull(programDebugLog, program->getInfoDebugLog());
@@ -339,6 +352,8 @@ void compile(EShLanguage shaderStage, int32_t version, bool isGlslEs,
         if (isLinked) {
             for (int stage = 0; stage < EShLangCount; ++stage) {
                 if (program->getIntermediate((EShLanguage)stage)) {
+                    PROFILE_SCOPE("GlslangToSpv");
+
                     std::string warningsErrors;
                     spv::SpvBuildLogger logger;
                     glslang::SpvOptions spvOptions;
@@ -371,6 +386,8 @@ void compile(EShLanguage shaderStage, int32_t version, bool isGlslEs,
     glslang::FinalizeProcess();
 
     if (isCompiled && isLinked && !disableSourceCode) {
+        PROFILE_SCOPE("SPIRV-Cross");
+
         spirv_cross::CompilerGLSL glsl(std::move(spirv));
         spirv_cross::ShaderResources resources = glsl.get_shader_resources();
 
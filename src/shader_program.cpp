@@ -5,7 +5,9 @@
 #include "shader_program.hpp"
 #include "shader_compiler.hpp"
 #include "default_shader.hpp"
+#include "cpu_profiler.hpp"
 
+#include <chrono>
 #include <regex>
 #include <sstream>
 
@@ -18,6 +20,10 @@ const bool IsGlslEs = true;
 const int32_t TargetShaderVersion = 420;
 const bool IsGlslEs = false;
 #endif
+
+// Every successfully linked program gets a unique serial, GL program names
+// may be recycled once the previous program has been deleted.
+uint64_t programSerial = 0;
 }  // namespace
 
 namespace shader_editor {
@@ -111,6 +117,11 @@ bool Shader::compile(int32_t targetVersion, bool isGlslEs) {
         return false;
     }
 
+    // Tiled exports move each tile to its place in the whole frame.
+    if (type == GL_FRAGMENT_SHADER) {
+        compiledSource = addFragCoordOffset(compiledSource, IsGlslEs);
+    }
+
     shader = glCreateShader(type);
     const char *const pCompiledSource = compiledSource.c_str();
 
@@ -396,6 +407,11 @@ bool ShaderProgram::containsUniform(const std::string &name) const {
     return uniforms.count(name) != 0;
 }
 
+bool ShaderProgram::isUniformActive(const std::string &name) const {
+    auto it = uniforms.find(name);
+    return it != uniforms.end() && it->second.location >= 0;
+}
+
 const ShaderUniform &ShaderProgram::getUniform(const std::string &name) const {
     const ShaderUniform &u = uniforms.at(name);
     return u;
@@ -484,6 +500,7 @@ void ShaderProgram::reset() {
     uniforms.clear();
     compileTime = 0;
     program = 0;
+    serial = 0;
     error = "";
     ok = false;
 }
@@ -509,6 +526,8 @@ void ShaderProgram::setCompileInfo(const std::string &vsPath,
 }
 
 GLuint ShaderProgram::compile() {
+    PROFILE_SCOPE("ShaderProgram::compile");
+
     if (program != 0) {
         glDeleteProgram(program);
         program = 0;
@@ -518,7 +537,8 @@ GLuint ShaderProgram::compile() {
                                vertexShader.getPath().c_str(),
                                fragmentShader.getPath().c_str());
 
-    double t0 = glfwGetTime();
+    // Not glfwGetTime(), GLFW is not initialized when running headless.
+    const auto t0 = std::chrono::steady_clock::now();
 
     if (!vertexShader.compile(TargetShaderVersion, IsGlslEs)) {
         const auto &errors = vertexShader.getErrors();
@@ -553,11 +573,14 @@ GLuint ShaderProgram::compile() {
     }
 
     ok = true;
+    serial = ++programSerial;
 
     loadAttributes();
     loadUniforms();
 
-    compileTime = glfwGetTime() - t0;
+    compileTime = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - t0)
+                      .count();
 
     AppLog::getInstance().info("(%s, %s): Program linking ok (%.2fs)\n",
                                vertexShader.getPath().c_str(),
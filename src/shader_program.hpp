@@ -126,6 +126,7 @@ class ShaderProgram {
     Shader vertexShader;
     Shader fragmentShader;
     GLuint program = 0;
+    uint64_t serial = 0;
     double compileTime = 0;
     std::string error = "";
 
@@ -162,6 +163,7 @@ class ShaderProgram {
     void applyAttributes();
 
     bool containsUniform(const std::string &name) const;
+    bool isUniformActive(const std::string &name) const;
     const ShaderUniform &getUniform(const std::string &name) const;
     void setUniformValue(const std::string &name,
                          const ShaderUniformValue &value);
@@ -183,6 +185,7 @@ class ShaderProgram {
 
     void reset();
     GLuint getProgram() const { return program; }
+    uint64_t getSerial() const { return serial; }
     const Shader &getVertexShader() const { return vertexShader; }
     const Shader &getFragmentShader() const { return fragmentShader; }
     bool isOK() const { return ok; }
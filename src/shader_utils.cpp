@@ -133,3 +133,116 @@ void recompileShaderFromFile(const shader_editor::PShaderProgram program,
 
     newProgram->compile(vsPath, fsPath, vsSource, fsSource, vsTime, fsTime);
 }
+
+const char* const FragCoordOffsetUniform = "fragCoordOffset";
+
+namespace {
+bool isIdentifierChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+// Offset of the first character of code that is not a preprocessor
+// directive, a comment or inside a conditional block.
+size_t findFirstCode(const std::string& source) {
+    const size_t size = source.size();
+    int32_t depth = 0;
+    bool lineStart = true;
+    bool inDirective = false;
+
+    for (size_t i = 0; i < size; i++) {
+        const char c = source[i];
+        const char next = i + 1 < size ? source[i + 1] : '\0';
+
+        if (c == '/' && next == '*') {
+            const size_t end = source.find("*/", i + 2);
+            if (end == std::string::npos) {
+                break;
+            }
+            i = end + 1;
+            continue;
+        }
+        if (c == '/' && next == '/') {
+            const size_t end = source.find('\n', i);
+            if (end == std::string::npos) {
+                break;
+            }
+            i = end - 1;
+            continue;
+        }
+        if (c == '\n') {
+            // Directives go on past escaped line breaks.
+            const bool escaped =
+                (i > 0 && source[i - 1] == '\\') ||
+                (i > 1 && source[i - 1] == '\r' && source[i - 2] == '\\');
+            inDirective = inDirective && escaped;
+            lineStart = !inDirective;
+            continue;
+        }
+        if (inDirective || c == ' ' || c == '\t' || c == '\r') {
+            continue;
+        }
+
+        if (lineStart && c == '#') {
+            inDirective = true;
+
+            size_t j = i + 1;
+            while (j < size && (source[j] == ' ' || source[j] == '\t')) {
+                j++;
+            }
+            size_t k = j;
+            while (k < size && isIdentifierChar(source[k])) {
+                k++;
+            }
+            const std::string name = source.substr(j, k - j);
+            if (name == "if" || name == "ifdef" || name == "ifndef") {
+                depth++;
+            } else if (name == "endif") {
+                depth--;
+            }
+            continue;
+        }
+
+        lineStart = false;
+        if (depth <= 0) {
+            return i;
+        }
+    }
+
+    return std::string::npos;
+}
+}  // namespace
+
+std::string addFragCoordOffset(const std::string& source, bool isGlslEs) {
+    const std::string builtin = "gl_FragCoord";
+    if (source.find(builtin) == std::string::npos) {
+        return source;
+    }
+
+    const size_t declarationAt = findFirstCode(source);
+    if (declarationAt == std::string::npos) {
+        return source;
+    }
+
+    const std::string offset = FragCoordOffsetUniform;
+    std::string result = source.substr(0, declarationAt);
+    result += isGlslEs ? "uniform highp vec2 " : "uniform vec2 ";
+    result += offset + "; ";
+
+    const std::string replacement =
+        "(" + builtin + " + vec4(" + offset + ", 0.0, 0.0))";
+    size_t from = declarationAt;
+    for (size_t at = source.find(builtin, from); at != std::string::npos;
+         at = source.find(builtin, from)) {
+        const size_t end = at + builtin.size();
+        const bool whole = (at == 0 || !isIdentifierChar(source[at - 1])) &&
+                           (end == source.size() ||
+                            !isIdentifierChar(source[end]));
+        result.append(source, from, at - from);
+        result += whole ? replacement : builtin;
+        from = end;
+    }
+    result.append(source, from, std::string::npos);
+
+    return result;
+}
@@ -9,3 +9,14 @@ GLint checkLinked(GLuint program, std::string& error);
 
 GLint checkCompiled(GLuint shader);
 GLint checkCompiled(GLuint shader, std::string& error);
+
+// Uniform declared by addFragCoordOffset().
+extern const char* const FragCoordOffsetUniform;
+
+// Adds the vec2 uniform FragCoordOffsetUniform to every read of
+// gl_FragCoord in a fragment shader, so that an export split into tiles can
+// render each tile with the coordinates it has in the whole frame. The
+// uniform is declared in front of the first line of code outside any #if,
+// on the same line, so compile errors keep their line numbers. Returns the
+// source unchanged when it does not read gl_FragCoord.
+std::string addFragCoordOffset(const std::string& source, bool isGlslEs);
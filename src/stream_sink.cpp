@@ -0,0 +1,232 @@
+#include "stream_sink.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string.h>
+
+#if !defined(_MSC_VER) && !defined(__MINGW32__) && !defined(__EMSCRIPTEN__)
+#define STREAM_SINK_SUPPORTED
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+
+namespace {
+const char* const FifoPrefix = "fifo:";
+const char* const UnixSocketPrefix = "unix:";
+
+bool hasPrefix(const std::string& target, const char* prefix) {
+    return target.compare(0, strlen(prefix), prefix) == 0;
+}
+}  // namespace
+
+bool StreamSink::isStreamTarget(const std::string& target) {
+    return target == "-" || hasPrefix(target, FifoPrefix) ||
+           hasPrefix(target, UnixSocketPrefix);
+}
+
+StreamSink::~StreamSink() {
+#ifdef STREAM_SINK_SUPPORTED
+    if (fd > STDOUT_FILENO) {
+        close(fd);
+    }
+#endif
+}
+
+bool StreamSink::open(const std::string& target) {
+#ifdef STREAM_SINK_SUPPORTED
+    this->target = target;
+
+    // A reader that goes away should fail the write, not kill the app.
+    signal(SIGPIPE, SIG_IGN);
+
+    bool ok = false;
+    if (target == "-") {
+        AppLog::getInstance().setConsoleStderr(true);
+        std::cout.flush();
+        fd = STDOUT_FILENO;
+        ok = true;
+    } else if (hasPrefix(target, FifoPrefix)) {
+        ok = openFifo(target.substr(strlen(FifoPrefix)));
+    } else if (hasPrefix(target, UnixSocketPrefix)) {
+        ok = openSocket(target.substr(strlen(UnixSocketPrefix)));
+    } else {
+        last_error = "Unknown stream target " + target;
+    }
+
+    if (!ok) {
+        return false;
+    }
+
+    lastFrame = std::make_unique<uint8_t[]>(getFrameSize());
+
+    if (rgba) {
+        AppLog::getInstance().info(
+            "Streaming raw RGBA %dx%d at 30000/1001 fps to %s\n", width,
+            height, target.c_str());
+        return true;
+    }
+
+    const std::string header = getY4mHeader(width, height);
+    if (!writeAll(header.data(), header.size())) {
+        last_error = "Could not write stream header";
+        return false;
+    }
+    return true;
+#else
+    last_error = "Streaming is not supported on this platform";
+    return false;
+#endif
+}
+
+bool StreamSink::openFifo(const std::string& path) {
+#ifdef STREAM_SINK_SUPPORTED
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        if (mkfifo(path.c_str(), 0644) != 0) {
+            last_error = "Could not create named pipe " + path;
+            return false;
+        }
+    } else if (!S_ISFIFO(st.st_mode)) {
+        last_error = path + " is not a named pipe";
+        return false;
+    }
+
+    // Opening a pipe for writing blocks until there is a reader.
+    fd = ::open(path.c_str(), O_WRONLY | O_NONBLOCK);
+    if (fd < 0 && errno == ENXIO) {
+        AppLog::getInstance().info("Waiting for a reader on %s\n",
+                                   path.c_str());
+        fd = ::open(path.c_str(), O_WRONLY);
+    }
+
+    if (fd < 0) {
+        last_error = "Could not open named pipe " + path;
+        return false;
+    }
+
+    // Writes should block, that is how the reader slows the export down.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool StreamSink::openSocket(const std::string& path) {
+#ifdef STREAM_SINK_SUPPORTED
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        last_error = "Socket path is too long: " + path;
+        return false;
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        last_error = "Could not create socket";
+        return false;
+    }
+
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) != 0) {
+        last_error = "Could not connect to " + path;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool StreamSink::writeAll(const void* data, size_t size) {
+#ifdef STREAM_SINK_SUPPORTED
+    PROFILE_SCOPE("StreamSink::writeAll");
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    while (size > 0) {
+        const ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= written;
+        bytesWritten += written;
+    }
+
+    writeMilliseconds += std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - t0)
+                             .count();
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t StreamSink::getFrameSize() const {
+    return rgba ? (size_t)width * height * 4 : getI420FrameSize(width, height);
+}
+
+bool StreamSink::writeLastFrame() {
+    const bool ok =
+        rgba ? writeAll(lastFrame.get(), getFrameSize())
+             : writeAll("FRAME\n", strlen("FRAME\n")) &&
+                   writeAll(lastFrame.get(), getFrameSize());
+
+    if (!ok) {
+        last_error = "Could not write to " + target + ": " + strerror(errno);
+    }
+    return ok;
+}
+
+bool StreamSink::writeFrame(const uint8_t* pixels, int64_t frame) {
+    if (rgba) {
+        // Read back frames are bottom-up.
+        libyuv::ARGBCopy(pixels, width * 4, lastFrame.get(), width * 4, width,
+                         -height);
+    } else {
+        memcpy(lastFrame.get(), pixels, getFrameSize());
+    }
+    return writeLastFrame();
+}
+
+bool StreamSink::writeDuplicateFrame(int64_t frame) {
+    // The reader expects every frame, the previous one is sent again.
+    return writeLastFrame();
+}
+
+bool StreamSink::finalize() {
+    bool ok = true;
+
+#ifdef STREAM_SINK_SUPPORTED
+    if (fd > STDOUT_FILENO) {
+        ok = close(fd) == 0;
+    }
+    fd = -1;
+#endif
+
+    // Time spent in write() is time the reader kept the export waiting.
+    const double megabytes = bytesWritten / (1024.0 * 1024.0);
+    AppLog::getInstance().info(
+        "Stream %s: wrote %.1f MB, %.1f ms blocked on the reader\n",
+        target.c_str(), megabytes, writeMilliseconds);
+
+    if (!ok) {
+        last_error = "Could not close " + target;
+    }
+    return ok;
+}
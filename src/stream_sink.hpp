@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "video_sink.hpp"
+
+// Streams uncompressed frames to another local process instead of a file.
+// Targets are "-" for stdout, "fifo:PATH" for a named pipe (created if it
+// does not exist) and "unix:PATH" for a listening Unix domain socket. Frames
+// are Y4M, or raw top-down RGBA without any header.
+//
+// Writes block while the reader is behind. The recording pipeline's bounded
+// queues then fill up and pass the backpressure on to the renderer.
+class StreamSink : public VideoSink {
+   private:
+    int fd = -1;
+    bool rgba = false;
+    std::string target;
+    // The last frame as it was written, top-down RGBA or I420, for
+    // duplicates.
+    std::unique_ptr<uint8_t[]> lastFrame;
+
+    int64_t bytesWritten = 0;
+    double writeMilliseconds = 0;
+
+    size_t getFrameSize() const;
+    bool writeAll(const void* data, size_t size);
+    bool writeLastFrame();
+    bool openFifo(const std::string& path);
+    bool openSocket(const std::string& path);
+
+   public:
+    StreamSink(int32_t width, int32_t height, bool rgba)
+        : VideoSink(width, height), rgba(rgba) {}
+    ~StreamSink();
+
+    static bool isStreamTarget(const std::string& target);
+
+    bool open(const std::string& target);
+    bool acceptsRgba() const override { return rgba; }
+    bool writeFrame(const uint8_t* pixels, int64_t frame) override;
+    bool acceptsDuplicateFrames() const override { return true; }
+    bool writeDuplicateFrame(int64_t frame) override;
+    bool finalize() override;
+};
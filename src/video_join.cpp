@@ -0,0 +1,229 @@
+#include "video_join.hpp"
+
+#include <memory>
+
+#include <mkvmuxer.hpp>
+#include <mkvparser.hpp>
+#include <mkvreader.hpp>
+
+#include "app_log.hpp"
+#include "cpu_profiler.hpp"
+#include "mp4muxer.h"
+#include "mymkvwriter.hpp"
+
+namespace {
+// Same frame duration as WebmEncoder at a 1001/30000 timebase.
+const uint64_t WebmFrameDuration = 1000000000ULL * 1001 / 30000;
+
+bool copyWebmFrames(const std::string& part, uint64_t offset,
+                    mkvmuxer::Segment& output, uint64_t& track,
+                    int32_t width, int32_t height,
+                    std::vector<uint8_t>& buffer) {
+    mkvparser::MkvReader reader;
+    if (reader.Open(part.c_str()) != 0) {
+        AppLog::getInstance().error("Could not open %s\n", part.c_str());
+        return false;
+    }
+
+    long long pos = 0;
+    mkvparser::EBMLHeader header;
+    mkvparser::Segment* parsed = nullptr;
+    if (header.Parse(&reader, pos) < 0 ||
+        mkvparser::Segment::CreateInstance(&reader, pos, parsed) != 0) {
+        AppLog::getInstance().error("Could not parse %s\n", part.c_str());
+        reader.Close();
+        return false;
+    }
+
+    std::unique_ptr<mkvparser::Segment> input(parsed);
+    const mkvparser::Tracks* tracks = nullptr;
+    if (input->Load() < 0 || (tracks = input->GetTracks()) == nullptr ||
+        tracks->GetTracksCount() == 0) {
+        AppLog::getInstance().error("Could not load %s\n", part.c_str());
+        reader.Close();
+        return false;
+    }
+
+    // The output track takes the codec of the first part.
+    if (track == 0) {
+        track = output.AddVideoTrack(width, height, 1);
+        mkvmuxer::Track* outputTrack = output.GetTrackByNumber(track);
+        if (track == 0 || outputTrack == nullptr) {
+            AppLog::getInstance().error("Could not add video track\n");
+            reader.Close();
+            return false;
+        }
+        outputTrack->set_codec_id(tracks->GetTrackByIndex(0)->GetCodecId());
+    }
+
+    for (const mkvparser::Cluster* cluster = input->GetFirst();
+         cluster != nullptr && !cluster->EOS();
+         cluster = input->GetNext(cluster)) {
+        const mkvparser::BlockEntry* entry = nullptr;
+        if (cluster->GetFirst(entry) < 0) {
+            break;
+        }
+
+        while (entry != nullptr && !entry->EOS()) {
+            const mkvparser::Block* block = entry->GetBlock();
+
+            for (int i = 0; i < block->GetFrameCount(); i++) {
+                const mkvparser::Block::Frame& blockFrame = block->GetFrame(i);
+                buffer.resize(static_cast<size_t>(blockFrame.len));
+                if (blockFrame.Read(&reader, buffer.data()) < 0) {
+                    AppLog::getInstance().error("Could not read %s\n",
+                                                part.c_str());
+                    reader.Close();
+                    return false;
+                }
+
+                mkvmuxer::Frame frame;
+                if (!frame.Init(buffer.data(), buffer.size())) {
+                    reader.Close();
+                    return false;
+                }
+                frame.set_track_number(track);
+                frame.set_timestamp(block->GetTime(cluster) + offset);
+                frame.set_is_key(block->IsKey());
+                frame.set_duration(WebmFrameDuration);
+                if (!output.AddGenericFrame(&frame)) {
+                    AppLog::getInstance().error("Could not add frame\n");
+                    reader.Close();
+                    return false;
+                }
+            }
+
+            if (cluster->GetNext(entry, entry) < 0) {
+                break;
+            }
+        }
+    }
+
+    reader.Close();
+    return true;
+}
+}  // namespace
+
+bool joinY4mFiles(const std::vector<std::string>& parts,
+                  const std::string& fileName) {
+    PROFILE_SCOPE("joinY4mFiles");
+
+    FILE* out = fopen(fileName.c_str(), "wb");
+    if (out == nullptr) {
+        AppLog::getInstance().error("Could not open %s\n", fileName.c_str());
+        return false;
+    }
+
+    std::vector<char> buffer(4 * 1024 * 1024);
+    bool ok = true;
+
+    for (size_t i = 0; i < parts.size() && ok; i++) {
+        FILE* in = fopen(parts[i].c_str(), "rb");
+        if (in == nullptr) {
+            AppLog::getInstance().error("Could not open %s\n",
+                                        parts[i].c_str());
+            ok = false;
+            break;
+        }
+
+        // Every part starts with the same stream header, only the first
+        // one is kept.
+        for (int c = fgetc(in); c != EOF; c = fgetc(in)) {
+            if (i == 0) {
+                fputc(c, out);
+            }
+            if (c == '\n') {
+                break;
+            }
+        }
+
+        for (size_t size = fread(buffer.data(), 1, buffer.size(), in);
+             size > 0; size = fread(buffer.data(), 1, buffer.size(), in)) {
+            if (fwrite(buffer.data(), 1, size, out) != size) {
+                AppLog::getInstance().error("Could not write %s\n",
+                                            fileName.c_str());
+                ok = false;
+                break;
+            }
+        }
+
+        fclose(in);
+    }
+
+    if (fclose(out) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool joinWebmFiles(const std::vector<std::string>& parts,
+                   const std::vector<int64_t>& firstFrames, int32_t width,
+                   int32_t height, const std::string& fileName) {
+    PROFILE_SCOPE("joinWebmFiles");
+
+    MyMkvWriter writer(fileName);
+    mkvmuxer::Segment output;
+    if (!output.Init(&writer)) {
+        AppLog::getInstance().error("Could not initialize main segment\n");
+        writer.Notify();
+        return false;
+    }
+    output.set_mode(mkvmuxer::Segment::Mode::kFile);
+
+    uint64_t track = 0;
+    std::vector<uint8_t> buffer;
+    bool ok = true;
+
+    for (size_t i = 0; i < parts.size() && ok; i++) {
+        ok = copyWebmFrames(parts[i], firstFrames[i] * WebmFrameDuration,
+                            output, track, width, height, buffer);
+    }
+
+    if (!output.Finalize()) {
+        AppLog::getInstance().error("Could not finalize mkv\n");
+        ok = false;
+    }
+    if (!writer.Notify()) {
+        AppLog::getInstance().error("Could not write %s\n", fileName.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+bool joinMp4Files(const std::vector<std::string>& parts, int32_t width,
+                  int32_t height, const std::string& fileName) {
+    PROFILE_SCOPE("joinMp4Files");
+
+    std::vector<FILE*> files;
+    bool ok = true;
+
+    for (const std::string& part : parts) {
+        FILE* in = fopen(part.c_str(), "rb");
+        if (in == nullptr) {
+            AppLog::getInstance().error("Could not open %s\n", part.c_str());
+            ok = false;
+            break;
+        }
+        files.push_back(in);
+    }
+
+    FILE* out = ok ? fopen(fileName.c_str(), "wb") : nullptr;
+    if (ok && out == nullptr) {
+        AppLog::getInstance().error("Could not open %s\n", fileName.c_str());
+        ok = false;
+    }
+
+    if (ok && !MP4MuxJoin(out, files.data(),
+                          static_cast<int32_t>(files.size()), width, height)) {
+        AppLog::getInstance().error("Could not join %s\n", fileName.c_str());
+        ok = false;
+    }
+
+    if (out != nullptr && fclose(out) != 0) {
+        ok = false;
+    }
+    for (FILE* in : files) {
+        fclose(in);
+    }
+    return ok;
+}
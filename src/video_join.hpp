@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+// Joins the files of a segmented export into fileName. The parts were
+// written by the same kind of sink with the same frame size, and every part
+// starts on a keyframe.
+
+bool joinY4mFiles(const std::vector<std::string>& parts,
+                  const std::string& fileName);
+
+// firstFrames holds the index of the first frame of each part, the parts'
+// timestamps all start at 0.
+bool joinWebmFiles(const std::vector<std::string>& parts,
+                   const std::vector<int64_t>& firstFrames, int32_t width,
+                   int32_t height, const std::string& fileName);
+
+bool joinMp4Files(const std::vector<std::string>& parts, int32_t width,
+                  int32_t height, const std::string& fileName);
@@ -0,0 +1,245 @@
+#include "video_sink.hpp"
+#include "h264_encoder.hpp"
+#include "stream_sink.hpp"
+#include "png_sequence_sink.hpp"
+#include "gif_sink.hpp"
+#include "app_log.hpp"
+#include <math.h>
+#include <string.h>
+
+std::unique_ptr<VideoSink> VideoSink::create(
+    int32_t videoType, const std::string& fileName, int32_t width,
+    int32_t height, int32_t webmBitrate, unsigned long webmEncodeDeadline,
+    const WebmEncoderOptions& webmOptions,
+    const GifEncoderOptions& gifOptions) {
+    std::unique_ptr<VideoSink> sink = nullptr;
+    bool opened = false;
+
+    if (StreamSink::isStreamTarget(fileName)) {
+        if (videoType != 0 && videoType != 3) {
+            AppLog::getInstance().error(
+                "Only Y4M and raw RGBA can be streamed\n");
+            return nullptr;
+        }
+
+        auto stream =
+            std::make_unique<StreamSink>(width, height, videoType == 3);
+        opened = stream->open(fileName);
+        sink = std::move(stream);
+    } else {
+        switch (videoType) {
+            case 0: {
+                auto y4m = std::make_unique<Y4mSink>(width, height);
+                opened = y4m->open(fileName);
+                sink = std::move(y4m);
+            } break;
+            case 1: {
+                auto webm = std::make_unique<WebmSink>(width, height);
+                opened = webm->open(fileName, webmBitrate, webmEncodeDeadline,
+                                    webmOptions);
+                sink = std::move(webm);
+            } break;
+            case 2: {
+                auto h264 = std::make_unique<H264Sink>(width, height);
+                opened = h264->open(fileName);
+                sink = std::move(h264);
+            } break;
+            case 3:
+                AppLog::getInstance().error(
+                    "Raw RGBA can only be streamed\n");
+                return nullptr;
+            case 4: {
+                auto png = std::make_unique<PngSequenceSink>(width, height);
+                opened = png->open(fileName);
+                sink = std::move(png);
+            } break;
+            case 5: {
+                auto gif = std::make_unique<GifSink>(width, height);
+                opened = gif->open(fileName, gifOptions);
+                sink = std::move(gif);
+            } break;
+            default:
+                AppLog::getInstance().error("Unknown video type %d\n",
+                                            videoType);
+                return nullptr;
+        }
+    }
+
+    if (!opened) {
+        AppLog::getInstance().error("Could not start recording: %s\n",
+                                    sink->lastError().c_str());
+        return nullptr;
+    }
+
+    return sink;
+}
+
+std::string getY4mHeader(int32_t width, int32_t height) {
+    char header[128];
+    snprintf(header, sizeof(header),
+             "YUV4MPEG2 W%d H%d F30000:1001 Ip A0:0 C420 XYSCSS=420\n", width,
+             height);
+    return header;
+}
+
+bool Y4mSink::open(const std::string& fileName) {
+    if (!file.open(fileName)) {
+        last_error = "Could not open " + fileName;
+        return false;
+    }
+
+    const std::string header = getY4mHeader(width, height);
+    headerSize = static_cast<int64_t>(header.size());
+    return file.write(header.data(), header.size());
+}
+
+void Y4mSink::reserve(int64_t frameCount) {
+    const int64_t frameSize =
+        static_cast<int64_t>(strlen("FRAME\n") +
+                             getI420FrameSize(width, height));
+    file.preallocate(headerSize + frameSize * frameCount);
+}
+
+bool Y4mSink::writeFrame(const uint8_t* i420, int64_t frame) {
+    const size_t size = getI420FrameSize(width, height);
+
+    if (!file.write("FRAME\n", strlen("FRAME\n")) ||
+        !file.write(i420, size)) {
+        last_error = "Could not write frame";
+        return false;
+    }
+
+    if (!keepLastFrame) {
+        return true;
+    }
+
+    if (!lastFrame) {
+        lastFrame = std::make_unique<uint8_t[]>(size);
+    }
+    memcpy(lastFrame.get(), i420, size);
+    return true;
+}
+
+bool Y4mSink::writeDuplicateFrame(int64_t frame) {
+    // Y4M has no way to repeat a frame, but the copy is still cheaper than
+    // converting it again.
+    if (!lastFrame) {
+        last_error = "No frame to repeat";
+        return false;
+    }
+
+    if (!file.write("FRAME\n", strlen("FRAME\n")) ||
+        !file.write(lastFrame.get(), getI420FrameSize(width, height))) {
+        last_error = "Could not write frame";
+        return false;
+    }
+    return true;
+}
+
+void Y4mSink::setDuplicateFrames(bool enabled) {
+    keepLastFrame = enabled;
+    if (!keepLastFrame) {
+        lastFrame.reset();
+    }
+}
+
+bool Y4mSink::finalize() {
+    const bool ok = file.close();
+    file.logStats("Y4M output");
+
+    if (!ok) {
+        last_error = "Could not write file";
+    }
+    return ok;
+}
+
+bool WebmSink::open(const std::string& fileName, int32_t bitrate,
+                    unsigned long deadline,
+                    const WebmEncoderOptions& options) {
+    this->deadline = deadline;
+    this->bitrate = bitrate;
+
+    try {
+        pWebmEncoder = std::make_unique<WebmEncoder>(
+            fileName, 1001, 30000, width, height, bitrate, options);
+    } catch (const std::string& error) {
+        last_error = error;
+        return false;
+    }
+    return true;
+}
+
+void WebmSink::reserve(int64_t frameCount) {
+    // The rate control keeps close to the target bitrate, a little extra
+    // covers the container.
+    const double seconds = frameCount * 1001.0 / 30000.0;
+    pWebmEncoder->preallocate(
+        static_cast<int64_t>(bitrate * 1000.0 / 8.0 * seconds * 1.1));
+}
+
+bool WebmSink::writeFrame(const uint8_t* i420, int64_t frame) {
+    if (!pWebmEncoder->addI420Frame(i420, deadline)) {
+        last_error = pWebmEncoder->lastError();
+        return false;
+    }
+    return true;
+}
+
+bool WebmSink::writeDuplicateFrame(int64_t frame) {
+    pWebmEncoder->skipFrame();
+    return true;
+}
+
+bool WebmSink::finalize() {
+    if (!pWebmEncoder->finalize(deadline)) {
+        last_error = pWebmEncoder->lastError();
+        return false;
+    }
+    pWebmEncoder->getOutputFile().logStats("WebM output");
+    return true;
+}
+
+H264Sink::~H264Sink() {
+    if (pOpenH264Encoder != nullptr) {
+        h264encoder::DestroyOpenH264Encoder(pOpenH264Encoder);
+    }
+}
+
+bool H264Sink::open(const std::string& fileName) {
+    if (!file.open(fileName)) {
+        last_error = "Could not open " + fileName;
+        return false;
+    }
+
+    if (!h264encoder::CreateOpenH264Encoder(&pOpenH264Encoder, &pMP4Muxer,
+                                            &pMP4H264Writer, width, height,
+                                            &file)) {
+        pOpenH264Encoder = nullptr;
+        last_error = "Could not create H264 encoder";
+        return false;
+    }
+    return true;
+}
+
+bool H264Sink::writeFrame(const uint8_t* i420, int64_t frame) {
+    int64_t timestamp = roundl((frame + 1) * 1001 / 30000);
+    h264encoder::EncodeFrame(pOpenH264Encoder, pMP4H264Writer,
+                             const_cast<uint8_t*>(i420), width, height,
+                             timestamp);
+    return true;
+}
+
+bool H264Sink::finalize() {
+    h264encoder::Finalize(pOpenH264Encoder, pMP4Muxer, pMP4H264Writer);
+    pOpenH264Encoder = nullptr;
+    pMP4Muxer = nullptr;
+    pMP4H264Writer = nullptr;
+
+    const bool ok = file.close();
+    file.logStats("MP4 output");
+
+    if (!ok) {
+        last_error = "Could not write file";
+    }
+    return ok;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "common.hpp"
+#include "mp4muxer.h"
+#include "output_file.hpp"
+#include "webm_encoder.hpp"
+#include "gif_encoder.hpp"
+
+// Packed I420 frames, chroma planes of odd sizes are rounded up as in libyuv
+// and Y4M.
+inline int32_t getI420ChromaWidth(int32_t width) { return (width + 1) / 2; }
+inline int32_t getI420ChromaHeight(int32_t height) { return (height + 1) / 2; }
+inline size_t getI420FrameSize(int32_t width, int32_t height) {
+    return (size_t)width * height + (size_t)getI420ChromaWidth(width) *
+                                        getI420ChromaHeight(height) * 2;
+}
+
+std::string getY4mHeader(int32_t width, int32_t height);
+
+// Destination of the I420 frames produced by Recording. Sinks are only used
+// from one thread at a time, the encoder thread while recording.
+class VideoSink {
+   protected:
+    int32_t width = 0;
+    int32_t height = 0;
+    std::string last_error;
+
+   public:
+    VideoSink(int32_t width, int32_t height) : width(width), height(height) {}
+    virtual ~VideoSink() {}
+
+    // Hint of how many frames will be written, lets the output reserve its
+    // disk space up front.
+    virtual void reserve(int64_t frameCount) {}
+    // Sinks that accept RGBA get the bottom-up frames as read back, without
+    // any conversion to I420.
+    virtual bool acceptsRgba() const { return false; }
+    virtual bool writeFrame(const uint8_t* i420, int64_t frame) = 0;
+    // Sinks that can repeat their previous frame without its pixels are
+    // handed unchanged frames through writeDuplicateFrame(), which skips the
+    // conversion and the encode.
+    virtual bool acceptsDuplicateFrames() const { return false; }
+    virtual bool writeDuplicateFrame(int64_t frame) { return false; }
+    // Told before the first frame whether writeDuplicateFrame() will be
+    // used, sinks only keep what they need to repeat a frame if it is.
+    virtual void setDuplicateFrames(bool enabled) {}
+    virtual bool finalize() = 0;
+
+    const std::string& lastError() const { return last_error; }
+
+    // Returns nullptr, with the reason logged, if the output could not be
+    // opened.
+    static std::unique_ptr<VideoSink> create(
+        int32_t videoType, const std::string& fileName, int32_t width,
+        int32_t height, int32_t webmBitrate, unsigned long webmEncodeDeadline,
+        const WebmEncoderOptions& webmOptions,
+        const GifEncoderOptions& gifOptions);
+};
+
+class Y4mSink : public VideoSink {
+   private:
+    OutputFile file;
+    int64_t headerSize = 0;
+    // Kept to be written again for duplicates, if there are any.
+    bool keepLastFrame = false;
+    std::unique_ptr<uint8_t[]> lastFrame;
+
+   public:
+    Y4mSink(int32_t width, int32_t height) : VideoSink(width, height) {}
+
+    bool open(const std::string& fileName);
+    void reserve(int64_t frameCount) override;
+    bool writeFrame(const uint8_t* i420, int64_t frame) override;
+    bool acceptsDuplicateFrames() const override { return true; }
+    bool writeDuplicateFrame(int64_t frame) override;
+    void setDuplicateFrames(bool enabled) override;
+    bool finalize() override;
+};
+
+class WebmSink : public VideoSink {
+   private:
+    std::unique_ptr<WebmEncoder> pWebmEncoder = nullptr;
+    unsigned long deadline = 0;
+    int32_t bitrate = 0;
+
+   public:
+    WebmSink(int32_t width, int32_t height) : VideoSink(width, height) {}
+
+    bool open(const std::string& fileName, int32_t bitrate,
+              unsigned long deadline, const WebmEncoderOptions& options);
+    void reserve(int64_t frameCount) override;
+    bool writeFrame(const uint8_t* i420, int64_t frame) override;
+    bool acceptsDuplicateFrames() const override { return true; }
+    bool writeDuplicateFrame(int64_t frame) override;
+    bool finalize() override;
+};
+
+// Every frame is encoded in full, minimp4 writes samples of a fixed
+// duration.
+class H264Sink : public VideoSink {
+   private:
+    OutputFile file;
+    void* pOpenH264Encoder = nullptr;
+    MP4E_mux_t* pMP4Muxer = nullptr;
+    mp4_h26x_writer_t* pMP4H264Writer = nullptr;
+
+   public:
+    H264Sink(int32_t width, int32_t height) : VideoSink(width, height) {}
+    ~H264Sink();
+
+    bool open(const std::string& fileName);
+    bool writeFrame(const uint8_t* i420, int64_t frame) override;
+    bool finalize() override;
+};
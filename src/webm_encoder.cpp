@@ -1,4 +1,8 @@
 #include "webm_encoder.hpp"
+#include "cpu_profiler.hpp"
+
+#include <algorithm>
+#include <thread>
 
 using namespace mkvmuxer;
 
@@ -36,8 +40,10 @@ void clear_image(vpx_image_t *img) {
 
 WebmEncoder::WebmEncoder(const std::string &file, int timebase_num,
                          int timebase_den, unsigned int width,
-                         unsigned int height, unsigned int bitrate_kbps) {
-    if (!InitCodec(timebase_num, timebase_den, width, height, bitrate_kbps)) {
+                         unsigned int height, unsigned int bitrate_kbps,
+                         const WebmEncoderOptions &options) {
+    if (!InitCodec(timebase_num, timebase_den, width, height, bitrate_kbps,
+                   options)) {
         throw last_error;
     }
     if (!InitMkvWriter(file)) {
@@ -55,14 +61,46 @@ WebmEncoder::~WebmEncoder() {
 }
 
 bool WebmEncoder::addRGBAFrame(const uint8_t *rgba, unsigned long deadline) {
-    RGBAtoVPXImage(rgba);
+    {
+        PROFILE_SCOPE("WebmEncoder::RGBAtoVPXImage");
+        RGBAtoVPXImage(rgba);
+    }
+
+    if (!EncodeFrame(img, deadline)) {
+        return false;
+    }
+    return true;
+}
+
+bool WebmEncoder::addI420Frame(const uint8_t *i420, unsigned long deadline) {
+    {
+        PROFILE_SCOPE("WebmEncoder::I420toVPXImage");
+        if (!I420toVPXImage(i420)) {
+            return false;
+        }
+    }
+
     if (!EncodeFrame(img, deadline)) {
         return false;
     }
     return true;
 }
 
+void WebmEncoder::skipFrame() {
+    frame_cnt++;
+    skipped_cnt++;
+}
+
 bool WebmEncoder::finalize(unsigned long deadline) {
+    // Skipped frames at the end would not count towards the duration, the
+    // last one is encoded again from the image still in img.
+    if (skipped_cnt > 0) {
+        frame_cnt--;
+        if (!EncodeFrame(img, deadline)) {
+            return false;
+        }
+    }
+
     if (!EncodeFrame(NULL, deadline)) {
         last_error = "Could not encode flush frame";
         return false;
@@ -72,19 +110,33 @@ bool WebmEncoder::finalize(unsigned long deadline) {
         last_error = "Could not finalize mkv";
         return false;
     }
-    mkv_writer->Notify();
+    if (!mkv_writer->Notify()) {
+        last_error = "Could not write mkv";
+        return false;
+    }
     return true;
 }
 
+bool WebmEncoder::preallocate(int64_t size) {
+    return mkv_writer->Preallocate(size);
+}
+
+const OutputFile &WebmEncoder::getOutputFile() const {
+    return mkv_writer->GetFile();
+}
+
 std::string WebmEncoder::lastError() { return std::string(last_error); }
 
 bool WebmEncoder::EncodeFrame(vpx_image_t *img, unsigned long deadline) {
+    PROFILE_SCOPE("WebmEncoder::EncodeFrame");
+
     vpx_codec_iter_t iter = NULL;
     const vpx_codec_cx_pkt_t *pkt;
     vpx_codec_err_t err;
 
     err = vpx_codec_encode(&ctx, img, frame_cnt, 1, 0, deadline);
     frame_cnt++;
+    skipped_cnt = 0;
     if (err != VPX_CODEC_OK) {
         last_error = std::string(vpx_codec_err_to_string(err));
         return false;
@@ -117,7 +169,11 @@ bool WebmEncoder::EncodeFrame(vpx_image_t *img, unsigned long deadline) {
 
 bool WebmEncoder::InitCodec(int timebase_num, int timebase_den,
                             unsigned int width, unsigned int height,
-                            unsigned int bitrate) {
+                            unsigned int bitrate,
+                            const WebmEncoderOptions &options) {
+    vp9 = options.vp9;
+    iface = vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx();
+
     vpx_codec_err_t err;
     err = vpx_codec_enc_config_default(iface, &cfg, 0);
     if (err != VPX_CODEC_OK) {
@@ -130,7 +186,44 @@ bool WebmEncoder::InitCodec(int timebase_num, int timebase_den,
     cfg.g_h = height;
     cfg.rc_target_bitrate = bitrate;
 
+#ifdef __EMSCRIPTEN__
+    cfg.g_threads = 1;
+#else
+    cfg.g_threads = options.threads > 0
+                        ? options.threads
+                        : std::max(1u, std::thread::hardware_concurrency());
+#endif
+
     err = vpx_codec_enc_init(&ctx, iface, &cfg, 0);
+    if (err != VPX_CODEC_OK) {
+        last_error = std::string(vpx_codec_err_to_string(err));
+        return false;
+    }
+
+    err = vpx_codec_control(&ctx, VP8E_SET_CPUUSED,
+                            vp9 ? std::min(options.cpuUsed, 8)
+                                : options.cpuUsed);
+    if (err != VPX_CODEC_OK) {
+        last_error = std::string(vpx_codec_err_to_string(err));
+        return false;
+    }
+
+    if (vp9) {
+        err = vpx_codec_control(&ctx, VP9E_SET_TILE_COLUMNS,
+                                options.tileColumns);
+        if (err == VPX_CODEC_OK) {
+            err = vpx_codec_control(&ctx, VP9E_SET_ROW_MT,
+                                    options.rowMultithreading ? 1 : 0);
+        }
+        if (err == VPX_CODEC_OK) {
+            err = vpx_codec_control(&ctx, VP9E_SET_FRAME_PARALLEL_DECODING,
+                                    options.frameParallel ? 1 : 0);
+        }
+    } else {
+        err = vpx_codec_control(&ctx, VP8E_SET_TOKEN_PARTITIONS,
+                                options.tokenPartitions);
+    }
+
     if (err != VPX_CODEC_OK) {
         last_error = std::string(vpx_codec_err_to_string(err));
         return false;
@@ -140,16 +233,32 @@ bool WebmEncoder::InitCodec(int timebase_num, int timebase_den,
 
 bool WebmEncoder::InitMkvWriter(const std::string &file) {
     mkv_writer = new MyMkvWriter(file);
+    if (!mkv_writer->IsOpen()) {
+        last_error = "Could not open " + file;
+        return false;
+    }
 
     main_segment = new Segment();
     if (!main_segment->Init(mkv_writer)) {
         last_error = "Could not initialize main segment";
         return false;
     }
-    if (main_segment->AddVideoTrack(cfg.g_w, cfg.g_h, 1) == 0) {
+    const uint64 track_number =
+        main_segment->AddVideoTrack(cfg.g_w, cfg.g_h, 1);
+    if (track_number == 0) {
         last_error = "Could not add video track";
         return false;
     }
+
+    // Tracks default to VP8.
+    if (vp9) {
+        Track *track = main_segment->GetTrackByNumber(track_number);
+        if (track == NULL) {
+            last_error = "Could not get video track";
+            return false;
+        }
+        track->set_codec_id(Tracks::kVp9CodecId);
+    }
     main_segment->set_mode(Segment::Mode::kFile);
     return true;
 }
@@ -174,3 +283,23 @@ bool WebmEncoder::RGBAtoVPXImage(const uint8_t *rgba) {
     }
     return true;
 }
+
+bool WebmEncoder::I420toVPXImage(const uint8_t *i420) {
+    const int width = cfg.g_w;
+    const int height = cfg.g_h;
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const uint8_t *y = i420;
+    const uint8_t *u = y + width * height;
+    const uint8_t *v = u + chromaWidth * chromaHeight;
+
+    if (libyuv::I420Copy(y, width, u, chromaWidth, v, chromaWidth,
+                         img->planes[VPX_PLANE_Y], img->stride[VPX_PLANE_Y],
+                         img->planes[VPX_PLANE_U], img->stride[VPX_PLANE_U],
+                         img->planes[VPX_PLANE_V], img->stride[VPX_PLANE_V],
+                         width, height) != 0) {
+        last_error = "Could not copy I420 frame";
+        return false;
+    }
+    return true;
+}
@@ -5,6 +5,7 @@
 
 #include <string>
 #include <cstdlib>
+#include <stdint.h>
 
 // libwebm
 #include <mkvmuxer.hpp>
@@ -16,28 +17,67 @@
 
 #include "mymkvwriter.hpp"
 
+// libvpx settings that trade compression for encode speed.
+struct WebmEncoderOptions {
+    // 0 uses one thread per hardware thread.
+    int32_t threads = 0;
+    // log2 of the number of token partitions (0 to 3), more partitions let
+    // the encoder threads work on more rows at once.
+    int32_t tokenPartitions = 2;
+    // VP8E_SET_CPUUSED, higher is faster and lower quality. VP9 only goes
+    // up to 8.
+    int32_t cpuUsed = 4;
+
+    // VP9 compresses better and scales across more cores than VP8 through
+    // tile columns (log2, limited by the frame width) and row-based
+    // multithreading. Frame parallel mode drops the dependency on the
+    // previous frame's context, which lets decoders use more threads.
+    bool vp9 = false;
+    int32_t tileColumns = 2;
+    bool rowMultithreading = true;
+    bool frameParallel = false;
+};
+
+const int32_t WebmSpeedPresetCount = 5;
+const char *const WebmSpeedPresetNames[WebmSpeedPresetCount] = {
+    "slowest", "slow", "medium", "fast", "fastest"};
+const int32_t WebmSpeedPresetCpuUsed[WebmSpeedPresetCount] = {0, 2, 4, 8, 16};
+
 class WebmEncoder {
    public:
     WebmEncoder(const std::string &file, int timebase_num, int timebase_den,
-                unsigned int width, unsigned int height, unsigned int bitrate);
+                unsigned int width, unsigned int height, unsigned int bitrate,
+                const WebmEncoderOptions &options = WebmEncoderOptions());
     ~WebmEncoder();
     bool addRGBAFrame(const uint8_t *rgba, unsigned long deadline);
+    // i420 is tightly packed: Y, then U and V at half resolution.
+    bool addI420Frame(const uint8_t *i420, unsigned long deadline);
+    // Repeats the previous frame: nothing is encoded, it stays on screen
+    // until the next frame's timestamp.
+    void skipFrame();
     bool finalize(unsigned long deadline);
+    bool preallocate(int64_t size);
+    const OutputFile &getOutputFile() const;
     std::string lastError();
 
    private:
     bool InitCodec(int timebase_num, int timebase_den, unsigned int width,
-                   unsigned int height, unsigned int bitrate);
+                   unsigned int height, unsigned int bitrate,
+                   const WebmEncoderOptions &options);
     bool InitMkvWriter(const std::string &file);
     bool InitImageBuffer();
 
     bool RGBAtoVPXImage(const uint8_t *data);
+    bool I420toVPXImage(const uint8_t *data);
     bool EncodeFrame(vpx_image_t *img, unsigned long deadline);
 
     vpx_codec_ctx_t ctx;
     unsigned int frame_cnt = 0;
+    // Frames skipped since the last encoded one.
+    unsigned int skipped_cnt = 0;
     vpx_codec_enc_cfg_t cfg;
     vpx_codec_iface_t *iface = vpx_codec_vp8_cx();
+    bool vp9 = false;
     vpx_image_t *img;
     std::string last_error;
     MyMkvWriter *mkv_writer;
@@ -0,0 +1,214 @@
+// Decodes frames written by writeGifFrame() with a strict LZW decoder and
+// checks that the indices come back unchanged and that the stream ends in a
+// Clear and an End code read at the width the decoder expects.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gif_encoder.hpp"
+
+namespace {
+const int32_t MinCodeSize = 8;
+const int32_t ClearCode = 1 << MinCodeSize;
+const int32_t EndCode = ClearCode + 1;
+const int32_t MaxCodes = 4096;
+
+class BitReader {
+   private:
+    const std::vector<uint8_t>& bytes;
+    size_t position = 0;
+
+   public:
+    explicit BitReader(const std::vector<uint8_t>& bytes) : bytes(bytes) {}
+
+    bool read(int32_t size, int32_t& code) {
+        if (position + size > bytes.size() * 8) {
+            return false;
+        }
+        code = 0;
+        for (int32_t i = 0; i < size; i++, position++) {
+            const int32_t bit = (bytes[position / 8] >> (position % 8)) & 1;
+            code |= bit << i;
+        }
+        return true;
+    }
+
+    // Bits after the current position, only padding is allowed there.
+    size_t getRemainingBits() const { return bytes.size() * 8 - position; }
+};
+
+// Returns an empty string on success, otherwise what went wrong.
+std::string decodeFrame(const std::vector<uint8_t>& frame,
+                        std::vector<uint8_t>& indices) {
+    // Graphic control extension and image descriptor.
+    size_t offset = 8 + 10;
+    if (frame.size() < offset + 1 || frame[8] != 0x2c) {
+        return "no image descriptor";
+    }
+    if (frame[offset - 1] & 0x80) {
+        offset += 3 * (2 << (frame[offset - 1] & 0x07));
+    }
+
+    if (frame[offset++] != MinCodeSize) {
+        return "unexpected minimum code size";
+    }
+
+    std::vector<uint8_t> data;
+    for (;;) {
+        if (offset >= frame.size()) {
+            return "unterminated sub-blocks";
+        }
+        const size_t size = frame[offset++];
+        if (size == 0) {
+            break;
+        }
+        if (offset + size > frame.size()) {
+            return "truncated sub-block";
+        }
+        data.insert(data.end(), frame.begin() + offset,
+                    frame.begin() + offset + size);
+        offset += size;
+    }
+    if (offset != frame.size()) {
+        return "data after the sub-blocks";
+    }
+
+    std::vector<int32_t> prefixes(MaxCodes);
+    std::vector<uint8_t> suffixes(MaxCodes);
+    std::vector<uint8_t> firsts(MaxCodes);
+    std::vector<uint8_t> string;
+
+    BitReader reader(data);
+    int32_t codeSize = MinCodeSize + 1;
+    int32_t nextCode = EndCode + 1;
+    int32_t previous = -1;
+    bool cleared = false;
+
+    indices.clear();
+    for (;;) {
+        int32_t code = 0;
+        if (!reader.read(codeSize, code)) {
+            return "missing End code";
+        }
+
+        if (code == ClearCode) {
+            codeSize = MinCodeSize + 1;
+            nextCode = EndCode + 1;
+            previous = -1;
+            cleared = true;
+            continue;
+        }
+        if (code == EndCode) {
+            break;
+        }
+        if (!cleared) {
+            return "no Clear code before the first code";
+        }
+
+        if (previous < 0) {
+            if (code >= ClearCode) {
+                return "first code after a Clear is not a literal";
+            }
+            indices.push_back(static_cast<uint8_t>(code));
+            previous = code;
+            continue;
+        }
+
+        if (code > nextCode) {
+            return "code " + std::to_string(code) + " not in the table";
+        }
+
+        // The string of the code, or of the previous code and its own first
+        // index for the one being defined.
+        string.clear();
+        int32_t c = code == nextCode ? previous : code;
+        while (c >= ClearCode) {
+            string.push_back(suffixes[c]);
+            c = prefixes[c];
+        }
+        string.push_back(static_cast<uint8_t>(c));
+        const uint8_t first = static_cast<uint8_t>(c);
+        indices.insert(indices.end(), string.rbegin(), string.rend());
+        if (code == nextCode) {
+            indices.push_back(first);
+        }
+
+        if (nextCode < MaxCodes) {
+            prefixes[nextCode] = previous;
+            suffixes[nextCode] = first;
+            nextCode++;
+            if (nextCode == (1 << codeSize) && codeSize < 12) {
+                codeSize++;
+            }
+        }
+        previous = code;
+    }
+
+    if (reader.getRemainingBits() >= 8) {
+        return "data after the End code";
+    }
+    return "";
+}
+
+bool checkRoundTrip(const char* name, const std::vector<uint8_t>& indices) {
+    std::vector<uint8_t> frame;
+    writeGifFrame(indices.data(), static_cast<int32_t>(indices.size()), 1,
+                  nullptr, 0, frame);
+
+    std::vector<uint8_t> decoded;
+    const std::string error = decodeFrame(frame, decoded);
+    if (!error.empty()) {
+        printf("FAIL: %s, %zu indices: %s\n", name, indices.size(),
+               error.c_str());
+        return false;
+    }
+    if (decoded != indices) {
+        printf("FAIL: %s, %zu indices: decoded %zu different indices\n",
+               name, indices.size(), decoded.size());
+        return false;
+    }
+    return true;
+}
+}  // namespace
+
+int main() {
+    int32_t failures = 0;
+    int32_t checks = 0;
+
+    // Every length up to a few table resets, so the code width changes
+    // right before the last code for some of them.
+    uint32_t state = 0x12345678u;
+    for (size_t count = 1; count <= 6000; count++) {
+        std::vector<uint8_t> random(count);
+        std::vector<uint8_t> runs(count);
+        std::vector<uint8_t> few(count);
+        for (size_t i = 0; i < count; i++) {
+            state = state * 1664525u + 1013904223u;
+            random[i] = static_cast<uint8_t>(state >> 24);
+            runs[i] = static_cast<uint8_t>(i / 37);
+            few[i] = static_cast<uint8_t>((state >> 24) & 3);
+        }
+
+        failures += !checkRoundTrip("random", random);
+        failures += !checkRoundTrip("runs", runs);
+        failures += !checkRoundTrip("four colors", few);
+        checks += 3;
+    }
+
+    // Long enough for the table to fill up and be cleared many times.
+    std::vector<uint8_t> large(1 << 20);
+    for (uint8_t& index : large) {
+        state = state * 1664525u + 1013904223u;
+        index = static_cast<uint8_t>(state >> 24);
+    }
+    failures += !checkRoundTrip("large", large);
+    std::vector<uint8_t> constant(1 << 20, 7);
+    failures += !checkRoundTrip("constant", constant);
+    checks += 2;
+
+    printf("%s: %d of %d frames decoded\n", failures == 0 ? "PASS" : "FAIL",
+           checks - failures, checks);
+    return failures == 0 ? 0 : 1;
+}
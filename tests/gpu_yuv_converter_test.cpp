@@ -0,0 +1,238 @@
+// Checks the GPU I420 conversion against libyuv's BT.601 conversion of the
+// same frames. Renders through a headless EGL context and exits with 77
+// (skipped) where none can be created.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <libyuv.h>
+
+#include "common.hpp"
+#include "gpu_yuv_converter.hpp"
+#include "headless.hpp"
+
+namespace {
+const int32_t SkipExitCode = 77;
+
+struct Pattern {
+    const char* name;
+    void (*fill)(std::vector<uint8_t>& rgba, int32_t width, int32_t height);
+};
+
+void setPixel(std::vector<uint8_t>& rgba, int32_t width, int32_t x,
+              int32_t y, uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t* p = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
+    p[3] = 255;
+}
+
+// Black, white and the primary and secondary colors, the extremes of each
+// plane's range.
+void fillEdgeColors(std::vector<uint8_t>& rgba, int32_t width,
+                    int32_t height) {
+    const uint8_t colors[][3] = {
+        {0, 0, 0},     {255, 255, 255}, {255, 0, 0},   {0, 255, 0},
+        {0, 0, 255},   {0, 255, 255},   {255, 0, 255}, {255, 255, 0},
+    };
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++) {
+            // Blocks of 2x2 so that each chroma sample sees one color.
+            const uint8_t* c = colors[(x / 2 + y / 2) % 8];
+            setPixel(rgba, width, x, y, c[0], c[1], c[2]);
+        }
+    }
+}
+
+// Single pixel checkerboard of the extremes, every chroma sample averages
+// four different colors.
+void fillCheckerboard(std::vector<uint8_t>& rgba, int32_t width,
+                      int32_t height) {
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++) {
+            if ((x + y) % 2 == 0) {
+                setPixel(rgba, width, x, y, 255, 0, 255);
+            } else {
+                setPixel(rgba, width, x, y, 0, 255, 0);
+            }
+        }
+    }
+}
+
+void fillGradient(std::vector<uint8_t>& rgba, int32_t width, int32_t height) {
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++) {
+            setPixel(rgba, width, x, y,
+                     static_cast<uint8_t>(x * 255 / (width - 1)),
+                     static_cast<uint8_t>(y * 255 / (height - 1)),
+                     static_cast<uint8_t>((x + y) * 255 /
+                                          (width + height - 2)));
+        }
+    }
+}
+
+void fillNoise(std::vector<uint8_t>& rgba, int32_t width, int32_t height) {
+    uint32_t state = 0x12345678u;
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++) {
+            state = state * 1664525u + 1013904223u;
+            setPixel(rgba, width, x, y, static_cast<uint8_t>(state >> 24),
+                     static_cast<uint8_t>(state >> 16),
+                     static_cast<uint8_t>(state >> 8));
+        }
+    }
+}
+
+const Pattern Patterns[] = {
+    {"edge colors", fillEdgeColors},
+    {"checkerboard", fillCheckerboard},
+    {"gradient", fillGradient},
+    {"noise", fillNoise},
+};
+
+// A quad covering the viewport, as the app draws its passes.
+struct Quad {
+    GLuint positions = 0;
+    GLuint indices = 0;
+    GLuint vertexArray = 0;
+
+    void initialize() {
+        const GLfloat vertices[] = {-1.0f, 1.0f,  0.0f, 1.0f, 1.0f,  0.0f,
+                                    -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f};
+        const GLushort elements[] = {0, 2, 1, 1, 2, 3};
+
+        glGenVertexArrays(1, &vertexArray);
+        glBindVertexArray(vertexArray);
+
+        glGenBuffers(1, &positions);
+        glBindBuffer(GL_ARRAY_BUFFER, positions);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices,
+                     GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+        glGenBuffers(1, &indices);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements), elements,
+                     GL_STATIC_DRAW);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void cleanup() {
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &positions);
+        glDeleteBuffers(1, &indices);
+    }
+};
+
+// Returns the largest difference between the planes, or -1 if the size
+// cannot be converted.
+int32_t convertAndCompare(const Pattern& pattern, int32_t width,
+                          int32_t height, const Quad& quad) {
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    pattern.fill(rgba, width, height);
+
+    // Rows are uploaded in order, so the first row ends up at the bottom
+    // like a rendered frame read back with glReadPixels.
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, rgba.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GpuYuvConverter converter;
+    if (!converter.initialize(width, height)) {
+        glDeleteTextures(1, &texture);
+        return -1;
+    }
+
+    const int32_t halfWidth = width / 2;
+    const size_t ySize = static_cast<size_t>(width) * height;
+    const size_t uSize = static_cast<size_t>(halfWidth) * (height / 2);
+
+    std::vector<uint8_t> actual(ySize + uSize * 2);
+    converter.convert(texture, quad.vertexArray);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height * 3 / 2, GL_RED, GL_UNSIGNED_BYTE,
+                 actual.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    converter.cleanup();
+    glDeleteTextures(1, &texture);
+
+    std::vector<uint8_t> expected(ySize + uSize * 2);
+    uint8_t* y = expected.data();
+    uint8_t* u = y + ySize;
+    uint8_t* v = u + uSize;
+    libyuv::ABGRToI420(rgba.data(), width * 4, y, width, u, halfWidth, v,
+                       halfWidth, width, -height);
+
+    int32_t maxDifference = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        maxDifference =
+            std::max(maxDifference, abs(expected[i] - actual[i]));
+    }
+    return maxDifference;
+}
+}  // namespace
+
+int main() {
+    if (!HeadlessContext::isSupported()) {
+        printf("SKIP: built without EGL\n");
+        return SkipExitCode;
+    }
+
+    HeadlessContext context;
+    if (!context.initialize()) {
+        printf("SKIP: no headless OpenGL context\n");
+        return SkipExitCode;
+    }
+
+    // Square, wide and tall frames, and widths whose chroma rows have an
+    // odd number of samples.
+    const int32_t sizes[][2] = {
+        {16, 16}, {64, 8}, {8, 64}, {18, 12}, {30, 20}, {1922, 1084},
+    };
+
+    Quad quad;
+    quad.initialize();
+
+    int32_t failures = 0;
+    for (const auto& size : sizes) {
+        for (const Pattern& pattern : Patterns) {
+            const int32_t difference =
+                convertAndCompare(pattern, size[0], size[1], quad);
+            const bool ok = difference >= 0 && difference <= 1;
+            printf("%s: %s %dx%d, max difference %d\n", ok ? "PASS" : "FAIL",
+                   pattern.name, size[0], size[1], difference);
+            if (!ok) {
+                failures++;
+            }
+        }
+    }
+
+    // The chroma rows are packed in pairs, heights that do not split into
+    // whole pairs are left to the CPU.
+    if (GpuYuvConverter::isSupported(16, 6) ||
+        GpuYuvConverter::isSupported(15, 8)) {
+        printf("FAIL: unsupported sizes are accepted\n");
+        failures++;
+    }
+
+    quad.cleanup();
+    context.cleanup();
+
+    return failures == 0 ? 0 : 1;
+}